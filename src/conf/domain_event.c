@@ -1229,6 +1229,7 @@ virDomainEventBalloonChangeNewFromDom(virDomainPtr dom,
         return NULL;
 
     ev->actual = actual;
+    ev->parent.parent.coalesce = true;
 
     return (virObjectEventPtr)ev;
 }
@@ -1247,6 +1248,7 @@ virDomainEventBalloonChangeNewFromObj(virDomainObjPtr obj,
         return NULL;
 
     ev->actual = actual;
+    ev->parent.parent.coalesce = true;
 
     return (virObjectEventPtr)ev;
 }
@@ -30,8 +30,10 @@
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "viruri.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -52,6 +54,7 @@ struct _virObjectEventCallback {
     virFreeCallback freecb;
     bool deleted;
     bool legacy; /* true if end user does not know callbackID */
+    bool coalesce; /* skip events superseded by a newer queued one */
 };
 typedef struct _virObjectEventCallback virObjectEventCallback;
 typedef virObjectEventCallback *virObjectEventCallbackPtr;
@@ -60,11 +63,16 @@ struct _virObjectEventCallbackList {
     unsigned int nextID;
     size_t count;
     virObjectEventCallbackPtr *callbacks;
+    size_t ncoalesce; /* callbacks with @coalesce set */
 };
 
 struct _virObjectEventQueue {
     size_t count;
     virObjectEventPtr *events;
+    /* the latest queued event with @coalesce set for each class, event
+     * ID, remote ID and object; the values are indexes into @events,
+     * plus 1 */
+    virHashTablePtr coalesce;
 };
 typedef struct _virObjectEventQueue virObjectEventQueue;
 typedef virObjectEventQueue *virObjectEventQueuePtr;
@@ -253,6 +261,8 @@ virObjectEventCallbackListRemoveID(virConnectPtr conn,
              * function won't end up with a double free error */
             if (doFreeCb && cb->freecb)
                 (*cb->freecb)(cb->opaque);
+            if (cb->coalesce)
+                cbList->ncoalesce--;
             virObjectEventCallbackFree(cb);
             VIR_DELETE_ELEMENT(cbList->callbacks, i, cbList->count);
             return ret;
@@ -302,6 +312,8 @@ virObjectEventCallbackListPurgeMarked(virObjectEventCallbackListPtr cbList)
             virFreeCallback freecb = cbList->callbacks[n]->freecb;
             if (freecb)
                 (*freecb)(cbList->callbacks[n]->opaque);
+            if (cbList->callbacks[n]->coalesce)
+                cbList->ncoalesce--;
             virObjectEventCallbackFree(cbList->callbacks[n]);
 
             VIR_DELETE_ELEMENT(cbList->callbacks, n, cbList->count);
@@ -366,6 +378,37 @@ virObjectEventCallbackLookup(virConnectPtr conn,
 }
 
 
+/**
+ * virObjectEventConnWantsCoalesce:
+ * @conn: pointer to the connection
+ *
+ * Connections opened with "coalesce_events=1" in their URI only care
+ * about the current state of the objects they watch. Events which
+ * merely carry that state, such as balloon changes or storage pool
+ * refreshes, are not dispatched to their callbacks if a newer event of
+ * the same kind for the same object was queued in the meantime.
+ *
+ * Returns: true if @conn asked for coalescing events, false otherwise.
+ */
+static bool
+virObjectEventConnWantsCoalesce(virConnectPtr conn)
+{
+    size_t i;
+
+    if (!conn->uri)
+        return false;
+
+    for (i = 0; i < conn->uri->paramsCount; i++) {
+        virURIParamPtr param = &conn->uri->params[i];
+
+        if (STRCASEEQ(param->name, "coalesce_events"))
+            return STREQ_NULLABLE(param->value, "1");
+    }
+
+    return false;
+}
+
+
 /**
  * virObjectEventCallbackListAddID:
  * @conn: pointer to the connection
@@ -441,10 +484,14 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     cb->filter = filter;
     cb->filter_opaque = filter_opaque;
     cb->legacy = legacy;
+    cb->coalesce = virObjectEventConnWantsCoalesce(conn);
 
     if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0)
         goto cleanup;
 
+    if (cbList->callbacks[cbList->count - 1]->coalesce)
+        cbList->ncoalesce++;
+
     /* When additional filtering is being done, every client callback
      * is matched to exactly one server callback.  */
     if (filter) {
@@ -479,6 +526,7 @@ virObjectEventQueueClear(virObjectEventQueuePtr queue)
         virObjectUnref(queue->events[i]);
     VIR_FREE(queue->events);
     queue->count = 0;
+    virHashRemoveAll(queue->coalesce);
 }
 
 /**
@@ -494,13 +542,21 @@ virObjectEventQueueFree(virObjectEventQueuePtr queue)
         return;
 
     virObjectEventQueueClear(queue);
+    virHashFree(queue->coalesce);
     VIR_FREE(queue);
 }
 
 static virObjectEventQueuePtr
 virObjectEventQueueNew(void)
 {
-    return g_new0(virObjectEventQueue, 1);
+    virObjectEventQueuePtr queue = g_new0(virObjectEventQueue, 1);
+
+    if (!(queue->coalesce = virHashNew(NULL))) {
+        VIR_FREE(queue);
+        return NULL;
+    }
+
+    return queue;
 }
 
 
@@ -632,6 +688,7 @@ virObjectEventNew(virClassPtr klass,
  * virObjectEventQueuePush:
  * @evtQueue: the object event queue
  * @event: the event to add
+ * @coalesce: whether any callback skips superseded events
  *
  * Internal function to push to the back of a virObjectEventQueue
  *
@@ -639,13 +696,35 @@ virObjectEventNew(virClassPtr klass,
  */
 static int
 virObjectEventQueuePush(virObjectEventQueuePtr evtQueue,
-                        virObjectEventPtr event)
+                        virObjectEventPtr event,
+                        bool coalesce)
 {
+    g_autofree char *key = NULL;
+    size_t pos;
+
     if (!evtQueue)
         return -1;
 
+    if (coalesce && event->coalesce) {
+        key = g_strdup_printf("%s:%d:%d:%s",
+                              virClassName(event->parent.klass),
+                              event->eventID, event->remoteID,
+                              event->meta.key);
+
+        if ((pos = (size_t)virHashLookup(evtQueue->coalesce, key)) > 0) {
+            VIR_DEBUG("event %p supersedes queued event %p",
+                      event, evtQueue->events[pos - 1]);
+            evtQueue->events[pos - 1]->superseded = true;
+        }
+    }
+
     if (VIR_APPEND_ELEMENT(evtQueue->events, evtQueue->count, event) < 0)
         return -1;
+
+    if (key)
+        ignore_value(virHashUpdateEntry(evtQueue->coalesce, key,
+                                        (void *)evtQueue->count));
+
     return 0;
 }
 
@@ -691,6 +770,9 @@ virObjectEventStateDispatchCallbacks(virObjectEventStatePtr state,
         if (!virObjectEventDispatchMatchCallback(event, cb))
             continue;
 
+        if (event->superseded && cb->coalesce)
+            continue;
+
         /* Drop the lock while dispatching, for sake of re-entrance */
         virObjectUnlock(state);
         event->dispatch(cb->conn, event, cb->cb, cb->opaque);
@@ -744,7 +826,8 @@ virObjectEventStateQueueRemote(virObjectEventStatePtr state,
     virObjectLock(state);
 
     event->remoteID = remoteID;
-    if (virObjectEventQueuePush(state->queue, event) < 0) {
+    if (virObjectEventQueuePush(state->queue, event,
+                                state->callbacks->ncoalesce > 0) < 0) {
         VIR_DEBUG("Error adding event to queue");
         virObjectUnref(event);
     }
@@ -808,6 +891,7 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
     tempQueue.events = state->queue->events;
     state->queue->count = 0;
     state->queue->events = NULL;
+    virHashRemoveAll(state->queue->coalesce);
     if (state->timer != -1)
         virEventUpdateTimeout(state->timer, -1);
 
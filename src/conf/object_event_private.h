@@ -48,6 +48,12 @@ struct  __attribute__((aligned(8))) _virObjectEvent {
     virObjectMeta meta;
     int remoteID;
     virObjectEventDispatchFunc dispatch;
+    /* The event only carries the current state of the object, so a newer
+     * event of the same class and ID for the same object supersedes it
+     * while both are still queued, for callbacks of connections which
+     * asked for that with "coalesce_events=1" in their URI */
+    bool coalesce;
+    bool superseded;
 };
 
 /**
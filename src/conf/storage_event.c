@@ -293,5 +293,8 @@ virStoragePoolEventRefreshNew(const char *name,
                                     0, name, uuid, uuidstr)))
         return NULL;
 
+    /* pending refreshes of the same pool are indistinguishable */
+    event->parent.parent.coalesce = true;
+
     return (virObjectEventPtr)event;
 }
@@ -48,6 +48,13 @@ struct _virNodeDeviceObjList {
      * for O(1), lockless lookup-by-name */
     virHashTable *objs;
 
+    /* Secondary indexes kept in sync with @objs by
+     * virNodeDeviceObjListAssignDef and virNodeDeviceObjListRemove.
+     * They don't hold a reference on the objects. */
+    virHashTable *sysfsPaths; /* sysfs path -> virNodeDeviceObj */
+    virHashTable *mdevUUIDs;  /* mdev UUID -> virNodeDeviceObj */
+    virHashTable *scsiHosts;  /* name -> virNodeDeviceObj with a SCSI
+                                 host capability */
 };
 
 
@@ -197,21 +204,45 @@ virNodeDeviceObjListSearch(virNodeDeviceObjListPtr devs,
 }
 
 
-static int
-virNodeDeviceObjListFindBySysfsPathCallback(const void *payload,
-                                            const char *name G_GNUC_UNUSED,
-                                            const void *opaque)
+/* Like virNodeDeviceObjListSearch, but only searches devices which have
+ * a SCSI host capability as none of the others can match @callback. */
+static virNodeDeviceObjPtr
+virNodeDeviceObjListSearchSCSIHosts(virNodeDeviceObjListPtr devs,
+                                    virHashSearcher callback,
+                                    const void *data)
 {
-    virNodeDeviceObjPtr obj = (virNodeDeviceObjPtr) payload;
-    const char *sysfs_path = opaque;
-    int want = 0;
+    virNodeDeviceObjPtr obj;
 
-    virObjectLock(obj);
-    if (obj->def->sysfs_path &&
-        STREQ_NULLABLE(obj->def->sysfs_path, sysfs_path))
-        want = 1;
-    virObjectUnlock(obj);
-    return want;
+    virObjectRWLockRead(devs);
+    obj = virHashSearch(devs->scsiHosts, callback, data, NULL);
+    virObjectRef(obj);
+    virObjectRWUnlock(devs);
+
+    if (obj)
+        virObjectLock(obj);
+
+    return obj;
+}
+
+
+static virNodeDeviceObjPtr
+virNodeDeviceObjListFindByIndex(virNodeDeviceObjListPtr devs,
+                                virHashTablePtr index,
+                                const char *key)
+{
+    virNodeDeviceObjPtr obj = NULL;
+
+    if (!key)
+        return NULL;
+
+    virObjectRWLockRead(devs);
+    obj = virObjectRef(virHashLookup(index, key));
+    virObjectRWUnlock(devs);
+
+    if (obj)
+        virObjectLock(obj);
+
+    return obj;
 }
 
 
@@ -219,9 +250,7 @@ virNodeDeviceObjPtr
 virNodeDeviceObjListFindBySysfsPath(virNodeDeviceObjListPtr devs,
                                     const char *sysfs_path)
 {
-    return virNodeDeviceObjListSearch(devs,
-                                      virNodeDeviceObjListFindBySysfsPathCallback,
-                                      sysfs_path);
+    return virNodeDeviceObjListFindByIndex(devs, devs->sysfsPaths, sysfs_path);
 }
 
 
@@ -284,9 +313,9 @@ virNodeDeviceObjListFindByWWNs(virNodeDeviceObjListPtr devs,
     struct virNodeDeviceObjListFindByWWNsData data = {
         .parent_wwnn = parent_wwnn, .parent_wwpn = parent_wwpn };
 
-    return virNodeDeviceObjListSearch(devs,
-                                      virNodeDeviceObjListFindByWWNsCallback,
-                                      &data);
+    return virNodeDeviceObjListSearchSCSIHosts(devs,
+                                               virNodeDeviceObjListFindByWWNsCallback,
+                                               &data);
 }
 
 
@@ -314,9 +343,9 @@ static virNodeDeviceObjPtr
 virNodeDeviceObjListFindByFabricWWN(virNodeDeviceObjListPtr devs,
                                     const char *parent_fabric_wwn)
 {
-    return virNodeDeviceObjListSearch(devs,
-                                      virNodeDeviceObjListFindByFabricWWNCallback,
-                                      parent_fabric_wwn);
+    return virNodeDeviceObjListSearchSCSIHosts(devs,
+                                               virNodeDeviceObjListFindByFabricWWNCallback,
+                                               parent_fabric_wwn);
 }
 
 
@@ -341,9 +370,18 @@ static virNodeDeviceObjPtr
 virNodeDeviceObjListFindByCap(virNodeDeviceObjListPtr devs,
                               const char *cap)
 {
-    return virNodeDeviceObjListSearch(devs,
-                                      virNodeDeviceObjListFindByCapCallback,
-                                      cap);
+    switch ((virNodeDevCapType) virNodeDevCapTypeFromString(cap)) {
+    case VIR_NODE_DEV_CAP_SCSI_HOST:
+    case VIR_NODE_DEV_CAP_FC_HOST:
+    case VIR_NODE_DEV_CAP_VPORTS:
+        return virNodeDeviceObjListSearchSCSIHosts(devs,
+                                                   virNodeDeviceObjListFindByCapCallback,
+                                                   cap);
+    default:
+        return virNodeDeviceObjListSearch(devs,
+                                          virNodeDeviceObjListFindByCapCallback,
+                                          cap);
+    }
 }
 
 
@@ -394,44 +432,16 @@ virNodeDeviceObjListFindSCSIHostByWWNs(virNodeDeviceObjListPtr devs,
     struct virNodeDeviceObjListFindSCSIHostByWWNsData data = {
         .wwnn = wwnn, .wwpn = wwpn };
 
-    return virNodeDeviceObjListSearch(devs,
-                                      virNodeDeviceObjListFindSCSIHostByWWNsCallback,
-                                      &data);
-}
-
-static int
-virNodeDeviceObjListFindMediatedDeviceByUUIDCallback(const void *payload,
-                                                     const char *name G_GNUC_UNUSED,
-                                                     const void *opaque)
-{
-    virNodeDeviceObjPtr obj = (virNodeDeviceObjPtr) payload;
-    const char *uuid = (const char *) opaque;
-    virNodeDevCapsDefPtr cap;
-    int want = 0;
-
-    virObjectLock(obj);
-
-    for (cap = obj->def->caps; cap != NULL; cap = cap->next) {
-        if (cap->data.type == VIR_NODE_DEV_CAP_MDEV) {
-            if (STREQ(cap->data.mdev.uuid, uuid)) {
-                want = 1;
-                break;
-            }
-        }
-     }
-
-    virObjectUnlock(obj);
-    return want;
+    return virNodeDeviceObjListSearchSCSIHosts(devs,
+                                               virNodeDeviceObjListFindSCSIHostByWWNsCallback,
+                                               &data);
 }
 
-
 virNodeDeviceObjPtr
 virNodeDeviceObjListFindMediatedDeviceByUUID(virNodeDeviceObjListPtr devs,
                                              const char *uuid)
 {
-    return virNodeDeviceObjListSearch(devs,
-                                      virNodeDeviceObjListFindMediatedDeviceByUUIDCallback,
-                                      uuid);
+    return virNodeDeviceObjListFindByIndex(devs, devs->mdevUUIDs, uuid);
 }
 
 static void
@@ -439,6 +449,9 @@ virNodeDeviceObjListDispose(void *obj)
 {
     virNodeDeviceObjListPtr devs = obj;
 
+    virHashFree(devs->sysfsPaths);
+    virHashFree(devs->mdevUUIDs);
+    virHashFree(devs->scsiHosts);
     virHashFree(devs->objs);
 }
 
@@ -454,7 +467,10 @@ virNodeDeviceObjListNew(void)
     if (!(devs = virObjectRWLockableNew(virNodeDeviceObjListClass)))
         return NULL;
 
-    if (!(devs->objs = virHashNew(virObjectFreeHashData))) {
+    if (!(devs->objs = virHashNew(virObjectFreeHashData)) ||
+        !(devs->sysfsPaths = virHashNew(NULL)) ||
+        !(devs->mdevUUIDs = virHashNew(NULL)) ||
+        !(devs->scsiHosts = virHashNew(NULL))) {
         virObjectUnref(devs);
         return NULL;
     }
@@ -463,6 +479,88 @@ virNodeDeviceObjListNew(void)
 }
 
 
+static const char *
+virNodeDeviceDefGetMdevUUID(virNodeDeviceDefPtr def)
+{
+    virNodeDevCapsDefPtr cap;
+
+    for (cap = def->caps; cap; cap = cap->next) {
+        if (cap->data.type == VIR_NODE_DEV_CAP_MDEV)
+            return cap->data.mdev.uuid;
+    }
+
+    return NULL;
+}
+
+
+static bool
+virNodeDeviceDefHasSCSIHostCap(virNodeDeviceDefPtr def)
+{
+    virNodeDevCapsDefPtr cap;
+
+    for (cap = def->caps; cap; cap = cap->next) {
+        if (cap->data.type == VIR_NODE_DEV_CAP_SCSI_HOST ||
+            cap->data.type == VIR_NODE_DEV_CAP_FC_HOST ||
+            cap->data.type == VIR_NODE_DEV_CAP_VPORTS)
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Must be called with @devs locked for writing. */
+static int
+virNodeDeviceObjListIndexAdd(virNodeDeviceObjListPtr devs,
+                             virNodeDeviceObjPtr obj)
+{
+    virNodeDeviceDefPtr def = obj->def;
+    const char *uuid;
+
+    if (def->sysfs_path &&
+        virHashUpdateEntry(devs->sysfsPaths, def->sysfs_path, obj) < 0)
+        return -1;
+
+    if ((uuid = virNodeDeviceDefGetMdevUUID(def)) &&
+        virHashUpdateEntry(devs->mdevUUIDs, uuid, obj) < 0)
+        return -1;
+
+    if (virNodeDeviceDefHasSCSIHostCap(def) &&
+        virHashUpdateEntry(devs->scsiHosts, def->name, obj) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static void
+virNodeDeviceObjListIndexRemoveEntry(virHashTablePtr index,
+                                     const char *key,
+                                     virNodeDeviceObjPtr obj)
+{
+    /* don't remove an entry of another device using the same key */
+    if (key && virHashLookup(index, key) == obj)
+        virHashRemoveEntry(index, key);
+}
+
+
+/* Must be called with @devs locked for writing. */
+static void
+virNodeDeviceObjListIndexRemove(virNodeDeviceObjListPtr devs,
+                                virNodeDeviceObjPtr obj)
+{
+    virNodeDeviceDefPtr def = obj->def;
+
+    if (!def)
+        return;
+
+    virNodeDeviceObjListIndexRemoveEntry(devs->sysfsPaths, def->sysfs_path, obj);
+    virNodeDeviceObjListIndexRemoveEntry(devs->mdevUUIDs,
+                                         virNodeDeviceDefGetMdevUUID(def), obj);
+    virNodeDeviceObjListIndexRemoveEntry(devs->scsiHosts, def->name, obj);
+}
+
+
 void
 virNodeDeviceObjListFree(virNodeDeviceObjListPtr devs)
 {
@@ -475,12 +573,14 @@ virNodeDeviceObjListAssignDef(virNodeDeviceObjListPtr devs,
                               virNodeDeviceDefPtr def)
 {
     virNodeDeviceObjPtr obj;
+    virNodeDeviceDefPtr oldDef = NULL;
 
     virObjectRWLockWrite(devs);
 
     if ((obj = virNodeDeviceObjListFindByNameLocked(devs, def->name))) {
         virObjectLock(obj);
-        virNodeDeviceDefFree(obj->def);
+        virNodeDeviceObjListIndexRemove(devs, obj);
+        oldDef = obj->def;
         obj->def = def;
     } else {
         if (!(obj = virNodeDeviceObjNew()))
@@ -495,6 +595,23 @@ virNodeDeviceObjListAssignDef(virNodeDeviceObjListPtr devs,
         virObjectRef(obj);
     }
 
+    if (virNodeDeviceObjListIndexAdd(devs, obj) < 0) {
+        virNodeDeviceObjListIndexRemove(devs, obj);
+        /* the caller keeps ownership of @def on failure */
+        if (oldDef) {
+            /* keep the device as it was before the redefinition */
+            obj->def = oldDef;
+            ignore_value(virNodeDeviceObjListIndexAdd(devs, obj));
+        } else {
+            obj->def = NULL;
+            virHashRemoveEntry(devs->objs, def->name);
+        }
+        virNodeDeviceObjEndAPI(&obj);
+        goto cleanup;
+    }
+
+    virNodeDeviceDefFree(oldDef);
+
  cleanup:
     virObjectRWUnlock(devs);
     return obj;
@@ -515,6 +632,7 @@ virNodeDeviceObjListRemove(virNodeDeviceObjListPtr devs,
     virObjectUnlock(obj);
     virObjectRWLockWrite(devs);
     virObjectLock(obj);
+    virNodeDeviceObjListIndexRemove(devs, obj);
     virHashRemoveEntry(devs->objs, def->name);
     virObjectUnlock(obj);
     virObjectUnref(obj);
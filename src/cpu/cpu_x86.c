@@ -157,6 +157,12 @@ struct _virCPUx86Map {
     virCPUx86ModelPtr *models;
     size_t nblockers;
     virCPUx86FeaturePtr *migrate_blockers;
+
+    /* Features and models compiled into bitsets, see x86MapCompile */
+    virCPUx86Data slots;
+    size_t nwords;
+    uint32_t *featureBits;
+    uint32_t *modelBits;
 };
 
 static virCPUx86MapPtr cpuMap;
@@ -803,51 +809,148 @@ x86DataAddSignature(virCPUx86Data *data,
 }
 
 
+/*
+ * In addition to the lists of data items, features and models are
+ * compiled into bitsets when the CPU map is loaded. Each CPUID leaf
+ * or MSR referenced by any feature gets four 32-bit words in them,
+ * one per register. Checking whether CPU data contains a feature and
+ * removing it is then a simple loop over a few words, rather than a
+ * search for every data item of the feature.
+ */
+#define X86_BITS_SLOT_WORDS 4
+
+static void
+x86DataToBits(virCPUx86MapPtr map,
+              const virCPUx86Data *data,
+              uint32_t *bits)
+{
+    size_t i;
+
+    memset(bits, 0, map->nwords * sizeof(*bits));
+
+    for (i = 0; i < map->slots.len; i++) {
+        virCPUx86DataItemPtr item = virCPUx86DataGet(data, &map->slots.items[i]);
+        uint32_t *words = bits + i * X86_BITS_SLOT_WORDS;
+
+        if (!item)
+            continue;
+
+        switch (item->type) {
+        case VIR_CPU_X86_DATA_CPUID:
+            words[0] = item->data.cpuid.eax;
+            words[1] = item->data.cpuid.ebx;
+            words[2] = item->data.cpuid.ecx;
+            words[3] = item->data.cpuid.edx;
+            break;
+
+        case VIR_CPU_X86_DATA_MSR:
+            words[0] = item->data.msr.eax;
+            words[1] = item->data.msr.edx;
+            break;
+
+        case VIR_CPU_X86_DATA_NONE:
+        default:
+            break;
+        }
+    }
+}
+
+
+static bool
+x86BitsIsSubset(const uint32_t *bits,
+                const uint32_t *subset,
+                size_t nwords)
+{
+    size_t i;
+
+    for (i = 0; i < nwords; i++) {
+        if ((bits[i] & subset[i]) != subset[i])
+            return false;
+    }
+
+    return true;
+}
+
+
+/* also removes all detected features from bits */
+static int
+x86BitsToCPUFeatures(virCPUDefPtr cpu,
+                     int policy,
+                     uint32_t *bits,
+                     virCPUx86MapPtr map)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < map->nfeatures; i++) {
+        const uint32_t *feature = map->featureBits + i * map->nwords;
+
+        if (x86BitsIsSubset(bits, feature, map->nwords)) {
+            for (j = 0; j < map->nwords; j++)
+                bits[j] &= ~feature[j];
+            if (virCPUDefAddFeature(cpu, map->features[i]->name, policy) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 static virCPUDefPtr
-x86DataToCPU(const virCPUx86Data *data,
-             virCPUx86ModelPtr model,
+x86BitsToCPU(const uint32_t *data,
+             virCPUx86VendorPtr vendor,
+             size_t model,
              virCPUx86MapPtr map,
              virDomainCapsCPUModelPtr hvModel)
 {
     g_autoptr(virCPUDef) cpu = NULL;
-    g_auto(virCPUx86Data) copy = VIR_CPU_X86_DATA_INIT;
-    g_auto(virCPUx86Data) modelData = VIR_CPU_X86_DATA_INIT;
-    virCPUx86VendorPtr vendor;
+    g_autofree uint32_t *copy = NULL;
+    g_autofree uint32_t *modelData = NULL;
+    const uint32_t *modelBits = map->modelBits + model * map->nwords;
+    size_t i;
 
     cpu = virCPUDefNew();
 
-    cpu->model = g_strdup(model->name);
-
-    x86DataCopy(&copy, data);
-    x86DataCopy(&modelData, &model->data);
+    cpu->model = g_strdup(map->models[model]->name);
 
-    if ((vendor = x86DataToVendor(&copy, map)))
+    if (vendor)
         cpu->vendor = g_strdup(vendor->name);
 
-    x86DataSubtract(&copy, &modelData);
-    x86DataSubtract(&modelData, data);
+    copy = g_new0(uint32_t, map->nwords);
+    modelData = g_new0(uint32_t, map->nwords);
+
+    for (i = 0; i < map->nwords; i++) {
+        copy[i] = data[i] & ~modelBits[i];
+        modelData[i] = modelBits[i] & ~data[i];
+    }
 
     /* The hypervisor's version of the CPU model (hvModel) may contain
      * additional features which may be currently unavailable. Such features
      * block usage of the CPU model and we need to explicitly disable them.
      */
     if (hvModel && hvModel->blockers) {
+        g_autofree uint32_t *featureBits = g_new0(uint32_t, map->nwords);
         char **blocker;
         virCPUx86FeaturePtr feature;
 
         for (blocker = hvModel->blockers; *blocker; blocker++) {
-            if ((feature = x86FeatureFind(map, *blocker)) &&
-                !x86DataIsSubset(&copy, &feature->data))
-                if (x86DataAdd(&modelData, &feature->data) < 0)
-                    return NULL;
+            if (!(feature = x86FeatureFind(map, *blocker)))
+                continue;
+
+            x86DataToBits(map, &feature->data, featureBits);
+            if (!x86BitsIsSubset(copy, featureBits, map->nwords)) {
+                for (i = 0; i < map->nwords; i++)
+                    modelData[i] |= featureBits[i];
+            }
         }
     }
 
     /* because feature policy is ignored for host CPU */
     cpu->type = VIR_CPU_TYPE_GUEST;
 
-    if (x86DataToCPUFeatures(cpu, VIR_CPU_FEATURE_REQUIRE, &copy, map) ||
-        x86DataToCPUFeatures(cpu, VIR_CPU_FEATURE_DISABLE, &modelData, map))
+    if (x86BitsToCPUFeatures(cpu, VIR_CPU_FEATURE_REQUIRE, copy, map) ||
+        x86BitsToCPUFeatures(cpu, VIR_CPU_FEATURE_DISABLE, modelData, map))
         return NULL;
 
     return g_steal_pointer(&cpu);
@@ -1663,11 +1766,83 @@ x86MapFree(virCPUx86MapPtr map)
      */
     g_free(map->migrate_blockers);
 
+    virCPUx86DataClear(&map->slots);
+    g_free(map->featureBits);
+    g_free(map->modelBits);
+
     g_free(map);
 }
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virCPUx86Map, x86MapFree);
 
 
+static int
+x86MapAddSlots(virCPUx86MapPtr map,
+               const virCPUx86Data *data)
+{
+    virCPUx86DataIterator iter;
+    virCPUx86DataItemPtr item;
+
+    virCPUx86DataIteratorInit(&iter, data);
+    while ((item = virCPUx86DataNext(&iter))) {
+        virCPUx86DataItem slot = { .type = item->type };
+
+        if (item->type == VIR_CPU_X86_DATA_CPUID) {
+            slot.data.cpuid.eax_in = item->data.cpuid.eax_in;
+            slot.data.cpuid.ecx_in = item->data.cpuid.ecx_in;
+        } else {
+            slot.data.msr.index = item->data.msr.index;
+        }
+
+        if (virCPUx86DataAddItem(&map->slots, &slot) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * x86MapCompile:
+ *
+ * Collects the CPUID leaves and MSRs used by any feature or model in
+ * @map and stores the bitsets of all features and models in it.
+ */
+static int
+x86MapCompile(virCPUx86MapPtr map)
+{
+    size_t i;
+
+    for (i = 0; i < map->nfeatures; i++) {
+        if (x86MapAddSlots(map, &map->features[i]->data) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < map->nmodels; i++) {
+        if (x86MapAddSlots(map, &map->models[i]->data) < 0)
+            return -1;
+    }
+
+    map->nwords = map->slots.len * X86_BITS_SLOT_WORDS;
+    map->featureBits = g_new0(uint32_t, map->nfeatures * map->nwords);
+    map->modelBits = g_new0(uint32_t, map->nmodels * map->nwords);
+
+    for (i = 0; i < map->nfeatures; i++) {
+        x86DataToBits(map, &map->features[i]->data,
+                      map->featureBits + i * map->nwords);
+    }
+
+    for (i = 0; i < map->nmodels; i++) {
+        x86DataToBits(map, &map->models[i]->data,
+                      map->modelBits + i * map->nwords);
+    }
+
+    VIR_DEBUG("Compiled %zu features and %zu models into %zu word bitsets",
+              map->nfeatures, map->nmodels, map->nwords);
+
+    return 0;
+}
+
+
 static virCPUx86MapPtr
 virCPUx86LoadMap(void)
 {
@@ -1678,6 +1853,9 @@ virCPUx86LoadMap(void)
     if (cpuMapLoad("x86", x86VendorParse, x86FeatureParse, x86ModelParse, map) < 0)
         return NULL;
 
+    if (x86MapCompile(map) < 0)
+        return NULL;
+
     return g_steal_pointer(&map);
 }
 
@@ -2117,6 +2295,7 @@ x86Decode(virCPUDefPtr cpu,
     virCPUx86ModelPtr model = NULL;
     g_autoptr(virCPUDef) cpuModel = NULL;
     g_auto(virCPUx86Data) data = VIR_CPU_X86_DATA_INIT;
+    g_autofree uint32_t *dataBits = NULL;
     virCPUx86VendorPtr vendor;
     virDomainCapsCPUModelPtr hvModel = NULL;
     g_autofree char *sigs = NULL;
@@ -2141,6 +2320,9 @@ x86Decode(virCPUDefPtr cpu,
 
     x86DataFilterTSX(&data, vendor, map);
 
+    dataBits = g_new0(uint32_t, map->nwords);
+    x86DataToBits(map, &data, dataBits);
+
     /* Walk through the CPU models in reverse order to check newest
      * models first.
      */
@@ -2175,7 +2357,7 @@ x86Decode(virCPUDefPtr cpu,
             continue;
         }
 
-        if (!(cpuCandidate = x86DataToCPU(&data, candidate, map, hvModel)))
+        if (!(cpuCandidate = x86BitsToCPU(dataBits, vendor, i, map, hvModel)))
             return -1;
         cpuCandidate->type = cpu->type;
 
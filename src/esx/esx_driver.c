@@ -913,6 +913,11 @@ esxConnectOpen(virConnectPtr conn, virConnectAuthPtr auth,
         priv->primary = priv->vCenter;
     }
 
+    if (priv->parsedUri->cache &&
+        esxVI_InventoryCache_Start(priv->primary, priv->parsedUri) < 0) {
+        goto cleanup;
+    }
+
     /* Setup capabilities */
     priv->caps = esxCapsInit(priv);
 
@@ -3178,6 +3183,8 @@ esxDomainUndefineFlags(virDomainPtr domain,
     if (esxVI_UnregisterVM(ctx, virtualMachine->obj) < 0)
         goto cleanup;
 
+    esxVI_InventoryCache_Invalidate(priv->primary->cache);
+
     result = 0;
 
  cleanup:
@@ -3833,6 +3840,9 @@ esxDomainMigratePerform(virDomainPtr domain,
         goto cleanup;
     }
 
+    /* The task ran on the vCenter context, not the one owning the cache */
+    esxVI_InventoryCache_Invalidate(priv->primary->cache);
+
     result = 0;
 
  cleanup:
@@ -45,6 +45,7 @@ esxUtil_ParseUri(esxUtil_ParsedUri **parsedUri, virURIPtr uri)
     size_t i;
     int noVerify;
     int autoAnswer;
+    int cache;
     char *tmp;
 
     ESX_VI_CHECK_ARG_LIST(parsedUri);
@@ -91,6 +92,16 @@ esxUtil_ParseUri(esxUtil_ParsedUri **parsedUri, virURIPtr uri)
             }
 
             (*parsedUri)->autoAnswer = autoAnswer != 0;
+        } else if (STRCASEEQ(queryParam->name, "cache")) {
+            if (virStrToLong_i(queryParam->value, NULL, 10, &cache) < 0 ||
+                (cache != 0 && cache != 1)) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("Query parameter 'cache' has unexpected "
+                                 "value '%s' (should be 0 or 1)"), queryParam->value);
+                goto cleanup;
+            }
+
+            (*parsedUri)->cache = cache != 0;
         } else if (STRCASEEQ(queryParam->name, "proxy")) {
             /* Expected format: [<type>://]<hostname>[:<port>] */
             (*parsedUri)->proxy = true;
@@ -39,6 +39,7 @@ struct _esxUtil_ParsedUri {
     char *vCenter;
     bool noVerify;
     bool autoAnswer;
+    bool cache;
     bool proxy;
     int proxy_type;
     char *proxy_hostname;
@@ -36,6 +36,7 @@
 #include "esx_util.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_ESX
 
@@ -801,6 +802,8 @@ ESX_VI__TEMPLATE__ALLOC(Context)
 /* esxVI_Context_Free */
 ESX_VI__TEMPLATE__FREE(Context,
 {
+    esxVI_InventoryCache_Stop(&item->cache);
+
     if (item->sessionLock)
         virMutexDestroy(item->sessionLock);
 
@@ -1409,6 +1412,620 @@ esxVI_Context_Execute(esxVI_Context *ctx, const char *methodName,
 
 
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * InventoryCache
+ */
+
+/* Seconds a WaitForUpdatesEx call may block before it returns empty-handed */
+#define ESX_VI_INVENTORY_CACHE_MAX_WAIT 30
+
+/* The virtual machine properties used by the list, lookup and info calls */
+static const char *esxVI_InventoryCacheProperties =
+    "configStatus\0"
+    "name\0"
+    "runtime.powerState\0"
+    "config.uuid\0"
+    "config.hardware.memoryMB\0"
+    "config.hardware.numCPU\0"
+    "config.memoryAllocation.limit\0";
+
+static virClassPtr esxVI_InventoryCacheClass;
+
+static void esxVI_InventoryCacheDispose(void *obj);
+
+static int
+esxVI_InventoryCacheOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(esxVI_InventoryCache, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(esxVI_InventoryCache);
+
+esxVI_InventoryCache *
+esxVI_InventoryCache_New(void)
+{
+    esxVI_InventoryCache *cache;
+
+    if (esxVI_InventoryCacheInitialize() < 0)
+        return NULL;
+
+    if (!(cache = virObjectLockableNew(esxVI_InventoryCacheClass)))
+        return NULL;
+
+    if (esxVI_String_AppendValueListToList(&cache->propertyNameList,
+                                           esxVI_InventoryCacheProperties) < 0) {
+        virObjectUnref(cache);
+        return NULL;
+    }
+
+    cache->version = g_strdup("");
+
+    return cache;
+}
+
+static void
+esxVI_InventoryCacheDispose(void *obj)
+{
+    esxVI_InventoryCache *cache = obj;
+
+    esxVI_Context_Free(&cache->ctx);
+    esxVI_String_Free(&cache->propertyNameList);
+    esxVI_ObjectContent_Free(&cache->virtualMachineList);
+    VIR_FREE(cache->version);
+}
+
+static void
+esxVI_InventoryCache_Run(void *opaque)
+{
+    esxVI_InventoryCache *cache = opaque;
+    esxVI_WaitOptions *waitOptions = NULL;
+    esxVI_UpdateSet *updateSet = NULL;
+    char *version = NULL;
+    unsigned long long generation;
+    bool quit = false;
+
+    if (esxVI_WaitOptions_Alloc(&waitOptions) < 0 ||
+        esxVI_Int_Alloc(&waitOptions->maxWaitSeconds) < 0) {
+        goto cleanup;
+    }
+
+    waitOptions->maxWaitSeconds->value = ESX_VI_INVENTORY_CACHE_MAX_WAIT;
+
+    while (true) {
+        virObjectLock(cache);
+        quit = cache->quit;
+        generation = cache->generation;
+        VIR_FREE(version);
+        version = g_strdup(cache->version);
+        virObjectUnlock(cache);
+
+        if (quit)
+            break;
+
+        if (esxVI_WaitForUpdatesEx(cache->ctx, version, waitOptions,
+                                   &updateSet) < 0) {
+            VIR_WARN("Waiting for inventory updates failed, "
+                     "disabling the inventory cache: %s",
+                     virGetLastErrorMessage());
+            break;
+        }
+
+        /* On failure the cache resyncs itself with the next update set */
+        ignore_value(esxVI_InventoryCache_Update(cache, updateSet,
+                                                 generation));
+
+        esxVI_UpdateSet_Free(&updateSet);
+    }
+
+ cleanup:
+    virObjectLock(cache);
+    cache->ready = false;
+    virObjectUnlock(cache);
+
+    if (quit)
+        ignore_value(esxVI_Logout(cache->ctx));
+
+    esxVI_WaitOptions_Free(&waitOptions);
+    VIR_FREE(version);
+    virObjectUnref(cache);
+}
+
+int
+esxVI_InventoryCache_Start(esxVI_Context *ctx, esxUtil_ParsedUri *parsedUri)
+{
+    int result = -1;
+    esxVI_InventoryCache *cache = NULL;
+    esxVI_ObjectSpec *objectSpec = NULL;
+    bool objectSpec_isAppended = false;
+    esxVI_PropertySpec *propertySpec = NULL;
+    bool propertySpec_isAppended = false;
+    esxVI_PropertyFilterSpec *propertyFilterSpec = NULL;
+    esxVI_ManagedObjectReference *propertyFilter = NULL;
+    virThread thread;
+
+    if (!ctx || !ctx->hostSystem || ctx->cache) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("Invalid argument"));
+        return -1;
+    }
+
+    if (ctx->apiVersion < 1000000 * 4 + 1000 * 1 /* 4.1 */) {
+        VIR_WARN("VI API version %s doesn't support WaitForUpdatesEx, "
+                 "not enabling the inventory cache",
+                 ctx->service->about->apiVersion);
+        return 0;
+    }
+
+    if (!(cache = esxVI_InventoryCache_New()))
+        return -1;
+
+    /* WaitForUpdatesEx blocks its context, so the cache needs its own */
+    if (esxVI_Context_Alloc(&cache->ctx) < 0 ||
+        esxVI_Context_Connect(cache->ctx, ctx->url, ctx->ipAddress,
+                              ctx->username, ctx->password, parsedUri) < 0) {
+        goto cleanup;
+    }
+
+    if (esxVI_ObjectSpec_Alloc(&objectSpec) < 0)
+        goto cleanup;
+
+    objectSpec->obj = ctx->hostSystem->_reference;
+    objectSpec->skip = esxVI_Boolean_False;
+    objectSpec->selectSet = cache->ctx->selectSet_hostSystemToVm;
+
+    if (esxVI_PropertySpec_Alloc(&propertySpec) < 0)
+        goto cleanup;
+
+    propertySpec->type = (char *)"VirtualMachine";
+    propertySpec->pathSet = cache->propertyNameList;
+
+    if (esxVI_PropertyFilterSpec_Alloc(&propertyFilterSpec) < 0 ||
+        esxVI_PropertySpec_AppendToList(&propertyFilterSpec->propSet,
+                                        propertySpec) < 0) {
+        goto cleanup;
+    }
+
+    propertySpec_isAppended = true;
+
+    if (esxVI_ObjectSpec_AppendToList(&propertyFilterSpec->objectSet,
+                                      objectSpec) < 0) {
+        goto cleanup;
+    }
+
+    objectSpec_isAppended = true;
+
+    /* The filter lives as long as the session of the private context */
+    if (esxVI_CreateFilter(cache->ctx, propertyFilterSpec, esxVI_Boolean_False,
+                           &propertyFilter) < 0) {
+        goto cleanup;
+    }
+
+    if (virThreadCreate(&thread, false, esxVI_InventoryCache_Run,
+                        virObjectRef(cache)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Could not create inventory cache thread"));
+        virObjectUnref(cache);
+        goto cleanup;
+    }
+
+    ctx->cache = g_steal_pointer(&cache);
+
+    result = 0;
+
+ cleanup:
+    /*
+     * Remove values owned by somebody else from the data structures to
+     * prevent them from being freed by esxVI_PropertyFilterSpec_Free().
+     */
+    if (objectSpec) {
+        objectSpec->obj = NULL;
+        objectSpec->selectSet = NULL;
+    }
+
+    if (propertySpec) {
+        propertySpec->type = NULL;
+        propertySpec->pathSet = NULL;
+    }
+
+    if (!objectSpec_isAppended)
+        esxVI_ObjectSpec_Free(&objectSpec);
+
+    if (!propertySpec_isAppended)
+        esxVI_PropertySpec_Free(&propertySpec);
+
+    esxVI_PropertyFilterSpec_Free(&propertyFilterSpec);
+    esxVI_ManagedObjectReference_Free(&propertyFilter);
+    virObjectUnref(cache);
+
+    return result;
+}
+
+/*
+ * The update thread holds its own reference and drops it once it notices
+ * the request to quit, so this doesn't have to wait for a pending
+ * WaitForUpdatesEx call to return.
+ */
+void
+esxVI_InventoryCache_Stop(esxVI_InventoryCache **cache)
+{
+    if (!cache || !(*cache))
+        return;
+
+    virObjectLock(*cache);
+    (*cache)->quit = true;
+    (*cache)->ready = false;
+    virObjectUnlock(*cache);
+
+    virObjectUnref(*cache);
+    *cache = NULL;
+}
+
+/*
+ * Stop serving lookups until the update thread has seen all changes made
+ * before this call. Used after modifying the inventory, so a caller cannot
+ * observe its own changes being undone by a stale cache.
+ */
+void
+esxVI_InventoryCache_Invalidate(esxVI_InventoryCache *cache)
+{
+    if (!cache)
+        return;
+
+    virObjectLock(cache);
+    cache->generation++;
+    cache->ready = false;
+    virObjectUnlock(cache);
+}
+
+static int
+esxVI_InventoryCache_ApplyPropertyChange(esxVI_InventoryCache *cache,
+                                         esxVI_ObjectContent *virtualMachine,
+                                         esxVI_PropertyChange *propertyChange)
+{
+    esxVI_DynamicProperty **link = NULL;
+    esxVI_DynamicProperty *dynamicProperty = NULL;
+
+    /* Without partial updates changes are reported for the filtered paths */
+    if (!esxVI_String_ListContainsValue(cache->propertyNameList,
+                                        propertyChange->name)) {
+        VIR_DEBUG("Unexpected change of property '%s'", propertyChange->name);
+        return -1;
+    }
+
+    for (link = &virtualMachine->propSet; *link; link = &(*link)->_next) {
+        if (STREQ((*link)->name, propertyChange->name)) {
+            dynamicProperty = *link;
+            *link = dynamicProperty->_next;
+            dynamicProperty->_next = NULL;
+            esxVI_DynamicProperty_Free(&dynamicProperty);
+            break;
+        }
+    }
+
+    switch (propertyChange->op) {
+      case esxVI_PropertyChangeOp_Add:
+      case esxVI_PropertyChangeOp_Assign:
+        if (!propertyChange->val)
+            break;
+
+        if (esxVI_DynamicProperty_Alloc(&dynamicProperty) < 0)
+            return -1;
+
+        dynamicProperty->name = g_strdup(propertyChange->name);
+
+        if (esxVI_AnyType_DeepCopy(&dynamicProperty->val,
+                                   propertyChange->val) < 0 ||
+            esxVI_DynamicProperty_AppendToList(&virtualMachine->propSet,
+                                               dynamicProperty) < 0) {
+            esxVI_DynamicProperty_Free(&dynamicProperty);
+            return -1;
+        }
+
+        break;
+
+      case esxVI_PropertyChangeOp_Remove:
+      case esxVI_PropertyChangeOp_IndirectRemove:
+        break;
+
+      case esxVI_PropertyChangeOp_Undefined:
+      default:
+        virReportEnumRangeError(esxVI_PropertyChangeOp, propertyChange->op);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+esxVI_InventoryCache_ApplyObjectUpdate(esxVI_InventoryCache *cache,
+                                       esxVI_ObjectUpdate *objectUpdate)
+{
+    esxVI_ObjectContent **link = NULL;
+    esxVI_ObjectContent *virtualMachine = NULL;
+    esxVI_PropertyChange *propertyChange = NULL;
+
+    if (STRNEQ(objectUpdate->obj->type, "VirtualMachine"))
+        return 0;
+
+    for (link = &cache->virtualMachineList; *link; link = &(*link)->_next) {
+        if (STREQ((*link)->obj->value, objectUpdate->obj->value))
+            break;
+    }
+
+    switch (objectUpdate->kind) {
+      case esxVI_ObjectUpdateKind_Enter:
+        if (!(*link)) {
+            if (esxVI_ObjectContent_Alloc(&virtualMachine) < 0 ||
+                esxVI_ManagedObjectReference_DeepCopy(&virtualMachine->obj,
+                                                      objectUpdate->obj) < 0) {
+                esxVI_ObjectContent_Free(&virtualMachine);
+                return -1;
+            }
+
+            *link = virtualMachine;
+        }
+
+        break;
+
+      case esxVI_ObjectUpdateKind_Modify:
+        if (!(*link)) {
+            VIR_DEBUG("Modification of unknown virtual machine '%s'",
+                      objectUpdate->obj->value);
+            return -1;
+        }
+
+        break;
+
+      case esxVI_ObjectUpdateKind_Leave:
+        if (*link) {
+            virtualMachine = *link;
+            *link = virtualMachine->_next;
+            virtualMachine->_next = NULL;
+            esxVI_ObjectContent_Free(&virtualMachine);
+        }
+
+        return 0;
+
+      case esxVI_ObjectUpdateKind_Undefined:
+      default:
+        virReportEnumRangeError(esxVI_ObjectUpdateKind, objectUpdate->kind);
+        return -1;
+    }
+
+    for (propertyChange = objectUpdate->changeSet; propertyChange;
+         propertyChange = propertyChange->_next) {
+        if (esxVI_InventoryCache_ApplyPropertyChange(cache, *link,
+                                                     propertyChange) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Applies an update set returned by WaitForUpdatesEx, @updateSet is NULL if
+ * the call timed out without changes. The cache starts serving lookups
+ * again if it hasn't been invalidated since @generation was read, that is
+ * since before the WaitForUpdatesEx call was issued.
+ *
+ * If the update set cannot be applied the cache falls back to the initial
+ * version and will be rebuilt from the next update set.
+ */
+int
+esxVI_InventoryCache_Update(esxVI_InventoryCache *cache,
+                            esxVI_UpdateSet *updateSet,
+                            unsigned long long generation)
+{
+    int result = -1;
+    esxVI_PropertyFilterUpdate *propertyFilterUpdate = NULL;
+    esxVI_ObjectUpdate *objectUpdate = NULL;
+
+    virObjectLock(cache);
+
+    if (updateSet) {
+        /* An update set for the initial version has the complete inventory */
+        if (STREQ(cache->version, ""))
+            esxVI_ObjectContent_Free(&cache->virtualMachineList);
+
+        for (propertyFilterUpdate = updateSet->filterSet;
+             propertyFilterUpdate;
+             propertyFilterUpdate = propertyFilterUpdate->_next) {
+            for (objectUpdate = propertyFilterUpdate->objectSet;
+                 objectUpdate; objectUpdate = objectUpdate->_next) {
+                if (esxVI_InventoryCache_ApplyObjectUpdate(cache,
+                                                           objectUpdate) < 0) {
+                    goto cleanup;
+                }
+            }
+        }
+
+        VIR_FREE(cache->version);
+        cache->version = g_strdup(updateSet->version);
+    }
+
+    if (generation == cache->generation)
+        cache->ready = true;
+
+    result = 0;
+
+ cleanup:
+    if (result < 0) {
+        cache->ready = false;
+        VIR_FREE(cache->version);
+        cache->version = g_strdup("");
+    }
+
+    virObjectUnlock(cache);
+
+    return result;
+}
+
+static bool
+esxVI_InventoryCache_HasProperties(esxVI_InventoryCache *cache,
+                                   esxVI_String *propertyNameList)
+{
+    esxVI_String *propertyName = NULL;
+
+    if (!propertyNameList)
+        return false;
+
+    for (propertyName = propertyNameList; propertyName;
+         propertyName = propertyName->_next) {
+        if (!esxVI_String_ListContainsValue(cache->propertyNameList,
+                                            propertyName->value)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Copies @src like RetrieveProperties would have returned it */
+static int
+esxVI_InventoryCache_CopyVirtualMachine(esxVI_ObjectContent **dest,
+                                        esxVI_ObjectContent *src,
+                                        esxVI_String *propertyNameList)
+{
+    esxVI_DynamicProperty *dynamicProperty = NULL;
+    esxVI_DynamicProperty **next = NULL;
+
+    if (esxVI_ObjectContent_Alloc(dest) < 0 ||
+        esxVI_ManagedObjectReference_DeepCopy(&(*dest)->obj, src->obj) < 0) {
+        goto failure;
+    }
+
+    next = &(*dest)->propSet;
+
+    for (dynamicProperty = src->propSet; dynamicProperty;
+         dynamicProperty = dynamicProperty->_next) {
+        if (!esxVI_String_ListContainsValue(propertyNameList,
+                                            dynamicProperty->name)) {
+            continue;
+        }
+
+        if (esxVI_DynamicProperty_DeepCopy(next, dynamicProperty) < 0)
+            goto failure;
+
+        next = &(*next)->_next;
+    }
+
+    return 0;
+
+ failure:
+    esxVI_ObjectContent_Free(dest);
+
+    return -1;
+}
+
+/*
+ * Returns -1 on error, 0 if the cache cannot answer the lookup and 1 if
+ * @virtualMachineList has been filled from the cache.
+ */
+int
+esxVI_InventoryCache_LookupVirtualMachineList
+  (esxVI_InventoryCache *cache, esxVI_String *propertyNameList,
+   esxVI_ObjectContent **virtualMachineList)
+{
+    int result = 0;
+    esxVI_ObjectContent *virtualMachine = NULL;
+    esxVI_ObjectContent **next = virtualMachineList;
+
+    ESX_VI_CHECK_ARG_LIST(virtualMachineList);
+
+    if (!cache)
+        return 0;
+
+    virObjectLock(cache);
+
+    if (!cache->ready ||
+        !esxVI_InventoryCache_HasProperties(cache, propertyNameList)) {
+        goto cleanup;
+    }
+
+    for (virtualMachine = cache->virtualMachineList; virtualMachine;
+         virtualMachine = virtualMachine->_next) {
+        if (esxVI_InventoryCache_CopyVirtualMachine(next, virtualMachine,
+                                                    propertyNameList) < 0) {
+            esxVI_ObjectContent_Free(virtualMachineList);
+            result = -1;
+            goto cleanup;
+        }
+
+        next = &(*next)->_next;
+    }
+
+    result = 1;
+
+ cleanup:
+    virObjectUnlock(cache);
+
+    return result;
+}
+
+/*
+ * Returns -1 on error, 0 if the cache cannot answer the lookup and 1 if
+ * @virtualMachine has been filled from the cache. A virtual machine that is
+ * not in the cache might still be found by searching the whole datacenter,
+ * so a miss is reported as 0.
+ */
+int
+esxVI_InventoryCache_LookupVirtualMachineByUuid
+  (esxVI_InventoryCache *cache, const unsigned char *uuid,
+   esxVI_String *propertyNameList, esxVI_ObjectContent **virtualMachine)
+{
+    int result = 0;
+    esxVI_ObjectContent *candidate = NULL;
+    esxVI_DynamicProperty *dynamicProperty = NULL;
+    unsigned char uuid_candidate[VIR_UUID_BUFLEN];
+
+    ESX_VI_CHECK_ARG_LIST(virtualMachine);
+
+    if (!cache)
+        return 0;
+
+    virObjectLock(cache);
+
+    if (!cache->ready ||
+        !esxVI_InventoryCache_HasProperties(cache, propertyNameList)) {
+        goto cleanup;
+    }
+
+    for (candidate = cache->virtualMachineList; candidate;
+         candidate = candidate->_next) {
+        for (dynamicProperty = candidate->propSet; dynamicProperty;
+             dynamicProperty = dynamicProperty->_next) {
+            if (STREQ(dynamicProperty->name, "config.uuid"))
+                break;
+        }
+
+        if (!dynamicProperty ||
+            dynamicProperty->val->type != esxVI_Type_String ||
+            virUUIDParse(dynamicProperty->val->string, uuid_candidate) < 0 ||
+            memcmp(uuid, uuid_candidate, VIR_UUID_BUFLEN) != 0) {
+            continue;
+        }
+
+        if (esxVI_InventoryCache_CopyVirtualMachine(virtualMachine, candidate,
+                                                    propertyNameList) < 0) {
+            result = -1;
+            goto cleanup;
+        }
+
+        result = 1;
+        break;
+    }
+
+ cleanup:
+    virObjectUnlock(cache);
+
+    return result;
+}
+
+
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  * Response
  */
@@ -2700,6 +3317,12 @@ esxVI_LookupVirtualMachineList(esxVI_Context *ctx,
                                esxVI_String *propertyNameList,
                                esxVI_ObjectContent **virtualMachineList)
 {
+    int cached = esxVI_InventoryCache_LookupVirtualMachineList
+                   (ctx->cache, propertyNameList, virtualMachineList);
+
+    if (cached != 0)
+        return cached < 0 ? -1 : 0;
+
     /* FIXME: Switch from ctx->hostSystem to ctx->computeResource->resourcePool
      *        for cluster support */
     return esxVI_LookupObjectContentByType(ctx, ctx->hostSystem->_reference,
@@ -2719,9 +3342,16 @@ esxVI_LookupVirtualMachineByUuid(esxVI_Context *ctx, const unsigned char *uuid,
     int result = -1;
     esxVI_ManagedObjectReference *managedObjectReference = NULL;
     char uuid_string[VIR_UUID_STRING_BUFLEN] = "";
+    int cached;
 
     ESX_VI_CHECK_ARG_LIST(virtualMachine);
 
+    cached = esxVI_InventoryCache_LookupVirtualMachineByUuid
+               (ctx->cache, uuid, propertyNameList, virtualMachine);
+
+    if (cached != 0)
+        return cached < 0 ? -1 : 0;
+
     virUUIDFormat(uuid, uuid_string);
 
     if (esxVI_FindByUuid(ctx, ctx->datacenter->_reference, uuid_string,
@@ -4340,6 +4970,8 @@ esxVI_WaitForTaskCompletion(esxVI_Context *ctx,
     if (esxVI_DestroyPropertyFilter(ctx, propertyFilter) < 0)
         VIR_DEBUG("DestroyPropertyFilter failed");
 
+    esxVI_InventoryCache_Invalidate(ctx->cache);
+
     if (esxVI_TaskInfoState_CastFromAnyType(propertyValue, finalState) < 0)
         goto cleanup;
 
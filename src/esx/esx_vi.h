@@ -29,6 +29,7 @@
 #include "internal.h"
 #include "virerror.h"
 #include "datatypes.h"
+#include "virobject.h"
 #include "esx_vi_types.h"
 #include "esx_util.h"
 
@@ -77,6 +78,7 @@ typedef struct _esxVI_CURL esxVI_CURL;
 typedef struct _esxVI_SharedCURL esxVI_SharedCURL;
 typedef struct _esxVI_MultiCURL esxVI_MultiCURL;
 typedef struct _esxVI_Context esxVI_Context;
+typedef struct _esxVI_InventoryCache esxVI_InventoryCache;
 typedef struct _esxVI_Response esxVI_Response;
 typedef struct _esxVI_Enumeration esxVI_Enumeration;
 typedef struct _esxVI_EnumerationValue esxVI_EnumerationValue;
@@ -200,6 +202,7 @@ struct _esxVI_Context {
     esxVI_SelectionSpec *selectSet_datacenterToNetwork;
     bool hasQueryVirtualDiskUuid;
     bool hasSessionIsActive;
+    esxVI_InventoryCache *cache; /* optional, see esxVI_InventoryCache_Start */
 };
 
 int esxVI_Context_Alloc(esxVI_Context **ctx);
@@ -217,6 +220,43 @@ int esxVI_Context_Execute(esxVI_Context *ctx, const char *methodName,
 
 
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * InventoryCache
+ *
+ * Local copy of the virtual machine inventory of a context. It's kept current
+ * by a background thread that uses a separate context to wait for property
+ * collector updates. Lookups that ask only for mirrored properties are served
+ * from the cache while it is in sync, all others go to the server.
+ */
+
+struct _esxVI_InventoryCache {
+    virObjectLockable parent;
+
+    esxVI_Context *ctx; /* private context of the update thread */
+    esxVI_String *propertyNameList; /* mirrored properties */
+    esxVI_ObjectContent *virtualMachineList;
+    char *version; /* of the last applied update set */
+    unsigned long long generation; /* bumped by esxVI_InventoryCache_Invalidate */
+    bool ready;
+    bool quit;
+};
+
+esxVI_InventoryCache *esxVI_InventoryCache_New(void);
+int esxVI_InventoryCache_Start(esxVI_Context *ctx, esxUtil_ParsedUri *parsedUri);
+void esxVI_InventoryCache_Stop(esxVI_InventoryCache **cache);
+void esxVI_InventoryCache_Invalidate(esxVI_InventoryCache *cache);
+int esxVI_InventoryCache_Update(esxVI_InventoryCache *cache,
+                                esxVI_UpdateSet *updateSet,
+                                unsigned long long generation);
+int esxVI_InventoryCache_LookupVirtualMachineList
+      (esxVI_InventoryCache *cache, esxVI_String *propertyNameList,
+       esxVI_ObjectContent **virtualMachineList);
+int esxVI_InventoryCache_LookupVirtualMachineByUuid
+      (esxVI_InventoryCache *cache, const unsigned char *uuid,
+       esxVI_String *propertyNameList, esxVI_ObjectContent **virtualMachine);
+
+
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  * Response
  */
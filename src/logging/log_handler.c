@@ -43,10 +43,21 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Large enough to drain a full pipe (64 KiB by default on Linux) in
+ * a single read() and hand it to the file writer as one chunk. The
+ * buffer only exists while data is being appended, so that idle log
+ * files don't keep it allocated. */
+#define VIR_LOG_HANDLER_READ_SIZE (64 * 1024)
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 typedef virLogHandlerLogFile *virLogHandlerLogFilePtr;
 
 struct _virLogHandlerLogFile {
+    /* Protects everything but @watch and @pipefd, which are only
+     * changed with the handler lock held. The handler lock may be
+     * acquired before this one, never the other way round. */
+    virMutex lock;
+
     virRotatingFileWriterPtr file;
     int watch;
     int pipefd; /* Read from QEMU via this */
@@ -86,6 +97,25 @@ virLogHandlerOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(virLogHandler);
 
 
+static virLogHandlerLogFilePtr
+virLogHandlerLogFileNew(void)
+{
+    virLogHandlerLogFilePtr file = g_new0(virLogHandlerLogFile, 1);
+
+    if (virMutexInit(&file->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize log file mutex"));
+        g_free(file);
+        return NULL;
+    }
+
+    file->watch = -1;
+    file->pipefd = -1;
+
+    return file;
+}
+
+
 static void
 virLogHandlerLogFileFree(virLogHandlerLogFilePtr file)
 {
@@ -98,12 +128,16 @@ virLogHandlerLogFileFree(virLogHandlerLogFilePtr file)
     if (file->watch != -1)
         virEventRemoveHandle(file->watch);
 
+    virMutexDestroy(&file->lock);
     VIR_FREE(file->driver);
     VIR_FREE(file->domname);
     VIR_FREE(file);
 }
 
 
+/*
+ * Must be called with the handler lock held, but not the lock of @file.
+ */
 static void
 virLogHandlerLogFileClose(virLogHandlerPtr handler,
                           virLogHandlerLogFilePtr file)
@@ -113,6 +147,10 @@ virLogHandlerLogFileClose(virLogHandlerPtr handler,
     for (i = 0; i < handler->nfiles; i++) {
         if (handler->files[i] == file) {
             VIR_DELETE_ELEMENT(handler->files, i, handler->nfiles);
+            /* Nobody can look the file up anymore, but wait for
+             * anyone still using it */
+            virMutexLock(&file->lock);
+            virMutexUnlock(&file->lock);
             virLogHandlerLogFileFree(file);
             break;
         }
@@ -135,6 +173,39 @@ virLogHandlerGetLogFileFromWatch(virLogHandlerPtr handler,
 }
 
 
+/*
+ * Appends whatever is available in @file's pipe to the log file.
+ * Must be called with the lock of @file held.
+ *
+ * Returns the number of bytes appended, 0 on EOF, -1 on error.
+ */
+static ssize_t
+virLogHandlerLogFileAppendPipe(virLogHandlerLogFilePtr file)
+{
+    g_autofree char *buf = g_new(char, VIR_LOG_HANDLER_READ_SIZE);
+    ssize_t len;
+
+ reread:
+    len = read(file->pipefd, buf, VIR_LOG_HANDLER_READ_SIZE);
+    if (len < 0) {
+        if (errno == EINTR)
+            goto reread;
+
+        virReportSystemError(errno, "%s",
+                             _("Unable to read from log pipe"));
+        return -1;
+    }
+
+    if (len == 0)
+        return 0;
+
+    if (virRotatingFileWriterAppend(file->file, buf, len) != len)
+        return -1;
+
+    return len;
+}
+
+
 static void
 virLogHandlerDomainLogFileEvent(int watch,
                                 int fd,
@@ -143,8 +214,6 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandlerPtr handler = opaque;
     virLogHandlerLogFilePtr logfile;
-    char buf[1024];
-    ssize_t len;
 
     virObjectLock(handler);
     logfile = virLogHandlerGetLogFileFromWatch(handler, watch);
@@ -154,35 +223,27 @@ virLogHandlerDomainLogFileEvent(int watch,
         return;
     }
 
+    /* Don't hold up other domains' logs while writing this one */
+    virMutexLock(&logfile->lock);
+    virObjectUnlock(handler);
+
     if (logfile->drained) {
         logfile->drained = false;
-        goto cleanup;
+        virMutexUnlock(&logfile->lock);
+        return;
     }
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
+    if (virLogHandlerLogFileAppendPipe(logfile) <= 0) {
+        virMutexUnlock(&logfile->lock);
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
-    } else if (len == 0) {
-        goto error;
+        virObjectLock(handler);
+        handler->inhibitor(false, handler->opaque);
+        virLogHandlerLogFileClose(handler, logfile);
+        virObjectUnlock(handler);
+        return;
     }
 
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
-        goto error;
-
- cleanup:
-    virObjectUnlock(handler);
-    return;
-
- error:
-    handler->inhibitor(false, handler->opaque);
-    virLogHandlerLogFileClose(handler, logfile);
-    virObjectUnlock(handler);
+    virMutexUnlock(&logfile->lock);
 }
 
 
@@ -220,7 +281,8 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
     const char *domuuid;
     const char *tmp;
 
-    file = g_new0(virLogHandlerLogFile, 1);
+    if (!(file = virLogHandlerLogFileNew()))
+        return NULL;
 
     handler->inhibitor(true, handler->opaque);
 
@@ -387,9 +449,9 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
     if (virPipe(pipefd) < 0)
         goto error;
 
-    file = g_new0(virLogHandlerLogFile, 1);
+    if (!(file = virLogHandlerLogFileNew()))
+        goto error;
 
-    file->watch = -1;
     file->pipefd = pipefd[0];
     pipefd[0] = -1;
     memcpy(file->domuuid, domuuid, VIR_UUID_BUFLEN);
@@ -431,11 +493,12 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
 }
 
 
+/*
+ * Must be called with the lock of @file held.
+ */
 static void
 virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
 {
-    char buf[1024];
-    ssize_t len;
     struct pollfd pfd;
     int ret;
 
@@ -455,18 +518,11 @@ virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
         if (ret == 0)
             return;
 
-        len = read(file->pipefd, buf, sizeof(buf));
         file->drained = true;
-        if (len < 0) {
-            if (errno == EINTR)
-                continue;
-            return;
-        } else if (len == 0) {
+        if (virLogHandlerLogFileAppendPipe(file) <= 0) {
+            virResetLastError();
             return;
         }
-
-        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
-            return;
     }
 }
 
@@ -479,7 +535,6 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
                                       off_t *offset)
 {
     virLogHandlerLogFilePtr file = NULL;
-    int ret = -1;
     size_t i;
 
     virCheckFlags(0, -1);
@@ -498,19 +553,20 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("No open log file %s"),
                        path);
-        goto cleanup;
+        virObjectUnlock(handler);
+        return -1;
     }
 
+    virMutexLock(&file->lock);
+    virObjectUnlock(handler);
+
     virLogHandlerDomainLogFileDrain(file);
 
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
 
-    ret = 0;
-
- cleanup:
-    virObjectUnlock(handler);
-    return ret;
+    virMutexUnlock(&file->lock);
+    return 0;
 }
 
 
@@ -565,7 +621,7 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
                                  unsigned int flags)
 {
     size_t i;
-    virRotatingFileWriterPtr writer = NULL;
+    virLogHandlerLogFilePtr file = NULL;
     virRotatingFileWriterPtr newwriter = NULL;
     int ret = -1;
 
@@ -577,23 +633,29 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
 
     for (i = 0; i < handler->nfiles; i++) {
         if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file), path)) {
-            writer = handler->files[i]->file;
+            file = handler->files[i];
             break;
         }
     }
 
-    if (!writer) {
-        if (!(newwriter = virRotatingFileWriterNew(path,
-                                                   handler->max_size,
-                                                   handler->max_backups,
-                                                   false,
-                                                   DEFAULT_MODE)))
-            goto cleanup;
-
-        writer = newwriter;
+    if (file) {
+        /* Only serialize with writers of this particular file */
+        virMutexLock(&file->lock);
+        virObjectUnlock(handler);
+        if (virRotatingFileWriterAppend(file->file, message, strlen(message)) >= 0)
+            ret = 0;
+        virMutexUnlock(&file->lock);
+        return ret;
     }
 
-    if (virRotatingFileWriterAppend(writer, message, strlen(message)) < 0)
+    if (!(newwriter = virRotatingFileWriterNew(path,
+                                               handler->max_size,
+                                               handler->max_backups,
+                                               false,
+                                               DEFAULT_MODE)))
+        goto cleanup;
+
+    if (virRotatingFileWriterAppend(newwriter, message, strlen(message)) < 0)
         goto cleanup;
 
     ret = 0;
@@ -169,6 +169,57 @@ int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo)
 }
 
 
+/**
+ * virLXCCgroupGetCpus:
+ * @cpus: returned bitmap
+ *
+ * Get the host CPUs the container is allowed to run on. If the
+ * cpuset controller is not available, @cpus is set to NULL.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virLXCCgroupGetCpus(virBitmapPtr *cpus)
+{
+    g_autoptr(virCgroup) cgroup = NULL;
+    g_autofree char *str = NULL;
+
+    *cpus = NULL;
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    if (!virCgroupHasController(cgroup, VIR_CGROUP_CONTROLLER_CPUSET))
+        return 0;
+
+    if (virCgroupGetCpusetCpus(cgroup, &str) < 0)
+        return -1;
+
+    if (!*str)
+        return 0;
+
+    return virBitmapParse(str, cpus, VIR_DOMAIN_CPUMASK_LEN);
+}
+
+
+/**
+ * virLXCCgroupGetCpuUsage:
+ * @usage: returned CPU time, in nanoseconds
+ *
+ * Get the CPU time consumed by all the tasks of the container.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virLXCCgroupGetCpuUsage(unsigned long long *usage)
+{
+    g_autoptr(virCgroup) cgroup = NULL;
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    return virCgroupGetCpuacctUsage(cgroup, usage);
+}
+
+
 
 typedef struct _virLXCCgroupDevicePolicy virLXCCgroupDevicePolicy;
 typedef virLXCCgroupDevicePolicy *virLXCCgroupDevicePolicyPtr;
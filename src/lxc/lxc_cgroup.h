@@ -36,6 +36,8 @@ int virLXCCgroupSetup(virDomainDefPtr def,
                       virBitmapPtr nodemask);
 
 int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo);
+int virLXCCgroupGetCpus(virBitmapPtr *cpus);
+int virLXCCgroupGetCpuUsage(unsigned long long *usage);
 
 int
 virLXCSetupHostUSBDeviceCgroup(virUSBDevicePtr dev,
@@ -32,19 +32,458 @@
 #include "virbuffer.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virhostcpu.h"
 
 #define VIR_FROM_THIS VIR_FROM_LXC
 
+VIR_ENUM_IMPL(virLXCProcFile,
+              VIR_LXC_PROC_LAST,
+              "meminfo",
+              "cpuinfo",
+              "stat",
+              "uptime",
+              "loadavg",
+);
+
+/* Number of CPU time columns in /proc/stat we care about */
+#define LXC_PROC_STAT_FIELDS 10
+
+/* Interval of load average sampling, as used by the kernel, in us */
+#define LXC_PROC_LOAD_FREQ (5 * 1000 * 1000)
+/* After this many intervals any past load is forgotten anyway */
+#define LXC_PROC_LOAD_MAX_TICKS 1000
+
+/* Decay factors of the 1, 5 and 15 minute load averages per
+ * LXC_PROC_LOAD_FREQ, same as EXP_1, EXP_5 and EXP_15 in the kernel */
+static const double lxcProcLoadExp[] = {
+    1884 / 2048.0, 2014 / 2048.0, 2037 / 2048.0,
+};
+
+
+/* Splits @str into lines, ignoring the empty string after the final
+ * newline. */
+static char **
+lxcProcSplitLines(const char *str,
+                  size_t *nlines)
+{
+    char **lines = g_strsplit(str, "\n", 0);
+
+    *nlines = g_strv_length(lines);
+    if (*nlines > 0 && !*lines[*nlines - 1])
+        (*nlines)--;
+
+    return lines;
+}
+
+
+char *lxcProcMeminfoFormat(const char *hostinfo,
+                           virDomainDefPtr def,
+                           virLXCMeminfoPtr meminfo)
+{
+    g_auto(virBuffer) buffer = VIR_BUFFER_INITIALIZER;
+    virBufferPtr new_meminfo = &buffer;
+    g_auto(GStrv) lines = NULL;
+    size_t nlines;
+    size_t i;
+    bool memLimit = virMemoryLimitIsSet(def->mem.hard_limit) ||
+                    virDomainDefGetMemoryTotal(def);
+    bool swapLimit = virMemoryLimitIsSet(def->mem.swap_hard_limit);
+
+    lines = lxcProcSplitLines(hostinfo, &nlines);
+
+    for (i = 0; i < nlines; i++) {
+        char *line = lines[i];
+        char *ptr = strchr(line, ':');
+        if (!ptr)
+            continue;
+        *ptr = '\0';
+
+        if (STREQ(line, "MemTotal") && memLimit) {
+            virBufferAsprintf(new_meminfo, "MemTotal:       %8llu kB\n",
+                              meminfo->memtotal);
+        } else if (STREQ(line, "MemFree") && memLimit) {
+            virBufferAsprintf(new_meminfo, "MemFree:        %8llu kB\n",
+                              (meminfo->memtotal - meminfo->memusage));
+        } else if (STREQ(line, "MemAvailable") && memLimit) {
+            /* MemAvailable is actually MemFree + SRReclaimable +
+               some other bits, but MemFree is the closest approximation
+               we have */
+            virBufferAsprintf(new_meminfo, "MemAvailable:   %8llu kB\n",
+                              (meminfo->memtotal - meminfo->memusage));
+        } else if (STREQ(line, "Buffers")) {
+            virBufferAsprintf(new_meminfo, "Buffers:        %8d kB\n", 0);
+        } else if (STREQ(line, "Cached")) {
+            virBufferAsprintf(new_meminfo, "Cached:         %8llu kB\n",
+                              meminfo->cached);
+        } else if (STREQ(line, "Active")) {
+            virBufferAsprintf(new_meminfo, "Active:         %8llu kB\n",
+                              (meminfo->active_anon + meminfo->active_file));
+        } else if (STREQ(line, "Inactive")) {
+            virBufferAsprintf(new_meminfo, "Inactive:       %8llu kB\n",
+                              (meminfo->inactive_anon + meminfo->inactive_file));
+        } else if (STREQ(line, "Active(anon)")) {
+            virBufferAsprintf(new_meminfo, "Active(anon):   %8llu kB\n",
+                              meminfo->active_anon);
+        } else if (STREQ(line, "Inactive(anon)")) {
+            virBufferAsprintf(new_meminfo, "Inactive(anon): %8llu kB\n",
+                              meminfo->inactive_anon);
+        } else if (STREQ(line, "Active(file)")) {
+            virBufferAsprintf(new_meminfo, "Active(file):   %8llu kB\n",
+                              meminfo->active_file);
+        } else if (STREQ(line, "Inactive(file)")) {
+            virBufferAsprintf(new_meminfo, "Inactive(file): %8llu kB\n",
+                              meminfo->inactive_file);
+        } else if (STREQ(line, "Unevictable")) {
+            virBufferAsprintf(new_meminfo, "Unevictable:    %8llu kB\n",
+                              meminfo->unevictable);
+        } else if (STREQ(line, "SwapTotal") && swapLimit) {
+            virBufferAsprintf(new_meminfo, "SwapTotal:      %8llu kB\n",
+                              (meminfo->swaptotal - meminfo->memtotal));
+        } else if (STREQ(line, "SwapFree") && swapLimit) {
+            virBufferAsprintf(new_meminfo, "SwapFree:       %8llu kB\n",
+                              (meminfo->swaptotal - meminfo->memtotal -
+                               meminfo->swapusage + meminfo->memusage));
+        } else if (STREQ(line, "Slab")) {
+            virBufferAsprintf(new_meminfo, "Slab:           %8d kB\n", 0);
+        } else if (STREQ(line, "SReclaimable")) {
+            virBufferAsprintf(new_meminfo, "SReclaimable:   %8d kB\n", 0);
+        } else if (STREQ(line, "SUnreclaim")) {
+            virBufferAsprintf(new_meminfo, "SUnreclaim:     %8d kB\n", 0);
+        } else {
+            *ptr = ':';
+            virBufferAsprintf(new_meminfo, "%s\n", line);
+        }
+    }
+
+    return virBufferContentAndReset(new_meminfo);
+}
+
+
+/**
+ * lxcProcCpuinfoFormat:
+ * @hostinfo: contents of the host's /proc/cpuinfo
+ * @cpus: CPUs the container may use, or NULL
+ *
+ * Drops the blocks describing CPUs not in @cpus and renumbers the
+ * remaining ones so that they appear as CPUs 0 to N-1.
+ *
+ * Returns the new contents.
+ */
+char *lxcProcCpuinfoFormat(const char *hostinfo,
+                           virBitmapPtr cpus)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(GStrv) lines = NULL;
+    size_t nlines;
+    size_t ncpus = 0;
+    bool keep = true;
+    size_t i;
+
+    if (!cpus)
+        return g_strdup(hostinfo);
+
+    lines = lxcProcSplitLines(hostinfo, &nlines);
+
+    for (i = 0; i < nlines; i++) {
+        const char *line = lines[i];
+        const char *sep;
+        unsigned int id;
+
+        if (STRPREFIX(line, "processor") &&
+            (sep = strchr(line, ':')) &&
+            virStrToLong_ui(sep + 1, NULL, 10, &id) == 0) {
+            if ((keep = virBitmapIsBitSet(cpus, id)))
+                virBufferAsprintf(&buf, "%.*s: %zu\n",
+                                  (int)(sep - line), line, ncpus++);
+            continue;
+        }
+
+        if (keep)
+            virBufferAsprintf(&buf, "%s\n", line);
+
+        /* An empty line ends the block of a processor */
+        if (!*line)
+            keep = true;
+    }
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/* Parses a "cpu" or "cpuN" line of /proc/stat. @cpu is set to -1 for
+ * the line which sums up all CPUs. */
+static bool
+lxcProcStatParseCpu(const char *line,
+                    int *cpu,
+                    unsigned long long *fields,
+                    size_t *nfields)
+{
+    const char *cur;
+    char *end;
+
+    if (!STRPREFIX(line, "cpu"))
+        return false;
+
+    cur = line + strlen("cpu");
+
+    if (*cur == ' ') {
+        *cpu = -1;
+    } else {
+        unsigned int id;
+
+        if (virStrToLong_ui(cur, &end, 10, &id) < 0 ||
+            *end != ' ' || id > INT_MAX)
+            return false;
+
+        *cpu = id;
+        cur = end;
+    }
+
+    *nfields = 0;
+    while (*nfields < LXC_PROC_STAT_FIELDS &&
+           virStrToLong_ull(cur, &end, 10, &fields[*nfields]) == 0) {
+        cur = end;
+        (*nfields)++;
+    }
+
+    return true;
+}
+
+
+/**
+ * lxcProcStatFormat:
+ * @hoststat: contents of the host's /proc/stat
+ * @cpus: CPUs the container may use, or NULL
+ *
+ * Drops the lines of CPUs not in @cpus, renumbers the remaining ones
+ * and makes the aggregate line sum up just those.
+ *
+ * Returns the new contents.
+ */
+char *lxcProcStatFormat(const char *hoststat,
+                        virBitmapPtr cpus)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(GStrv) lines = NULL;
+    unsigned long long fields[LXC_PROC_STAT_FIELDS];
+    unsigned long long total[LXC_PROC_STAT_FIELDS] = { 0 };
+    size_t ntotal = 0;
+    size_t nfields;
+    size_t nlines;
+    size_t ncpus = 0;
+    int cpu;
+    size_t i, j;
+
+    if (!cpus)
+        return g_strdup(hoststat);
+
+    lines = lxcProcSplitLines(hoststat, &nlines);
+
+    /* The aggregate line comes first, so sum up the CPUs beforehand */
+    for (i = 0; i < nlines; i++) {
+        if (!lxcProcStatParseCpu(lines[i], &cpu, fields, &nfields) ||
+            cpu < 0 || !virBitmapIsBitSet(cpus, cpu))
+            continue;
+
+        for (j = 0; j < nfields; j++)
+            total[j] += fields[j];
+        ntotal = MAX(ntotal, nfields);
+    }
+
+    for (i = 0; i < nlines; i++) {
+        if (!lxcProcStatParseCpu(lines[i], &cpu, fields, &nfields)) {
+            virBufferAsprintf(&buf, "%s\n", lines[i]);
+            continue;
+        }
+
+        if (cpu < 0) {
+            virBufferAddLit(&buf, "cpu ");
+            for (j = 0; j < ntotal; j++)
+                virBufferAsprintf(&buf, " %llu", total[j]);
+        } else if (virBitmapIsBitSet(cpus, cpu)) {
+            virBufferAsprintf(&buf, "cpu%zu", ncpus++);
+            for (j = 0; j < nfields; j++)
+                virBufferAsprintf(&buf, " %llu", fields[j]);
+        } else {
+            continue;
+        }
+        virBufferAddLit(&buf, "\n");
+    }
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/**
+ * lxcProcUptimeFormat:
+ * @uptime: time since the container was started, in us
+ * @usage: CPU time consumed by the container, in ns
+ * @ncpus: number of CPUs the container may use
+ *
+ * Formats /proc/uptime. The idle time is the time the container's
+ * CPUs were not used by the container, summed over all of them.
+ *
+ * Returns the new contents.
+ */
+char *lxcProcUptimeFormat(long long uptime,
+                          unsigned long long usage,
+                          size_t ncpus)
+{
+    /* Both in hundredths of a second */
+    unsigned long long up = uptime > 0 ? uptime / 10000 : 0;
+    unsigned long long busy = usage / 10000000;
+    unsigned long long idle = 0;
+
+    if (up * ncpus > busy)
+        idle = up * ncpus - busy;
+
+    return g_strdup_printf("%llu.%02llu %llu.%02llu\n",
+                           up / 100, up % 100, idle / 100, idle % 100);
+}
+
+
+/**
+ * lxcProcLoadavgUpdate:
+ * @loadavg: load average state
+ * @usage: CPU time consumed by the container, in ns
+ * @now: current monotonic time, in us
+ *
+ * The kernel does not track load per cgroup. Approximate it with the
+ * average number of CPUs the container kept busy, decayed the same
+ * way the kernel decays the host load every five seconds.
+ */
+void lxcProcLoadavgUpdate(virLXCLoadavgPtr loadavg,
+                          unsigned long long usage,
+                          long long now)
+{
+    long long elapsed = now - loadavg->sample;
+    size_t ticks;
+    double active;
+    size_t i, j;
+
+    if (loadavg->sample == 0 || usage < loadavg->usage) {
+        loadavg->usage = usage;
+        loadavg->sample = now;
+        return;
+    }
+
+    if (elapsed < LXC_PROC_LOAD_FREQ)
+        return;
+
+    ticks = MIN(elapsed / LXC_PROC_LOAD_FREQ, LXC_PROC_LOAD_MAX_TICKS);
+    active = (usage - loadavg->usage) / (elapsed * 1000.0);
+
+    for (i = 0; i < G_N_ELEMENTS(loadavg->load); i++) {
+        for (j = 0; j < ticks; j++)
+            loadavg->load[i] = loadavg->load[i] * lxcProcLoadExp[i] +
+                               active * (1 - lxcProcLoadExp[i]);
+    }
+
+    loadavg->usage = usage;
+    loadavg->sample = now;
+}
+
+
+/**
+ * lxcProcLoadavgFormat:
+ * @loadavg: load average state
+ * @hostloadavg: contents of the host's /proc/loadavg, or NULL
+ *
+ * Formats /proc/loadavg. Task counts and the last PID are not tracked
+ * per container and are taken from @hostloadavg.
+ *
+ * Returns the new contents.
+ */
+char *lxcProcLoadavgFormat(virLXCLoadavgPtr loadavg,
+                           const char *hostloadavg)
+{
+    const char *tasks = "0/0 0\n";
+    const char *cur = hostloadavg;
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(loadavg->load) && cur; i++) {
+        if ((cur = strchr(cur, ' ')))
+            cur++;
+    }
+
+    if (cur && *cur)
+        tasks = cur;
+
+    return g_strdup_printf("%.2f %.2f %.2f %s",
+                           loadavg->load[0], loadavg->load[1],
+                           loadavg->load[2], tasks);
+}
+
+
+/**
+ * lxcProcSnapshotRead:
+ * @snapshot: snapshot of the file being read
+ * @buf: where to store the data read
+ * @size: size of @buf
+ * @offset: offset in the file to read from
+ * @now: current monotonic time, in us
+ * @generate: callback generating new contents of the file
+ * @opaque: data for @generate
+ *
+ * Reads past the start of the file are served from @snapshot, so that
+ * a reader sees consistent contents across several read() calls. A
+ * read at offset zero gets new contents from @generate only once
+ * @snapshot is older than LXC_FUSE_CACHE_INTERVAL.
+ *
+ * Returns the number of bytes read, or -1 if no contents could be
+ * generated. @snapshot is left untouched in that case.
+ */
+int lxcProcSnapshotRead(struct virLXCProcSnapshot *snapshot,
+                        char *buf,
+                        size_t size,
+                        off_t offset,
+                        long long now,
+                        virLXCProcGenerator generate,
+                        void *opaque)
+{
+    int res = 0;
+
+    if (!snapshot->content ||
+        (offset == 0 && now - snapshot->stamp >= LXC_FUSE_CACHE_INTERVAL)) {
+        char *content;
+
+        if (!(content = generate(now, opaque)))
+            return -1;
+
+        g_free(snapshot->content);
+        snapshot->content = content;
+        snapshot->len = strlen(content);
+        snapshot->stamp = now;
+    }
+
+    if (offset >= 0 && (size_t)offset < snapshot->len) {
+        res = MIN(size, snapshot->len - (size_t)offset);
+        memcpy(buf, snapshot->content + offset, res);
+    }
+
+    return res;
+}
+
+
 #if WITH_FUSE
 
-static const char *fuse_meminfo_path = "/meminfo";
+# define LXC_PROC_MAX_SIZE (1024 * 1024)
+
+static int lxcProcFileFromPath(const char *path)
+{
+    if (path[0] != '/')
+        return -1;
+
+    return virLXCProcFileTypeFromString(path + 1);
+}
 
 static int lxcProcGetattr(const char *path, struct stat *stbuf)
 {
     g_autofree char *mempath = NULL;
     struct stat sb;
     struct fuse_context *context = fuse_get_context();
-    virDomainDefPtr def = (virDomainDefPtr)context->private_data;
+    virLXCFusePtr fuse = context->private_data;
+    virDomainDefPtr def = fuse->def;
 
     memset(stbuf, 0, sizeof(struct stat));
     mempath = g_strdup_printf("/proc/%s", path);
@@ -52,7 +491,7 @@ static int lxcProcGetattr(const char *path, struct stat *stbuf)
     if (STREQ(path, "/")) {
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 2;
-    } else if (STREQ(path, fuse_meminfo_path)) {
+    } else if (lxcProcFileFromPath(path) >= 0) {
         if (stat(mempath, &sb) < 0)
             return -errno;
 
@@ -78,20 +517,23 @@ static int lxcProcReaddir(const char *path, void *buf,
                           off_t offset G_GNUC_UNUSED,
                           struct fuse_file_info *fi G_GNUC_UNUSED)
 {
+    size_t i;
+
     if (STRNEQ(path, "/"))
         return -ENOENT;
 
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
-    filler(buf, fuse_meminfo_path + 1, NULL, 0);
+    for (i = 0; i < VIR_LXC_PROC_LAST; i++)
+        filler(buf, virLXCProcFileTypeToString(i), NULL, 0);
 
     return 0;
 }
 
-static int lxcProcOpen(const char *path G_GNUC_UNUSED,
-                       struct fuse_file_info *fi G_GNUC_UNUSED)
+static int lxcProcOpen(const char *path,
+                       struct fuse_file_info *fi)
 {
-    if (STRNEQ(path, fuse_meminfo_path))
+    if (lxcProcFileFromPath(path) < 0)
         return -ENOENT;
 
     if ((fi->flags & 3) != O_RDONLY)
@@ -116,136 +558,105 @@ static int lxcProcHostRead(char *path, char *buf, size_t size, off_t offset)
     return res;
 }
 
-static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
-                              char *buf, size_t size, off_t offset)
+static int lxcProcGetCpuCount(virBitmapPtr cpus)
 {
-    int res;
-    FILE *fd = NULL;
-    g_autofree char *line = NULL;
-    size_t n;
-    struct virLXCMeminfo meminfo;
-    g_auto(virBuffer) buffer = VIR_BUFFER_INITIALIZER;
-    virBufferPtr new_meminfo = &buffer;
+    if (cpus)
+        return virBitmapCountBits(cpus);
 
-    if (virLXCCgroupGetMeminfo(&meminfo) < 0) {
-        virErrorSetErrnoFromLastError();
-        return -errno;
-    }
-
-    fd = fopen(hostpath, "r");
-    if (fd == NULL) {
-        virReportSystemError(errno, _("Cannot open %s"), hostpath);
-        res = -errno;
-        goto cleanup;
-    }
-
-    if (fseek(fd, offset, SEEK_SET) < 0) {
-        virReportSystemError(errno, "%s", _("fseek failed"));
-        res = -errno;
-        goto cleanup;
-    }
-
-    res = -1;
-    while (getline(&line, &n, fd) > 0) {
-        char *ptr = strchr(line, ':');
-        if (!ptr)
-            continue;
-        *ptr = '\0';
+    return virHostCPUGetCount();
+}
 
-        if (STREQ(line, "MemTotal") &&
-            (virMemoryLimitIsSet(def->mem.hard_limit) ||
-             virDomainDefGetMemoryTotal(def))) {
-            virBufferAsprintf(new_meminfo, "MemTotal:       %8llu kB\n",
-                              meminfo.memtotal);
-        } else if (STREQ(line, "MemFree") &&
-                   (virMemoryLimitIsSet(def->mem.hard_limit) ||
-                    virDomainDefGetMemoryTotal(def))) {
-            virBufferAsprintf(new_meminfo, "MemFree:        %8llu kB\n",
-                              (meminfo.memtotal - meminfo.memusage));
-        } else if (STREQ(line, "MemAvailable") &&
-                   (virMemoryLimitIsSet(def->mem.hard_limit) ||
-                    virDomainDefGetMemoryTotal(def))) {
-            /* MemAvailable is actually MemFree + SRReclaimable +
-               some other bits, but MemFree is the closest approximation
-               we have */
-            virBufferAsprintf(new_meminfo, "MemAvailable:   %8llu kB\n",
-                              (meminfo.memtotal - meminfo.memusage));
-        } else if (STREQ(line, "Buffers")) {
-            virBufferAsprintf(new_meminfo, "Buffers:        %8d kB\n", 0);
-        } else if (STREQ(line, "Cached")) {
-            virBufferAsprintf(new_meminfo, "Cached:         %8llu kB\n",
-                              meminfo.cached);
-        } else if (STREQ(line, "Active")) {
-            virBufferAsprintf(new_meminfo, "Active:         %8llu kB\n",
-                              (meminfo.active_anon + meminfo.active_file));
-        } else if (STREQ(line, "Inactive")) {
-            virBufferAsprintf(new_meminfo, "Inactive:       %8llu kB\n",
-                              (meminfo.inactive_anon + meminfo.inactive_file));
-        } else if (STREQ(line, "Active(anon)")) {
-            virBufferAsprintf(new_meminfo, "Active(anon):   %8llu kB\n",
-                              meminfo.active_anon);
-        } else if (STREQ(line, "Inactive(anon)")) {
-            virBufferAsprintf(new_meminfo, "Inactive(anon): %8llu kB\n",
-                              meminfo.inactive_anon);
-        } else if (STREQ(line, "Active(file)")) {
-            virBufferAsprintf(new_meminfo, "Active(file):   %8llu kB\n",
-                              meminfo.active_file);
-        } else if (STREQ(line, "Inactive(file)")) {
-            virBufferAsprintf(new_meminfo, "Inactive(file): %8llu kB\n",
-                              meminfo.inactive_file);
-        } else if (STREQ(line, "Unevictable")) {
-            virBufferAsprintf(new_meminfo, "Unevictable:    %8llu kB\n",
-                              meminfo.unevictable);
-        } else if (STREQ(line, "SwapTotal") &&
-                   virMemoryLimitIsSet(def->mem.swap_hard_limit)) {
-            virBufferAsprintf(new_meminfo, "SwapTotal:      %8llu kB\n",
-                              (meminfo.swaptotal - meminfo.memtotal));
-        } else if (STREQ(line, "SwapFree") &&
-                   virMemoryLimitIsSet(def->mem.swap_hard_limit)) {
-            virBufferAsprintf(new_meminfo, "SwapFree:       %8llu kB\n",
-                              (meminfo.swaptotal - meminfo.memtotal -
-                               meminfo.swapusage + meminfo.memusage));
-        } else if (STREQ(line, "Slab")) {
-            virBufferAsprintf(new_meminfo, "Slab:           %8d kB\n", 0);
-        } else if (STREQ(line, "SReclaimable")) {
-            virBufferAsprintf(new_meminfo, "SReclaimable:   %8d kB\n", 0);
-        } else if (STREQ(line, "SUnreclaim")) {
-            virBufferAsprintf(new_meminfo, "SUnreclaim:     %8d kB\n", 0);
-        } else {
-            *ptr = ':';
-            virBufferAdd(new_meminfo, line, -1);
-        }
+struct lxcProcGenerateData {
+    virLXCFusePtr fuse;
+    virLXCProcFile file;
+};
 
+/* Generates the contents of a file for the container. Must be called
+ * with fuse->lock held. */
+static char *lxcProcGenerate(long long now,
+                             void *opaque)
+{
+    struct lxcProcGenerateData *data = opaque;
+    virLXCFusePtr fuse = data->fuse;
+    virLXCProcFile file = data->file;
+    g_autofree char *hostpath = NULL;
+    g_autofree char *host = NULL;
+    g_autoptr(virBitmap) cpus = NULL;
+    struct virLXCMeminfo meminfo;
+    unsigned long long usage;
+    int ncpus;
+
+    hostpath = g_strdup_printf("/proc/%s", virLXCProcFileTypeToString(file));
+
+    switch (file) {
+    case VIR_LXC_PROC_MEMINFO:
+        if (virLXCCgroupGetMeminfo(&meminfo) < 0 ||
+            virFileReadAll(hostpath, LXC_PROC_MAX_SIZE, &host) < 0)
+            return NULL;
+        return lxcProcMeminfoFormat(host, fuse->def, &meminfo);
+
+    case VIR_LXC_PROC_CPUINFO:
+        if (virLXCCgroupGetCpus(&cpus) < 0 ||
+            virFileReadAll(hostpath, LXC_PROC_MAX_SIZE, &host) < 0)
+            return NULL;
+        return lxcProcCpuinfoFormat(host, cpus);
+
+    case VIR_LXC_PROC_STAT:
+        if (virLXCCgroupGetCpus(&cpus) < 0 ||
+            virFileReadAll(hostpath, LXC_PROC_MAX_SIZE, &host) < 0)
+            return NULL;
+        return lxcProcStatFormat(host, cpus);
+
+    case VIR_LXC_PROC_UPTIME:
+        if (virLXCCgroupGetCpus(&cpus) < 0 ||
+            virLXCCgroupGetCpuUsage(&usage) < 0 ||
+            (ncpus = lxcProcGetCpuCount(cpus)) < 0)
+            return NULL;
+        return lxcProcUptimeFormat(now - fuse->start, usage, ncpus);
+
+    case VIR_LXC_PROC_LOADAVG:
+        if (virLXCCgroupGetCpuUsage(&usage) < 0)
+            return NULL;
+        /* Only used for the task counts */
+        ignore_value(virFileReadAll(hostpath, LXC_PROC_MAX_SIZE, &host));
+        lxcProcLoadavgUpdate(&fuse->loadavg, usage, now);
+        return lxcProcLoadavgFormat(&fuse->loadavg, host);
+
+    case VIR_LXC_PROC_LAST:
+        break;
     }
-    res = strlen(virBufferCurrentContent(new_meminfo));
-    if (res > size)
-        res = size;
-    memcpy(buf, virBufferCurrentContent(new_meminfo), res);
 
- cleanup:
-    VIR_FORCE_FCLOSE(fd);
-    return res;
+    return NULL;
 }
 
-static int lxcProcRead(const char *path G_GNUC_UNUSED,
-                       char *buf G_GNUC_UNUSED,
-                       size_t size G_GNUC_UNUSED,
-                       off_t offset G_GNUC_UNUSED,
+static int lxcProcRead(const char *path,
+                       char *buf,
+                       size_t size,
+                       off_t offset,
                        struct fuse_file_info *fi G_GNUC_UNUSED)
 {
-    int res = -ENOENT;
+    int res;
     g_autofree char *hostpath = NULL;
     struct fuse_context *context = NULL;
-    virDomainDefPtr def = NULL;
+    struct lxcProcGenerateData data;
+    int file;
 
-    hostpath = g_strdup_printf("/proc/%s", path);
+    if ((file = lxcProcFileFromPath(path)) < 0)
+        return -ENOENT;
 
     context = fuse_get_context();
-    def = (virDomainDefPtr)context->private_data;
-
-    if (STREQ(path, fuse_meminfo_path)) {
-        if ((res = lxcProcReadMeminfo(hostpath, def, buf, size, offset)) < 0)
-            res = lxcProcHostRead(hostpath, buf, size, offset);
+    data.fuse = context->private_data;
+    data.file = file;
+
+    virMutexLock(&data.fuse->lock);
+    res = lxcProcSnapshotRead(&data.fuse->snapshots[file], buf, size, offset,
+                              g_get_monotonic_time(),
+                              lxcProcGenerate, &data);
+    virMutexUnlock(&data.fuse->lock);
+
+    if (res < 0) {
+        hostpath = g_strdup_printf("/proc/%s", path);
+        return lxcProcHostRead(hostpath, buf, size, offset);
     }
 
     return res;
@@ -285,6 +696,7 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
     virLXCFusePtr fuse = g_new0(virLXCFuse, 1);
 
     fuse->def = def;
+    fuse->start = g_get_monotonic_time();
 
     if (virMutexInit(&fuse->lock) < 0)
         goto cleanup2;
@@ -309,7 +721,7 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
         goto cleanup1;
 
     fuse->fuse = fuse_new(fuse->ch, &args, &lxcProcOper,
-                          sizeof(lxcProcOper), fuse->def);
+                          sizeof(lxcProcOper), fuse);
     if (fuse->fuse == NULL) {
         fuse_unmount(fuse->mountpoint, fuse->ch);
         goto cleanup1;
@@ -342,6 +754,8 @@ int lxcStartFuse(virLXCFusePtr fuse)
 void lxcFreeFuse(virLXCFusePtr *f)
 {
     virLXCFusePtr fuse = *f;
+    size_t i;
+
     /* lxcFuseRun thread create success */
     if (fuse) {
         /* exit fuse_loop, lxcFuseRun thread may try to destroy
@@ -351,6 +765,8 @@ void lxcFreeFuse(virLXCFusePtr *f)
             fuse_exit(fuse->fuse);
         virMutexUnlock(&fuse->lock);
 
+        for (i = 0; i < VIR_LXC_PROC_LAST; i++)
+            g_free(fuse->snapshots[i].content);
         g_free(fuse->mountpoint);
         g_free(*f);
     }
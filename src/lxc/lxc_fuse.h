@@ -27,6 +27,8 @@
 #endif
 
 #include "lxc_conf.h"
+#include "virbitmap.h"
+#include "virenum.h"
 
 struct virLXCMeminfo {
     unsigned long long memtotal;
@@ -42,6 +44,40 @@ struct virLXCMeminfo {
 };
 typedef struct virLXCMeminfo *virLXCMeminfoPtr;
 
+struct virLXCLoadavg {
+    double load[3];
+    unsigned long long usage; /* CPU time at @sample, in ns */
+    long long sample;         /* monotonic time of last sample, in us */
+};
+typedef struct virLXCLoadavg *virLXCLoadavgPtr;
+
+typedef enum {
+    VIR_LXC_PROC_MEMINFO,
+    VIR_LXC_PROC_CPUINFO,
+    VIR_LXC_PROC_STAT,
+    VIR_LXC_PROC_UPTIME,
+    VIR_LXC_PROC_LOADAVG,
+
+    VIR_LXC_PROC_LAST
+} virLXCProcFile;
+
+VIR_ENUM_DECL(virLXCProcFile);
+
+/* How long a snapshot of a /proc file is served, in us */
+#define LXC_FUSE_CACHE_INTERVAL (1000 * 1000)
+
+/* Contents of a virtualized /proc file, shared by all reads until
+ * it gets too old */
+struct virLXCProcSnapshot {
+    char *content;
+    size_t len;
+    long long stamp; /* monotonic time of generation, in us */
+};
+
+/* Generates the contents of a virtualized /proc file at @now, returns
+ * NULL on failure */
+typedef char *(*virLXCProcGenerator)(long long now, void *opaque);
+
 struct virLXCFuse {
     virDomainDefPtr def;
     virThread thread;
@@ -49,6 +85,9 @@ struct virLXCFuse {
     struct fuse *fuse;
     struct fuse_chan *ch;
     virMutex lock;
+    long long start; /* monotonic time the container was started at */
+    struct virLXCProcSnapshot snapshots[VIR_LXC_PROC_LAST];
+    struct virLXCLoadavg loadavg;
 };
 typedef struct virLXCFuse virLXCFuse;
 typedef struct virLXCFuse *virLXCFusePtr;
@@ -56,3 +95,27 @@ typedef struct virLXCFuse *virLXCFusePtr;
 int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def);
 int lxcStartFuse(virLXCFusePtr f);
 void lxcFreeFuse(virLXCFusePtr *f);
+
+char *lxcProcMeminfoFormat(const char *hostinfo,
+                           virDomainDefPtr def,
+                           virLXCMeminfoPtr meminfo);
+char *lxcProcCpuinfoFormat(const char *hostinfo,
+                           virBitmapPtr cpus);
+char *lxcProcStatFormat(const char *hoststat,
+                        virBitmapPtr cpus);
+char *lxcProcUptimeFormat(long long uptime,
+                          unsigned long long usage,
+                          size_t ncpus);
+void lxcProcLoadavgUpdate(virLXCLoadavgPtr loadavg,
+                          unsigned long long usage,
+                          long long now);
+char *lxcProcLoadavgFormat(virLXCLoadavgPtr loadavg,
+                           const char *hostloadavg);
+
+int lxcProcSnapshotRead(struct virLXCProcSnapshot *snapshot,
+                        char *buf,
+                        size_t size,
+                        off_t offset,
+                        long long now,
+                        virLXCProcGenerator generate,
+                        void *opaque);
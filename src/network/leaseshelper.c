@@ -84,6 +84,7 @@ main(int argc, char **argv)
 {
     g_autofree char *pid_file = NULL;
     g_autofree char *custom_lease_file = NULL;
+    const char *lease_dir = LOCALSTATEDIR "/lib/libvirt/dnsmasq";
     const char *ip = NULL;
     const char *mac = NULL;
     const char *leases_str = NULL;
@@ -156,8 +157,7 @@ main(int argc, char **argv)
 
     server_duid = g_strdup(getenv("DNSMASQ_SERVER_DUID"));
 
-    custom_lease_file = g_strdup_printf(LOCALSTATEDIR "/lib/libvirt/dnsmasq/%s.status",
-                                        interface);
+    custom_lease_file = g_strdup_printf("%s/%s.status", lease_dir, interface);
 
     pid_file = g_strdup(RUNSTATEDIR "/leaseshelper.pid");
 
@@ -250,6 +250,11 @@ main(int argc, char **argv)
         break;
     }
 
+    /* The index merely speeds up lookups in the NSS plugin which falls
+     * back to parsing the lease files whenever the index is stale. */
+    if (virLeaseIndexWrite(lease_dir) < 0)
+        virResetLastError();
+
     rv = EXIT_SUCCESS;
 
  cleanup:
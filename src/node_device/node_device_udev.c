@@ -41,11 +41,16 @@
 #include "virnetdev.h"
 #include "virmdev.h"
 #include "virutil.h"
+#include "virhostcpu.h"
 
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_NODEDEV
 
+/* Maximum number of threads gathering device details during the initial
+ * enumeration of devices */
+#define UDEV_ENUMERATE_MAX_WORKERS 16
+
 VIR_LOG_INIT("node_device.node_device_udev");
 
 #ifndef TYPE_RAID
@@ -314,6 +319,9 @@ udevGenerateDeviceName(struct udev_device *device,
 }
 
 
+/* pci_get_strings loads the PCI IDs database lazily and isn't thread safe */
+static virMutex udevPCIIdsLock = VIR_MUTEX_INITIALIZER;
+
 static int
 udevTranslatePCIIds(unsigned int vendor,
                     unsigned int product,
@@ -331,6 +339,8 @@ udevTranslatePCIIds(unsigned int vendor,
     m.device_class_mask = 0;
     m.match_data = 0;
 
+    virMutexLock(&udevPCIIdsLock);
+
     /* pci_get_strings returns void */
     pci_get_strings(&m,
                     &device_name,
@@ -341,6 +351,8 @@ udevTranslatePCIIds(unsigned int vendor,
     *vendor_string = g_strdup(vendor_name);
     *product_string = g_strdup(device_name);
 
+    virMutexUnlock(&udevPCIIdsLock);
+
     return 0;
 }
 
@@ -1414,33 +1426,54 @@ udevSetParent(struct udev_device *device,
 }
 
 
-static int
-udevAddOneDevice(struct udev_device *device)
+/* Gathers the definition of @device except for its parent, which can
+ * only be linked once the parent device is known.  Doesn't touch the
+ * device list, so it can be run for several devices in parallel.
+ *
+ * Returns the definition or NULL if the device is not interesting or
+ * on error. */
+static virNodeDeviceDefPtr
+udevGetDeviceDef(struct udev_device *device)
 {
-    virNodeDeviceDefPtr def = NULL;
-    virNodeDeviceObjPtr obj = NULL;
-    virNodeDeviceDefPtr objdef;
-    virObjectEventPtr event = NULL;
-    bool new_device = true;
-    int ret = -1;
+    g_autoptr(virNodeDeviceDef) def = NULL;
 
     def = g_new0(virNodeDeviceDef, 1);
 
     def->sysfs_path = g_strdup(udev_device_get_syspath(device));
 
     if (udevGetStringProperty(device, "DRIVER", &def->driver) < 0)
-        goto cleanup;
+        goto error;
 
     def->caps = g_new0(virNodeDevCapsDef, 1);
 
     if (udevGetDeviceType(device, &def->caps->data.type) != 0)
-        goto cleanup;
+        goto error;
 
     if (udevGetDeviceNodes(device, def) != 0)
-        goto cleanup;
+        goto error;
 
     if (udevGetDeviceDetails(device, def) != 0)
-        goto cleanup;
+        goto error;
+
+    return g_steal_pointer(&def);
+
+ error:
+    VIR_DEBUG("Discarding device %p %s", def, NULLSTR(def->sysfs_path));
+    return NULL;
+}
+
+
+/* Links @def to its parent and adds it to the device list.  Consumes
+ * @def. */
+static int
+udevAddOneDeviceDef(struct udev_device *device,
+                    virNodeDeviceDefPtr def)
+{
+    virNodeDeviceObjPtr obj = NULL;
+    virNodeDeviceDefPtr objdef;
+    virObjectEventPtr event = NULL;
+    bool new_device = true;
+    int ret = -1;
 
     if (udevSetParent(device, def) != 0)
         goto cleanup;
@@ -1472,7 +1505,7 @@ udevAddOneDevice(struct udev_device *device)
 
     if (ret != 0) {
         VIR_DEBUG("Discarding device %d %p %s", ret, def,
-                  def ? NULLSTR(def->sysfs_path) : "");
+                  NULLSTR(def->sysfs_path));
         virNodeDeviceDefFree(def);
     }
 
@@ -1481,28 +1514,66 @@ udevAddOneDevice(struct udev_device *device)
 
 
 static int
-udevProcessDeviceListEntry(struct udev *udev,
-                           struct udev_list_entry *list_entry)
+udevAddOneDevice(struct udev_device *device)
 {
-    struct udev_device *device;
-    const char *name = NULL;
-    int ret = -1;
+    virNodeDeviceDefPtr def;
+
+    if (!(def = udevGetDeviceDef(device)))
+        return -1;
+
+    return udevAddOneDeviceDef(device, def);
+}
+
+
+typedef struct _udevEnumerateData udevEnumerateData;
+typedef udevEnumerateData *udevEnumerateDataPtr;
+struct _udevEnumerateData {
+    char **syspaths;
+    virNodeDeviceDefPtr *defs;
+    size_t ndevices;
+    int next; /* index of the next device to process, updated atomically */
+};
 
-    name = udev_list_entry_get_name(list_entry);
 
-    device = udev_device_new_from_syspath(udev, name);
+/* A libudev context and the objects created from it must not be used by
+ * several threads at once, so each worker looks the devices up in a
+ * context of its own. */
+static void
+udevEnumerateProcess(struct udev *udev,
+                     udevEnumerateDataPtr data)
+{
+    size_t i;
+
+    while ((i = g_atomic_int_add(&data->next, 1)) < data->ndevices) {
+        struct udev_device *device;
+
+        if (!(device = udev_device_new_from_syspath(udev, data->syspaths[i])))
+            continue;
 
-    if (device != NULL) {
-        if (udevAddOneDevice(device) != 0) {
+        if (!(data->defs[i] = udevGetDeviceDef(device))) {
             VIR_DEBUG("Failed to create node device for udev device '%s'",
-                      name);
+                      data->syspaths[i]);
+            virResetLastError();
         }
-        ret = 0;
+
+        udev_device_unref(device);
     }
+}
 
-    udev_device_unref(device);
 
-    return ret;
+static void
+udevEnumerateWorker(void *opaque)
+{
+    struct udev *udev;
+
+    if (!(udev = udev_new())) {
+        VIR_WARN("Failed to create udev context for enumerate worker");
+        return;
+    }
+
+    udevEnumerateProcess(udev, opaque);
+
+    udev_unref(udev);
 }
 
 
@@ -1530,11 +1601,22 @@ udevEnumerateAddMatches(struct udev_enumerate *udev_enumerate)
 }
 
 
+/* Gathering the details of a device involves plenty of sysfs reads,
+ * which are done for several devices in parallel, each worker thread
+ * using its own udev context.  The devices are then added one by one in
+ * the order udev listed them so that parents are added before their
+ * children. */
 static int
 udevEnumerateDevices(struct udev *udev)
 {
     struct udev_enumerate *udev_enumerate = NULL;
     struct udev_list_entry *list_entry = NULL;
+    udevEnumerateData data = { 0 };
+    g_autofree virThread *workers = NULL;
+    size_t nworkers = 0;
+    int ncpus;
+    size_t nthreads;
+    size_t i;
     int ret = -1;
 
     udev_enumerate = udev_enumerate_new(udev);
@@ -1546,12 +1628,71 @@ udevEnumerateDevices(struct udev *udev)
 
     udev_list_entry_foreach(list_entry,
                             udev_enumerate_get_list_entry(udev_enumerate)) {
+        data.ndevices++;
+    }
 
-        udevProcessDeviceListEntry(udev, list_entry);
+    data.syspaths = g_new0(char *, data.ndevices + 1);
+    data.defs = g_new0(virNodeDeviceDefPtr, data.ndevices);
+    data.ndevices = 0;
+
+    udev_list_entry_foreach(list_entry,
+                            udev_enumerate_get_list_entry(udev_enumerate)) {
+        const char *name = udev_list_entry_get_name(list_entry);
+
+        data.syspaths[data.ndevices++] = g_strdup(name);
+    }
+
+    if ((ncpus = virHostCPUGetCount()) < 1) {
+        virResetLastError();
+        ncpus = 1;
+    }
+    nthreads = MIN(ncpus, UDEV_ENUMERATE_MAX_WORKERS);
+    nthreads = MIN(nthreads, MAX(data.ndevices, 1));
+
+    /* The current thread is one of the workers too, using the context it
+     * was given, so this works even if no other thread could be created. */
+    workers = g_new0(virThread, nthreads);
+    for (i = 1; i < nthreads; i++) {
+        if (virThreadCreateFull(&workers[nworkers], true, udevEnumerateWorker,
+                                "udev-enumerate", false, &data) < 0) {
+            VIR_WARN("Failed to create udev enumerate worker: %s",
+                     g_strerror(errno));
+            break;
+        }
+        nworkers++;
+    }
+
+    udevEnumerateProcess(udev, &data);
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    VIR_DEBUG("Gathered details of %zu devices using %zu threads",
+              data.ndevices, nworkers + 1);
+
+    for (i = 0; i < data.ndevices; i++) {
+        struct udev_device *device;
+
+        if (!data.defs[i])
+            continue;
+
+        if (!(device = udev_device_new_from_syspath(udev, data.syspaths[i]))) {
+            virNodeDeviceDefFree(g_steal_pointer(&data.defs[i]));
+            continue;
+        }
+
+        if (udevAddOneDeviceDef(device, g_steal_pointer(&data.defs[i])) != 0) {
+            VIR_DEBUG("Failed to create node device for udev device '%s'",
+                      data.syspaths[i]);
+        }
+
+        udev_device_unref(device);
     }
 
     ret = 0;
  cleanup:
+    g_strfreev(data.syspaths);
+    g_free(data.defs);
     udev_enumerate_unref(udev_enumerate);
     return ret;
 }
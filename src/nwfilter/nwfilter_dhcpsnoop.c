@@ -71,12 +71,27 @@ VIR_LOG_INIT("nwfilter.nwfilter_dhcpsnoop");
 # define LEASEFILE LEASEFILE_DIR "nwfilter.leases"
 # define TMPLEASEFILE LEASEFILE_DIR "nwfilter.ltmp"
 
+/* how long lease file appends may stay unsynced, in milliseconds */
+# define LEASEFILE_SYNC_INTERVAL 500
+/* dead lease records tolerated before compaction regardless of nLeases */
+# define LEASEFILE_COMPACT_MIN 1024
+
 struct virNWFilterSnoopState {
     /* lease file */
     int                  leaseFD;
     int                  nLeases; /* number of active leases */
     int                  wLeases; /* number of written leases */
     int                  nThreads; /* number of running threads */
+    /* lease file journal; leaseLock nests inside snoopLock and req locks */
+    virMutex             leaseLock;  /* protects all fields below and leaseFD */
+    virCond              leaseCond;
+    virThread            leaseThread;
+    bool                 leaseThreadActive;
+    bool                 leaseQuit;
+    bool                 leaseDirty;      /* appends not yet synced */
+    bool                 leaseCompact;    /* compaction requested */
+    bool                 leaseCompacting; /* compaction in progress */
+    virBuffer            leasePending;    /* appends during compaction */
     /* thread management */
     virHashTablePtr      snoopReqs;
     virHashTablePtr      ifnameToKey;
@@ -101,6 +116,14 @@ struct virNWFilterSnoopState {
     do { \
         virMutexUnlock(&virNWFilterSnoopState.activeLock); \
     } while (0)
+# define virNWFilterSnoopLeaseLock() \
+    do { \
+        virMutexLock(&virNWFilterSnoopState.leaseLock); \
+    } while (0)
+# define virNWFilterSnoopLeaseUnlock() \
+    do { \
+        virMutexUnlock(&virNWFilterSnoopState.leaseLock); \
+    } while (0)
 
 # define VIR_IFKEY_LEN   ((VIR_UUID_STRING_BUFLEN) + (VIR_MAC_STRING_BUFLEN))
 
@@ -284,6 +307,7 @@ static void virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl);
 /* local variables */
 static struct virNWFilterSnoopState virNWFilterSnoopState = {
     .leaseFD = -1,
+    .leasePending = VIR_BUFFER_INITIALIZER,
 };
 
 static const unsigned char dhcp_magic[4] = { 99, 130, 83, 99 };
@@ -1675,12 +1699,18 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
     return -1;
 }
 
+/*
+ * Call this function with the LeaseLock held.
+ */
 static void
 virNWFilterSnoopLeaseFileClose(void)
 {
     VIR_FORCE_CLOSE(virNWFilterSnoopState.leaseFD);
 }
 
+/*
+ * Call this function with the LeaseLock held.
+ */
 static void
 virNWFilterSnoopLeaseFileOpen(void)
 {
@@ -1691,60 +1721,96 @@ virNWFilterSnoopLeaseFileOpen(void)
 }
 
 /*
- * Write a single lease to the given file.
+ * Format a single lease as a line of the lease file.
  *
  */
 static int
-virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
-                               virNWFilterSnoopIPLeasePtr ipl)
+virNWFilterSnoopLeaseFileFormat(virBufferPtr buf, const char *ifkey,
+                                virNWFilterSnoopIPLeasePtr ipl)
 {
-    g_autofree char *lbuf = NULL;
     g_autofree char *ipstr = virSocketAddrFormat(&ipl->ipAddress);
     g_autofree char *dhcpstr = virSocketAddrFormat(&ipl->ipServer);
-    int len;
 
     if (!dhcpstr || !ipstr)
         return -1;
 
     /* time intf ip dhcpserver */
-    lbuf = g_strdup_printf("%u %s %s %s\n", ipl->timeout, ifkey, ipstr, dhcpstr);
-    len = strlen(lbuf);
+    virBufferAsprintf(buf, "%u %s %s %s\n", ipl->timeout, ifkey, ipstr, dhcpstr);
+    return 0;
+}
+
+/*
+ * Write the content of a buffer to the given file.
+ */
+static int
+virNWFilterSnoopLeaseFileWrite(int lfd, virBufferPtr buf)
+{
+    size_t len = virBufferUse(buf);
+
+    if (len == 0)
+        return 0;
 
-    if (safewrite(lfd, lbuf, len) != len) {
+    if (safewrite(lfd, virBufferCurrentContent(buf), len) != len) {
         virReportSystemError(errno, "%s", _("lease file write failed"));
         return -1;
     }
 
-    ignore_value(g_fsync(lfd));
     return 0;
 }
 
 /*
  * Append a single lease to the end of the lease file.
- * To keep a limited number of dead leases, re-read the lease
- * file if the threshold of active leases versus written ones
- * exceeds a threshold.
+ *
+ * The append is not synced here; the lease file thread batches the
+ * fsync() of all appends done within LEASEFILE_SYNC_INTERVAL. To keep a
+ * limited number of dead leases, the lease file thread is asked to
+ * compact the file once the number of written leases exceeds a
+ * threshold relative to the active ones.
+ *
+ * This function only takes the LeaseLock, so it may be called with
+ * a req lock held.
  */
 static void
 virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl)
 {
     virNWFilterSnoopReqPtr req = ipl->snoopReq;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    int threshold;
 
-    virNWFilterSnoopLock();
+    if (virNWFilterSnoopLeaseFileFormat(&buf, req->ifkey, ipl) < 0)
+        return;
+
+    virNWFilterSnoopLeaseLock();
 
     if (virNWFilterSnoopState.leaseFD < 0)
         virNWFilterSnoopLeaseFileOpen();
     if (virNWFilterSnoopLeaseFileWrite(virNWFilterSnoopState.leaseFD,
-                                       req->ifkey, ipl) < 0)
-        goto error;
+                                       &buf) < 0)
+        goto cleanup;
+
+    /* the compacted file must not lose leases written meanwhile */
+    if (virNWFilterSnoopState.leaseCompacting)
+        virBufferAddBuffer(&virNWFilterSnoopState.leasePending, &buf);
+
+    virNWFilterSnoopState.leaseDirty = true;
 
     /* keep dead leases at < ~95% of file size */
-    if (g_atomic_int_add(&virNWFilterSnoopState.wLeases, 1) >=
-        g_atomic_int_get(&virNWFilterSnoopState.nLeases) * 20)
-        virNWFilterSnoopLeaseFileLoad();   /* load & refresh lease file */
+    threshold = MAX(g_atomic_int_get(&virNWFilterSnoopState.nLeases) * 20,
+                    LEASEFILE_COMPACT_MIN);
+    if (++virNWFilterSnoopState.wLeases >= threshold)
+        virNWFilterSnoopState.leaseCompact = true;
+
+    if (!virNWFilterSnoopState.leaseThreadActive) {
+        /* no lease file thread yet or anymore; sync right away */
+        ignore_value(g_fsync(virNWFilterSnoopState.leaseFD));
+        virNWFilterSnoopState.leaseDirty = false;
+    } else {
+        /* leaseCond is shared with waiters for a running compaction */
+        virCondBroadcast(&virNWFilterSnoopState.leaseCond);
+    }
 
- error:
-    virNWFilterSnoopUnlock();
+ cleanup:
+    virNWFilterSnoopLeaseUnlock();
 }
 
 /*
@@ -1779,7 +1845,7 @@ virNWFilterSnoopPruneIter(const void *payload,
 }
 
 /*
- * Iterator to write all leases of a single request to a file.
+ * Iterator to format all leases of a single request into a buffer.
  * Call this function with the SnoopLock held.
  */
 static int
@@ -1788,14 +1854,14 @@ virNWFilterSnoopSaveIter(void *payload,
                          void *data)
 {
     virNWFilterSnoopReqPtr req = payload;
-    int tfd = *(int *)data;
+    virBufferPtr buf = data;
     virNWFilterSnoopIPLeasePtr ipl;
 
     /* protect req->start */
     virNWFilterSnoopReqLock(req);
 
     for (ipl = req->start; ipl; ipl = ipl->next)
-        ignore_value(virNWFilterSnoopLeaseFileWrite(tfd, req->ifkey, ipl));
+        ignore_value(virNWFilterSnoopLeaseFileFormat(buf, req->ifkey, ipl));
 
     virNWFilterSnoopReqUnlock(req);
     return 0;
@@ -1804,16 +1870,46 @@ virNWFilterSnoopSaveIter(void *payload,
 /*
  * Write all valid leases into a temporary file and then
  * rename the file to the final file.
- * Call this function with the SnoopLock held.
+ *
+ * The SnoopLock is only held while taking a snapshot of the leases in
+ * memory; the file I/O happens outside of it. Leases saved while the
+ * temporary file is being written are collected in leasePending and
+ * appended to it before it replaces the lease file, so none of them
+ * get lost. Replaying such a lease twice on load is harmless.
  */
 static void
 virNWFilterSnoopLeaseFileRefresh(void)
 {
-    int tfd;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    int tfd = -1;
+
+    virNWFilterSnoopLock();
+
+    /* only one compaction at a time; the one in progress does not
+     * need the SnoopLock anymore */
+    virNWFilterSnoopLeaseLock();
+    while (virNWFilterSnoopState.leaseCompacting)
+        ignore_value(virCondWait(&virNWFilterSnoopState.leaseCond,
+                                 &virNWFilterSnoopState.leaseLock));
+    virNWFilterSnoopState.leaseCompacting = true;
+    virNWFilterSnoopState.leaseCompact = false;
+    virBufferFreeAndReset(&virNWFilterSnoopState.leasePending);
+    virNWFilterSnoopLeaseUnlock();
+
+    if (virNWFilterSnoopState.snoopReqs) {
+        /* clean up the requests */
+        virHashRemoveSet(virNWFilterSnoopState.snoopReqs,
+                         virNWFilterSnoopPruneIter, NULL);
+        /* now save them */
+        virHashForEach(virNWFilterSnoopState.snoopReqs,
+                       virNWFilterSnoopSaveIter, &buf);
+    }
+
+    virNWFilterSnoopUnlock();
 
     if (virFileMakePathWithMode(LEASEFILE_DIR, 0700) < 0) {
         virReportError(errno, _("mkdir(\"%s\")"), LEASEFILE_DIR);
-        return;
+        goto cleanup;
     }
 
     if (unlink(TMPLEASEFILE) < 0 && errno != ENOENT)
@@ -1823,35 +1919,98 @@ virNWFilterSnoopLeaseFileRefresh(void)
     tfd = open(TMPLEASEFILE, O_CREAT|O_RDWR|O_TRUNC|O_EXCL, 0644);
     if (tfd < 0) {
         virReportSystemError(errno, _("open(\"%s\")"), TMPLEASEFILE);
-        return;
-    }
-
-    if (virNWFilterSnoopState.snoopReqs) {
-        /* clean up the requests */
-        virHashRemoveSet(virNWFilterSnoopState.snoopReqs,
-                         virNWFilterSnoopPruneIter, NULL);
-        /* now save them */
-        virHashForEach(virNWFilterSnoopState.snoopReqs,
-                       virNWFilterSnoopSaveIter, (void *)&tfd);
-    }
-
-    if (VIR_CLOSE(tfd) < 0) {
-        virReportSystemError(errno, _("unable to close %s"), TMPLEASEFILE);
-        /* assuming the old lease file is still better, skip the renaming */
         goto cleanup;
     }
 
-    if (rename(TMPLEASEFILE, LEASEFILE) < 0) {
-        virReportSystemError(errno, _("rename(\"%s\", \"%s\")"),
-                             TMPLEASEFILE, LEASEFILE);
+    if (virNWFilterSnoopLeaseFileWrite(tfd, &buf) < 0) {
+        VIR_FORCE_CLOSE(tfd);
         unlink(TMPLEASEFILE);
     }
-    g_atomic_int_set(&virNWFilterSnoopState.wLeases, 0);
 
  cleanup:
+    virNWFilterSnoopLeaseLock();
+
+    if (tfd >= 0) {
+        if (virNWFilterSnoopLeaseFileWrite(tfd,
+                                           &virNWFilterSnoopState.leasePending) < 0 ||
+            g_fsync(tfd) < 0 || VIR_CLOSE(tfd) < 0) {
+            virReportSystemError(errno, _("unable to write %s"), TMPLEASEFILE);
+            /* assuming the old lease file is still better, skip the renaming */
+            VIR_FORCE_CLOSE(tfd);
+            unlink(TMPLEASEFILE);
+        } else if (rename(TMPLEASEFILE, LEASEFILE) < 0) {
+            virReportSystemError(errno, _("rename(\"%s\", \"%s\")"),
+                                 TMPLEASEFILE, LEASEFILE);
+            unlink(TMPLEASEFILE);
+        } else {
+            virNWFilterSnoopState.wLeases = 0;
+        }
+    }
+
+    virBufferFreeAndReset(&virNWFilterSnoopState.leasePending);
+    virNWFilterSnoopState.leaseCompacting = false;
+    virCondBroadcast(&virNWFilterSnoopState.leaseCond);
+
     virNWFilterSnoopLeaseFileOpen();
+
+    virNWFilterSnoopLeaseUnlock();
 }
 
+/*
+ * Lease file thread: batches the fsync() of lease file appends and
+ * compacts the lease file in the background when asked to.
+ */
+static void
+virNWFilterSnoopLeaseFileThread(void *opaque G_GNUC_UNUSED)
+{
+    unsigned long long deadline = 0;
+    unsigned long long now;
+    int fd;
+
+    virNWFilterSnoopLeaseLock();
+
+    while (true) {
+        if (virNWFilterSnoopState.leaseCompact &&
+            !virNWFilterSnoopState.leaseQuit) {
+            virNWFilterSnoopLeaseUnlock();
+            virNWFilterSnoopLeaseFileRefresh();
+            virNWFilterSnoopLeaseLock();
+            /* the compacted file was synced before renaming it */
+            continue;
+        }
+
+        if (virNWFilterSnoopState.leaseDirty) {
+            if (deadline == 0 && virTimeMillisNow(&now) == 0)
+                deadline = now + LEASEFILE_SYNC_INTERVAL;
+
+            if (!virNWFilterSnoopState.leaseQuit && deadline != 0 &&
+                virCondWaitUntil(&virNWFilterSnoopState.leaseCond,
+                                 &virNWFilterSnoopState.leaseLock,
+                                 deadline) == 0)
+                continue;
+
+            /* batch interval expired; fsync() without blocking appends */
+            virNWFilterSnoopState.leaseDirty = false;
+            deadline = 0;
+            fd = dup(virNWFilterSnoopState.leaseFD);
+            virNWFilterSnoopLeaseUnlock();
+            if (fd >= 0) {
+                ignore_value(g_fsync(fd));
+                VIR_FORCE_CLOSE(fd);
+            }
+            virNWFilterSnoopLeaseLock();
+            continue;
+        }
+
+        if (virNWFilterSnoopState.leaseQuit)
+            break;
+
+        ignore_value(virCondWait(&virNWFilterSnoopState.leaseCond,
+                                 &virNWFilterSnoopState.leaseLock));
+    }
+
+    virNWFilterSnoopLeaseUnlock();
+}
 
 static void
 virNWFilterSnoopLeaseFileLoad(void)
@@ -2002,7 +2161,9 @@ virNWFilterDHCPSnoopInit(void)
     VIR_DEBUG("Initializing DHCP snooping");
 
     if (virMutexInitRecursive(&virNWFilterSnoopState.snoopLock) < 0 ||
-        virMutexInit(&virNWFilterSnoopState.activeLock) < 0)
+        virMutexInit(&virNWFilterSnoopState.activeLock) < 0 ||
+        virMutexInit(&virNWFilterSnoopState.leaseLock) < 0 ||
+        virCondInit(&virNWFilterSnoopState.leaseCond) < 0)
         return -1;
 
     virNWFilterSnoopState.ifnameToKey = virHashNew(NULL);
@@ -2016,7 +2177,18 @@ virNWFilterDHCPSnoopInit(void)
         goto error;
 
     virNWFilterSnoopLeaseFileLoad();
-    virNWFilterSnoopLeaseFileOpen();
+
+    virNWFilterSnoopState.leaseQuit = false;
+    if (virThreadCreateFull(&virNWFilterSnoopState.leaseThread, true,
+                            virNWFilterSnoopLeaseFileThread,
+                            "dhcp-snoop-leases", false, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create lease file thread"));
+        goto error;
+    }
+    virNWFilterSnoopLeaseLock();
+    virNWFilterSnoopState.leaseThreadActive = true;
+    virNWFilterSnoopLeaseUnlock();
 
     return 0;
 
@@ -2085,7 +2257,9 @@ virNWFilterDHCPSnoopEnd(const char *ifname)
 
         virNWFilterSnoopReqPut(req);
     } else {                      /* free all of them */
+        virNWFilterSnoopLeaseLock();
         virNWFilterSnoopLeaseFileClose();
+        virNWFilterSnoopLeaseUnlock();
 
         virHashRemoveAll(virNWFilterSnoopState.ifnameToKey);
 
@@ -2102,12 +2276,27 @@ virNWFilterDHCPSnoopEnd(const char *ifname)
 void
 virNWFilterDHCPSnoopShutdown(void)
 {
+    bool joinLeaseThread;
+
     virNWFilterSnoopEndThreads();
     virNWFilterSnoopJoinThreads();
 
+    /* have the lease file thread sync outstanding appends and quit */
+    virNWFilterSnoopLeaseLock();
+    joinLeaseThread = virNWFilterSnoopState.leaseThreadActive;
+    virNWFilterSnoopState.leaseQuit = true;
+    virNWFilterSnoopState.leaseThreadActive = false;
+    virCondBroadcast(&virNWFilterSnoopState.leaseCond);
+    virNWFilterSnoopLeaseUnlock();
+
+    if (joinLeaseThread)
+        virThreadJoin(&virNWFilterSnoopState.leaseThread);
+
     virNWFilterSnoopLock();
 
+    virNWFilterSnoopLeaseLock();
     virNWFilterSnoopLeaseFileClose();
+    virNWFilterSnoopLeaseUnlock();
     virHashFree(virNWFilterSnoopState.ifnameToKey);
     virHashFree(virNWFilterSnoopState.snoopReqs);
 
@@ -55,6 +55,9 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <sys/utsname.h>
+#ifdef __linux__
+# include <sys/inotify.h>
+#endif
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -686,6 +689,9 @@ struct _virQEMUCaps {
     time_t libvirtCtime;
     time_t modDirMtime;
     bool invalidation;
+    /* value of watchChanges of the cache when the binary and the module
+     * directory were last checked, not stored in the cache file */
+    unsigned long long watchValidated;
 
     virBitmapPtr flags;
 
@@ -4145,6 +4151,13 @@ struct _virQEMUCapsCachePriv {
     /* cache whether /dev/kvm is usable as runUid:runGuid */
     virTristateBool kvmUsable;
     time_t kvmCtime;
+    unsigned long long kvmValidated;
+
+    /* inotify watch on the files checked by virQEMUCapsIsValid, -1 if
+     * inotify is not available; watchChanges is incremented whenever
+     * an event is seen */
+    int watchFd;
+    unsigned long long watchChanges;
 };
 typedef struct _virQEMUCapsCachePriv virQEMUCapsCachePriv;
 typedef virQEMUCapsCachePriv *virQEMUCapsCachePrivPtr;
@@ -4158,6 +4171,7 @@ virQEMUCapsCachePrivFree(void *privData)
     VIR_FREE(priv->libDir);
     VIR_FREE(priv->kernelVersion);
     VIR_FREE(priv->hostCPUSignature);
+    VIR_FORCE_CLOSE(priv->watchFd);
     VIR_FREE(priv);
 }
 
@@ -4851,6 +4865,123 @@ virQEMUCapsKVMSupportsNesting(void)
 }
 
 
+#ifdef __linux__
+# define QEMU_CAPS_WATCH_EVENTS \
+    (IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | \
+     IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+
+static void
+virQEMUCapsCacheWatchPath(virQEMUCapsCachePrivPtr priv,
+                          const char *path)
+{
+    if (priv->watchFd < 0)
+        return;
+
+    if (inotify_add_watch(priv->watchFd, path, QEMU_CAPS_WATCH_EVENTS) < 0) {
+        VIR_DEBUG("Unable to watch '%s' for changes: %s",
+                  path, g_strerror(errno));
+        VIR_FORCE_CLOSE(priv->watchFd);
+    }
+}
+#else /* !__linux__ */
+static void
+virQEMUCapsCacheWatchPath(virQEMUCapsCachePrivPtr priv G_GNUC_UNUSED,
+                          const char *path G_GNUC_UNUSED)
+{
+}
+#endif /* !__linux__ */
+
+
+/* Watch the directories containing @binary and its target if @binary
+ * is a symlink so that virQEMUCapsIsValid can see it was changed. */
+static void
+virQEMUCapsCacheWatchBinary(virQEMUCapsCachePrivPtr priv,
+                            const char *binary)
+{
+    g_autofree char *dir = NULL;
+    g_autofree char *target = NULL;
+    g_autofree char *targetDir = NULL;
+
+    if (priv->watchFd < 0)
+        return;
+
+    dir = g_path_get_dirname(binary);
+    virQEMUCapsCacheWatchPath(priv, dir);
+
+    /* virQEMUCapsIsValid will fail to stat a missing binary anyway */
+    if (virFileResolveAllLinks(binary, &target) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    targetDir = g_path_get_dirname(target);
+    if (STRNEQ(dir, targetDir))
+        virQEMUCapsCacheWatchPath(priv, targetDir);
+}
+
+
+static void
+virQEMUCapsCacheWatchInit(virQEMUCapsCachePrivPtr priv)
+{
+    g_autofree char *modParent = NULL;
+
+    priv->watchFd = -1;
+    priv->watchChanges = 1;
+
+#ifdef __linux__
+    if ((priv->watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        VIR_DEBUG("Unable to initialize inotify: %s", g_strerror(errno));
+        return;
+    }
+#endif
+
+    virQEMUCapsCacheWatchPath(priv, "/dev");
+
+    /* catch the module directory being created or removed as well,
+     * virQEMUCapsIsValid starts watching it once it exists */
+    modParent = g_path_get_dirname(QEMU_MODDIR);
+    virQEMUCapsCacheWatchPath(priv, modParent);
+
+    if (virFileExists(QEMU_MODDIR))
+        virQEMUCapsCacheWatchPath(priv, QEMU_MODDIR);
+}
+
+
+/* Consume all pending events, we are not interested in the details. */
+static void
+virQEMUCapsCacheWatchDrain(virQEMUCapsCachePrivPtr priv)
+{
+    char buf[4096];
+    ssize_t got;
+
+    while (priv->watchFd >= 0) {
+        if ((got = read(priv->watchFd, buf, sizeof(buf))) > 0) {
+            priv->watchChanges++;
+            continue;
+        }
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got == 0 || errno != EAGAIN) {
+            VIR_DEBUG("Failed to read inotify events, falling back to stat");
+            VIR_FORCE_CLOSE(priv->watchFd);
+        }
+        break;
+    }
+}
+
+
+/* Returns true if nothing watched changed since @validated was recorded. */
+static bool
+virQEMUCapsCacheWatchUnchanged(virQEMUCapsCachePrivPtr priv,
+                               unsigned long long validated)
+{
+    return priv->watchFd >= 0 && validated == priv->watchChanges;
+}
+
+
 /* Determine whether '/dev/kvm' is usable as QEMU user:QEMU group. */
 static bool
 virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
@@ -4862,6 +4993,11 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
     time_t kvm_ctime;
     time_t cached_kvm_ctime = priv->kvmCtime;
 
+    /* nothing in /dev changed since the last stat */
+    if (cached_value != VIR_TRISTATE_BOOL_ABSENT &&
+        virQEMUCapsCacheWatchUnchanged(priv, priv->kvmValidated))
+        return cached_value == VIR_TRISTATE_BOOL_YES;
+
     if (stat(kvm_device, &sb) < 0) {
         if (errno != ENOENT) {
             virReportSystemError(errno,
@@ -4877,6 +5013,8 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
         cached_value = VIR_TRISTATE_BOOL_ABSENT;
     }
 
+    priv->kvmValidated = priv->watchChanges;
+
     if (cached_value != VIR_TRISTATE_BOOL_ABSENT)
         return cached_value == VIR_TRISTATE_BOOL_YES;
 
@@ -4908,6 +5046,7 @@ virQEMUCapsIsValid(void *data,
     bool kvmUsable;
     struct stat sb;
     bool kvmSupportsNesting;
+    bool unchanged;
 
     if (!qemuCaps->invalidation)
         return true;
@@ -4915,7 +5054,21 @@ virQEMUCapsIsValid(void *data,
     if (!qemuCaps->binary)
         return true;
 
-    if (virFileExists(QEMU_MODDIR)) {
+    /* Neither the binary nor the module directory need to be checked
+     * again unless inotify reported a change since the last check. */
+    virQEMUCapsCacheWatchDrain(priv);
+    unchanged = virQEMUCapsCacheWatchUnchanged(priv, qemuCaps->watchValidated);
+
+    if (!unchanged)
+        virQEMUCapsCacheWatchBinary(priv, qemuCaps->binary);
+
+    if (!unchanged && virFileExists(QEMU_MODDIR)) {
+        /* The directory may have been (re)created since we started
+         * watching it. Adding a watch again is a no-op if it's already
+         * watched; on failure inotify is disabled and we keep relying
+         * on the mtime check below. */
+        virQEMUCapsCacheWatchPath(priv, QEMU_MODDIR);
+
         if (stat(QEMU_MODDIR, &sb) < 0) {
             VIR_DEBUG("Failed to stat QEMU module directory '%s': %s",
                       QEMU_MODDIR,
@@ -4944,19 +5097,23 @@ virQEMUCapsIsValid(void *data,
         return false;
     }
 
-    if (stat(qemuCaps->binary, &sb) < 0) {
-        VIR_DEBUG("Failed to stat QEMU binary '%s': %s",
-                  qemuCaps->binary,
-                  g_strerror(errno));
-        return false;
-    }
+    if (!unchanged) {
+        if (stat(qemuCaps->binary, &sb) < 0) {
+            VIR_DEBUG("Failed to stat QEMU binary '%s': %s",
+                      qemuCaps->binary,
+                      g_strerror(errno));
+            return false;
+        }
 
-    if (sb.st_ctime != qemuCaps->ctime) {
-        VIR_DEBUG("Outdated capabilities for '%s': QEMU binary changed "
-                  "(%lld vs %lld)",
-                  qemuCaps->binary,
-                  (long long)sb.st_ctime, (long long)qemuCaps->ctime);
-        return false;
+        if (sb.st_ctime != qemuCaps->ctime) {
+            VIR_DEBUG("Outdated capabilities for '%s': QEMU binary changed "
+                      "(%lld vs %lld)",
+                      qemuCaps->binary,
+                      (long long)sb.st_ctime, (long long)qemuCaps->ctime);
+            return false;
+        }
+
+        qemuCaps->watchValidated = priv->watchChanges;
     }
 
     if (!virQEMUCapsGuestIsNative(priv->hostArch, qemuCaps->arch)) {
@@ -5668,6 +5825,7 @@ virQEMUCapsCacheNew(const char *libDir,
         goto error;
 
     priv = g_new0(virQEMUCapsCachePriv, 1);
+    priv->watchFd = -1;
     virFileCacheSetPriv(cache, priv);
 
     priv->libDir = g_strdup(libDir);
@@ -5681,6 +5839,8 @@ virQEMUCapsCacheNew(const char *libDir,
     priv->runGid = runGid;
     priv->kvmUsable = VIR_TRISTATE_BOOL_ABSENT;
 
+    virQEMUCapsCacheWatchInit(priv);
+
     if (uname(&uts) == 0)
         priv->kernelVersion = g_strdup_printf("%s %s", uts.release, uts.version);
 
@@ -5711,6 +5871,53 @@ virQEMUCapsCacheLookup(virFileCachePtr cache,
 }
 
 
+/**
+ * virQEMUCapsCachePrefetch:
+ * @cache: QEMU capabilities cache
+ *
+ * Starts probing capabilities of the default emulators for all guest
+ * architectures in the background.  Probing a binary takes a while, so
+ * several binaries are probed in parallel rather than one by one when
+ * host capabilities are built.
+ */
+void
+virQEMUCapsCachePrefetch(virFileCachePtr cache)
+{
+    virQEMUCapsCachePrivPtr priv = virFileCacheGetPriv(cache);
+    VIR_AUTOSTRINGLIST binaries = NULL;
+    int ncpus;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        g_autofree char *binary = NULL;
+
+        if (!(binary = virQEMUCapsGetDefaultEmulator(priv->hostArch, i)) ||
+            !virFileIsExecutable(binary) ||
+            virStringListHasString((const char **) binaries, binary))
+            continue;
+
+        if (virStringListAdd(&binaries, binary) < 0)
+            return;
+    }
+
+    if (!binaries)
+        return;
+
+    if ((ncpus = virHostCPUGetCount()) < 1) {
+        virResetLastError();
+        ncpus = 1;
+    }
+
+    priv->microcodeVersion = virHostCPUGetMicrocodeVersion(priv->hostArch);
+
+    if (virFileCachePrefetch(cache, (const char *const *) binaries, ncpus) < 0) {
+        VIR_WARN("Failed to start probing QEMU capabilities: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+}
+
+
 virQEMUCapsPtr
 virQEMUCapsCacheLookupCopy(virFileCachePtr cache,
                            virDomainVirtType virtType,
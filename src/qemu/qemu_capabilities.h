@@ -708,6 +708,7 @@ virFileCachePtr virQEMUCapsCacheNew(const char *libDir,
                                     gid_t gid);
 virQEMUCapsPtr virQEMUCapsCacheLookup(virFileCachePtr cache,
                                       const char *binary);
+void virQEMUCapsCachePrefetch(virFileCachePtr cache);
 virQEMUCapsPtr virQEMUCapsCacheLookupCopy(virFileCachePtr cache,
                                           virDomainVirtType virtType,
                                           const char *binary,
@@ -25,6 +25,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#if defined WITH_MNTENT_H && defined WITH_GETMNTENT_R
+# include <mntent.h>
+#endif
 
 #include "virerror.h"
 #include "qemu_conf.h"
@@ -1373,12 +1376,131 @@ virCapsPtr virQEMUDriverCreateCapabilities(virQEMUDriverPtr driver)
 }
 
 
+#if defined WITH_MNTENT_H && defined WITH_GETMNTENT_R
+/* Appends the mount point and options of every resctrl mount, so that
+ * remounting with e.g. different cdp/mba_MBps options changes the
+ * host state even though /sys/fs/resctrl/info stays around. */
+static void
+virQEMUDriverFormatResctrlMounts(virBufferPtr buf)
+{
+    FILE *f;
+    struct mntent mb;
+    char mntbuf[1024];
+
+    if (!(f = setmntent("/proc/self/mounts", "r")))
+        return;
+
+    while (getmntent_r(f, &mb, mntbuf, sizeof(mntbuf))) {
+        if (STREQ(mb.mnt_type, "resctrl"))
+            virBufferAsprintf(buf, "resctrl-mount=%s %s\n",
+                              mb.mnt_dir, mb.mnt_opts);
+    }
+
+    endmntent(f);
+}
+
+#else /* defined WITH_MNTENT_H && defined WITH_GETMNTENT_R */
+
+static void
+virQEMUDriverFormatResctrlMounts(virBufferPtr buf G_GNUC_UNUSED)
+{
+}
+
+#endif /* defined WITH_MNTENT_H && defined WITH_GETMNTENT_R */
+
+
+/* Describes the state of the host parts of capabilities which may
+ * change at runtime and are expensive to gather, i.e., CPU cache banks
+ * of online CPUs and resctrl info and mount options.  Returns NULL if it
+ * can't be determined. */
+static char *
+virQEMUDriverGetHostState(void)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    const char *files[] = {
+        "/sys/devices/system/cpu/online",
+        "/sys/devices/system/node/online",
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(files); i++) {
+        g_autofree char *content = NULL;
+
+        if (virFileReadAllQuiet(files[i], 1024, &content) < 0)
+            return NULL;
+
+        virBufferAsprintf(&buf, "%s\n", content);
+    }
+
+    virBufferAsprintf(&buf, "resctrl=%d\n",
+                      virFileExists("/sys/fs/resctrl/info"));
+    virQEMUDriverFormatResctrlMounts(&buf);
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static void
+virQEMUDriverGuestCapsFree(virQEMUCapsPtr *guests)
+{
+    size_t i;
+
+    if (!guests)
+        return;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++)
+        virObjectUnref(guests[i]);
+    g_free(guests);
+}
+
+
+/* Looks up QEMU capabilities of the default emulator for each guest
+ * arch the same way virQEMUCapsInit does.  The cache only returns
+ * a different object if the emulator changed. */
+static virQEMUCapsPtr *
+virQEMUDriverGetGuestCaps(virQEMUDriverPtr driver)
+{
+    virQEMUCapsPtr *guests = g_new0(virQEMUCapsPtr, VIR_ARCH_LAST);
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        g_autofree char *binary = NULL;
+
+        if (!(binary = virQEMUCapsGetDefaultEmulator(driver->hostarch, i)))
+            continue;
+
+        if (!(guests[i] = virQEMUCapsCacheLookup(driver->qemuCapsCache, binary)))
+            virResetLastError();
+    }
+
+    return guests;
+}
+
+
+static bool
+virQEMUDriverCapabilitiesUnchanged(virQEMUDriverPtr driver,
+                                   const char *hostState,
+                                   virQEMUCapsPtr *guests)
+{
+    if (!driver->caps || driver->caps->nguests == 0 ||
+        !hostState || !driver->capsHostState || !driver->capsGuests)
+        return false;
+
+    if (STRNEQ(hostState, driver->capsHostState))
+        return false;
+
+    return memcmp(guests, driver->capsGuests,
+                  sizeof(*guests) * VIR_ARCH_LAST) == 0;
+}
+
+
 /**
  * virQEMUDriverGetCapabilities:
  *
  * Get a reference to the virCapsPtr instance for the
  * driver. If @refresh is true, the capabilities will be
- * rebuilt first
+ * rebuilt first unless neither the host nor any of the QEMU
+ * binaries changed since they were built last time.
  *
  * The caller must release the reference with virObjetUnref
  *
@@ -1390,12 +1512,32 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
     virCapsPtr ret = NULL;
     if (refresh) {
         virCapsPtr caps = NULL;
-        if ((caps = virQEMUDriverCreateCapabilities(driver)) == NULL)
+        g_autofree char *hostState = virQEMUDriverGetHostState();
+        virQEMUCapsPtr *guests = virQEMUDriverGetGuestCaps(driver);
+
+        qemuDriverLock(driver);
+        if (virQEMUDriverCapabilitiesUnchanged(driver, hostState, guests)) {
+            VIR_DEBUG("Host and QEMU binaries unchanged, reusing capabilities");
+            ret = virObjectRef(driver->caps);
+            qemuDriverUnlock(driver);
+            virQEMUDriverGuestCapsFree(guests);
+            return ret;
+        }
+        qemuDriverUnlock(driver);
+
+        if ((caps = virQEMUDriverCreateCapabilities(driver)) == NULL) {
+            virQEMUDriverGuestCapsFree(guests);
             return NULL;
+        }
 
         qemuDriverLock(driver);
         virObjectUnref(driver->caps);
         driver->caps = caps;
+        VIR_FREE(driver->capsXML);
+        g_free(driver->capsHostState);
+        driver->capsHostState = g_steal_pointer(&hostState);
+        virQEMUDriverGuestCapsFree(driver->capsGuests);
+        driver->capsGuests = guests;
     } else {
         qemuDriverLock(driver);
 
@@ -1414,6 +1556,59 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
 }
 
 
+/**
+ * virQEMUDriverGetCapabilitiesXML:
+ *
+ * Refresh the capabilities of the driver if needed and format
+ * them.  The XML is cached together with the capabilities.
+ *
+ * Returns: the formatted capabilities XML or NULL on error
+ */
+char *virQEMUDriverGetCapabilitiesXML(virQEMUDriverPtr driver)
+{
+    g_autoptr(virCaps) caps = NULL;
+    char *xml = NULL;
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, true)))
+        return NULL;
+
+    qemuDriverLock(driver);
+    if (caps == driver->caps && driver->capsXML)
+        xml = g_strdup(driver->capsXML);
+    qemuDriverUnlock(driver);
+
+    if (xml)
+        return xml;
+
+    if (!(xml = virCapabilitiesFormatXML(caps)))
+        return NULL;
+
+    qemuDriverLock(driver);
+    if (caps == driver->caps && !driver->capsXML)
+        driver->capsXML = g_strdup(xml);
+    qemuDriverUnlock(driver);
+
+    return xml;
+}
+
+
+/**
+ * virQEMUDriverFreeCapabilities:
+ *
+ * Release the capabilities of the driver and everything cached
+ * along with them.
+ */
+void virQEMUDriverFreeCapabilities(virQEMUDriverPtr driver)
+{
+    virObjectUnref(driver->caps);
+    driver->caps = NULL;
+    VIR_FREE(driver->capsXML);
+    VIR_FREE(driver->capsHostState);
+    virQEMUDriverGuestCapsFree(driver->capsGuests);
+    driver->capsGuests = NULL;
+}
+
+
 /**
  * virQEMUDriverGetDomainCapabilities:
  *
@@ -268,6 +268,14 @@ struct _virQEMUDriver {
      */
     virCapsPtr caps;
 
+    /* Require lock, describe what @caps was built from so that it is
+     * only rebuilt when something changed, see
+     * virQEMUDriverGetCapabilities */
+    char *capsHostState;
+    virQEMUCapsPtr *capsGuests;
+    /* Require lock, formatted @caps or NULL */
+    char *capsXML;
+
     /* Lazy initialized on first use, immutable thereafter.
      * Require lock to get the pointer & do optional initialization
      */
@@ -340,6 +348,8 @@ virCPUDefPtr virQEMUDriverGetHostCPU(virQEMUDriverPtr driver);
 virCapsPtr virQEMUDriverCreateCapabilities(virQEMUDriverPtr driver);
 virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
                                         bool refresh);
+char *virQEMUDriverGetCapabilitiesXML(virQEMUDriverPtr driver);
+void virQEMUDriverFreeCapabilities(virQEMUDriverPtr driver);
 
 virDomainCapsPtr
 virQEMUDriverGetDomainCapabilities(virQEMUDriverPtr driver,
@@ -10574,6 +10574,123 @@ qemuProcessEventFree(struct qemuProcessEvent *event)
 }
 
 
+/**
+ * qemuProcessEventSubmit:
+ * @driver: qemu driver data
+ * @event: event to process
+ *
+ * Queues @event to be processed by the driver's worker pool.  Events of
+ * a single domain are processed one by one in the order they were
+ * submitted, while events of different domains are processed in
+ * parallel.  To achieve this the worker pool is given domains rather
+ * than events and a domain is queued in the pool only while it has
+ * some events to process.
+ *
+ * The caller must hold the lock of @event->vm.  On success @event is
+ * owned by the domain's event queue.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuProcessEventSubmit(virQEMUDriverPtr driver,
+                       struct qemuProcessEvent *event)
+{
+    virDomainObjPtr vm = event->vm;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (!priv->eventsScheduled) {
+        if (virThreadPoolSendJob(driver->workerPool, 0, virObjectRef(vm)) < 0) {
+            virObjectUnref(vm);
+            return -1;
+        }
+        priv->eventsScheduled = true;
+    }
+
+    event->queued = g_get_monotonic_time();
+    event->next = NULL;
+
+    if (priv->eventsTail)
+        priv->eventsTail->next = event;
+    else
+        priv->eventsHead = event;
+    priv->eventsTail = event;
+    priv->nevents++;
+
+    VIR_DEBUG("Queued event %d for domain %s, queue depth %zu",
+              event->eventType, vm->def->name, priv->nevents);
+
+    return 0;
+}
+
+
+/**
+ * qemuProcessEventNext:
+ * @vm: domain object, must be locked
+ *
+ * Removes the oldest event from the event queue of @vm.
+ *
+ * Returns the event or NULL if there's none.
+ */
+struct qemuProcessEvent *
+qemuProcessEventNext(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    struct qemuProcessEvent *event = priv->eventsHead;
+
+    if (!event)
+        return NULL;
+
+    if (!(priv->eventsHead = event->next))
+        priv->eventsTail = NULL;
+    event->next = NULL;
+    priv->nevents--;
+
+    VIR_DEBUG("Processing event %d for domain %s after %llu us, "
+              "queue depth %zu",
+              event->eventType, vm->def->name,
+              (unsigned long long) g_get_monotonic_time() - event->queued,
+              priv->nevents);
+
+    return event;
+}
+
+
+/**
+ * qemuProcessEventDone:
+ * @driver: qemu driver data
+ * @vm: domain object, must be locked
+ *
+ * To be called by the worker pool after processing an event of @vm.  If
+ * more events were queued in the meantime, the domain is queued in the
+ * worker pool again, behind the domains which are already waiting.
+ */
+void
+qemuProcessEventDone(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    struct qemuProcessEvent *event;
+
+    if (!priv->eventsHead) {
+        priv->eventsScheduled = false;
+        return;
+    }
+
+    if (virThreadPoolSendJob(driver->workerPool, 0, virObjectRef(vm)) == 0)
+        return;
+
+    VIR_WARN("Dropping %zu events of domain %s: %s",
+             priv->nevents, vm->def->name, virGetLastErrorMessage());
+    virObjectUnref(vm);
+
+    while ((event = qemuProcessEventNext(vm))) {
+        virObjectUnref(event->vm);
+        qemuProcessEventFree(event);
+    }
+    priv->eventsScheduled = false;
+}
+
+
 char *
 qemuDomainGetManagedPRSocketPath(qemuDomainObjPrivatePtr priv)
 {
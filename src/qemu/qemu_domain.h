@@ -257,6 +257,13 @@ struct _qemuDomainObjPrivate {
     /* running backup job */
     virDomainBackupDefPtr backup;
 
+    /* Events waiting to be processed by the driver's worker pool in
+     * the order they were submitted, see qemuProcessEventSubmit. */
+    struct qemuProcessEvent *eventsHead;
+    struct qemuProcessEvent *eventsTail;
+    size_t nevents;
+    bool eventsScheduled; /* the domain is queued in the worker pool */
+
     bool dbusDaemonRunning;
 
     /* list of Ids to migrate */
@@ -451,10 +458,19 @@ struct qemuProcessEvent {
     int action;
     int status;
     void *data;
+
+    unsigned long long queued; /* monotonic time of qemuProcessEventSubmit */
+    struct qemuProcessEvent *next;
 };
 
 void qemuProcessEventFree(struct qemuProcessEvent *event);
 
+int qemuProcessEventSubmit(virQEMUDriverPtr driver,
+                           struct qemuProcessEvent *event);
+struct qemuProcessEvent *qemuProcessEventNext(virDomainObjPtr vm);
+void qemuProcessEventDone(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm);
+
 #define QEMU_TYPE_DOMAIN_LOG_CONTEXT qemu_domain_log_context_get_type()
 G_DECLARE_FINAL_TYPE(qemuDomainLogContext, qemu_domain_log_context, QEMU, DOMAIN_LOG_CONTEXT, GObject);
 typedef qemuDomainLogContext *qemuDomainLogContextPtr;
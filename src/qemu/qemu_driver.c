@@ -133,6 +133,9 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 #define QEMU_GUEST_VCPU_MAX_ID 4096
 
+/* Maximum number of domains whose monitor events are processed at once */
+#define QEMU_EVENT_WORKERS 16
+
 #define QEMU_NB_BLKIO_PARAM  6
 
 #define QEMU_NB_BANDWIDTH_PARAM 7
@@ -887,6 +890,10 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->qemuCapsCache)
         goto error;
 
+    /* Probing QEMU binaries is slow, start doing so while we're
+     * initializing the rest of the driver and loading domains */
+    virQEMUCapsCachePrefetch(qemu_driver->qemuCapsCache);
+
     if (!(sec_managers = qemuSecurityGetNested(qemu_driver->securityManager)))
         goto error;
 
@@ -975,7 +982,8 @@ qemuStateInitialize(bool privileged,
     /* must be initialized before trying to reconnect to all the
      * running domains since there might occur some QEMU monitor
      * events that will be dispatched to the worker pool */
-    qemu_driver->workerPool = virThreadPoolNewFull(0, 1, 0, qemuProcessEventHandler,
+    qemu_driver->workerPool = virThreadPoolNewFull(0, QEMU_EVENT_WORKERS, 0,
+                                                   qemuProcessEventHandler,
                                                    "qemu-event", qemu_driver);
     if (!qemu_driver->workerPool)
         goto error;
@@ -1144,7 +1152,7 @@ qemuStateCleanup(void)
     virObjectUnref(qemu_driver->xmlopt);
     virCPUDefFree(qemu_driver->hostcpu);
     virCapabilitiesHostNUMAUnref(qemu_driver->hostnuma);
-    virObjectUnref(qemu_driver->caps);
+    virQEMUDriverFreeCapabilities(qemu_driver);
     ebtablesContextFree(qemu_driver->ebtables);
     VIR_FREE(qemu_driver->qemuImgBinary);
     virObjectUnref(qemu_driver->domains);
@@ -1333,15 +1341,11 @@ qemuConnectGetMaxVcpus(virConnectPtr conn G_GNUC_UNUSED, const char *type)
 
 static char *qemuConnectGetCapabilities(virConnectPtr conn) {
     virQEMUDriverPtr driver = conn->privateData;
-    g_autoptr(virCaps) caps = NULL;
 
     if (virConnectGetCapabilitiesEnsureACL(conn) < 0)
         return NULL;
 
-    if (!(caps = virQEMUDriverGetCapabilities(driver, true)))
-        return NULL;
-
-    return virCapabilitiesFormatXML(caps);
+    return virQEMUDriverGetCapabilitiesXML(driver);
 }
 
 
@@ -4294,14 +4298,17 @@ processGuestCrashloadedEvent(virQEMUDriverPtr driver,
 
 static void qemuProcessEventHandler(void *data, void *opaque)
 {
-    struct qemuProcessEvent *processEvent = data;
-    virDomainObjPtr vm = processEvent->vm;
+    virDomainObjPtr vm = data;
+    struct qemuProcessEvent *processEvent;
     virQEMUDriverPtr driver = opaque;
 
-    VIR_DEBUG("vm=%p, event=%d", vm, processEvent->eventType);
-
     virObjectLock(vm);
 
+    if (!(processEvent = qemuProcessEventNext(vm)))
+        goto cleanup;
+
+    VIR_DEBUG("vm=%p, event=%d", vm, processEvent->eventType);
+
     switch (processEvent->eventType) {
     case QEMU_PROCESS_EVENT_WATCHDOG:
         processWatchdogEvent(driver, vm, processEvent->action);
@@ -4345,8 +4352,12 @@ static void qemuProcessEventHandler(void *data, void *opaque)
         break;
     }
 
-    virDomainObjEndAPI(&vm);
+    virObjectUnref(processEvent->vm);
     qemuProcessEventFree(processEvent);
+
+ cleanup:
+    qemuProcessEventDone(driver, vm);
+    virDomainObjEndAPI(&vm);
 }
 
 
@@ -17617,9 +17628,19 @@ qemuConnectGetDomainCapabilities(virConnectPtr conn,
 }
 
 
+/* Data gathered once per qemuConnectGetAllDomainStats() call and
+ * shared by all the domains. */
+typedef struct _qemuDomainGetStatsData qemuDomainGetStatsData;
+typedef qemuDomainGetStatsData *qemuDomainGetStatsDataPtr;
+struct _qemuDomainGetStatsData {
+    virNetDevTapStatsPtr netstats; /* may be NULL */
+};
+
+
 static int
 qemuDomainGetStatsState(virQEMUDriverPtr driver G_GNUC_UNUSED,
                         virDomainObjPtr dom,
+                        qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                         virTypedParamListPtr params,
                         unsigned int privflags G_GNUC_UNUSED)
 {
@@ -17948,6 +17969,7 @@ qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
 static int
 qemuDomainGetStatsCpu(virQEMUDriverPtr driver,
                       virDomainObjPtr dom,
+                      qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                       virTypedParamListPtr params,
                       unsigned int privflags G_GNUC_UNUSED)
 {
@@ -17964,6 +17986,7 @@ qemuDomainGetStatsCpu(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsMemory(virQEMUDriverPtr driver,
                          virDomainObjPtr dom,
+                         qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                          virTypedParamListPtr params,
                          unsigned int privflags G_GNUC_UNUSED)
 
@@ -17975,6 +17998,7 @@ qemuDomainGetStatsMemory(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
+                          qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                           virTypedParamListPtr params,
                           unsigned int privflags)
 {
@@ -18033,6 +18057,7 @@ qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
                        virDomainObjPtr dom,
+                       qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                        virTypedParamListPtr params,
                        unsigned int privflags)
 {
@@ -18116,6 +18141,7 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsInterface(virQEMUDriverPtr driver G_GNUC_UNUSED,
                             virDomainObjPtr dom,
+                            qemuDomainGetStatsDataPtr data,
                             virTypedParamListPtr params,
                             unsigned int privflags G_GNUC_UNUSED)
 {
@@ -18149,8 +18175,8 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver G_GNUC_UNUSED,
                 continue;
             }
         } else {
-            if (virNetDevTapInterfaceStats(net->ifname, &tmp,
-                                           !virDomainNetTypeSharesHostView(net)) < 0) {
+            if (virNetDevTapStatsLookup(data->netstats, net->ifname, &tmp,
+                                        !virDomainNetTypeSharesHostView(net)) < 0) {
                 virResetLastError();
                 continue;
             }
@@ -18457,6 +18483,7 @@ qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
 static int
 qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
                         virDomainObjPtr dom,
+                        qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                         virTypedParamListPtr params,
                         unsigned int privflags)
 {
@@ -18532,6 +18559,7 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
                            virDomainObjPtr dom,
+                           qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                            virTypedParamListPtr params,
                            unsigned int privflags)
 {
@@ -18608,6 +18636,7 @@ qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
 static int
 qemuDomainGetStatsPerf(virQEMUDriverPtr driver G_GNUC_UNUSED,
                        virDomainObjPtr dom,
+                       qemuDomainGetStatsDataPtr data G_GNUC_UNUSED,
                        virTypedParamListPtr params,
                        unsigned int privflags G_GNUC_UNUSED)
 {
@@ -18628,6 +18657,7 @@ qemuDomainGetStatsPerf(virQEMUDriverPtr driver G_GNUC_UNUSED,
 typedef int
 (*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
+                          qemuDomainGetStatsDataPtr data,
                           virTypedParamListPtr list,
                           unsigned int flags);
 
@@ -18696,6 +18726,7 @@ qemuDomainGetStatsNeedMonitor(unsigned int stats)
 static int
 qemuDomainGetStats(virConnectPtr conn,
                    virDomainObjPtr dom,
+                   qemuDomainGetStatsDataPtr data,
                    unsigned int stats,
                    virDomainStatsRecordPtr *record,
                    unsigned int flags)
@@ -18708,8 +18739,8 @@ qemuDomainGetStats(virConnectPtr conn,
 
     for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
         if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params,
-                                                  flags) < 0)
+            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, data,
+                                                  params, flags) < 0)
                 return -1;
         }
     }
@@ -18740,6 +18771,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virDomainObjPtr vm;
     size_t nvms;
     virDomainStatsRecordPtr *tmpstats = NULL;
+    qemuDomainGetStatsData data = { 0 };
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
     int nstats = 0;
     size_t i;
@@ -18780,6 +18812,16 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     if (qemuDomainGetStatsNeedMonitor(stats))
         privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
+    /* Fetch statistics of all host interfaces at once instead of
+     * once for every interface of every domain. If that fails the
+     * interfaces are queried one by one. */
+    if (stats & VIR_DOMAIN_STATS_INTERFACE && nvms > 0 &&
+        !(data.netstats = virNetDevTapStatsNew())) {
+        VIR_DEBUG("Unable to take interface stats snapshot: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     for (i = 0; i < nvms; i++) {
         virDomainStatsRecordPtr tmp = NULL;
         domflags = 0;
@@ -18802,7 +18844,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 
         if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
             domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
+        if (qemuDomainGetStats(conn, vm, &data, stats, &tmp, domflags) < 0) {
             if (HAVE_JOB(domflags) && vm)
                 qemuDomainObjEndJob(driver, vm);
 
@@ -18828,6 +18870,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virErrorPreserveLast(&orig_err);
     virDomainStatsRecordListFree(tmpstats);
     virObjectListFreeCount(vms, nvms);
+    virNetDevTapStatsFree(data.netstats);
     virErrorRestore(&orig_err);
 
     return ret;
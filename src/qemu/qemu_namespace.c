@@ -604,9 +604,16 @@ qemuDomainSetupLaunchSecurity(virDomainObjPtr vm,
 }
 
 
+typedef enum {
+    QEMU_NAMESPACE_OP_MKNOD,
+    QEMU_NAMESPACE_OP_UNLINK,
+} qemuNamespaceOpType;
+
+
 static int
-qemuNamespaceMknodPaths(virDomainObjPtr vm,
-                        const char **paths);
+qemuNamespaceProcessPaths(virDomainObjPtr vm,
+                          qemuNamespaceOpType type,
+                          const char **paths);
 
 
 int
@@ -653,7 +660,8 @@ qemuDomainBuildNamespace(virQEMUDriverConfigPtr cfg,
     if (qemuDomainSetupLaunchSecurity(vm, &paths) < 0)
         return -1;
 
-    if (qemuNamespaceMknodPaths(vm, (const char **) paths) < 0)
+    if (qemuNamespaceProcessPaths(vm, QEMU_NAMESPACE_OP_MKNOD,
+                                  (const char **) paths) < 0)
         return -1;
 
     return 0;
@@ -872,6 +880,7 @@ struct _qemuNamespaceMknodItem {
     char *file;
     char *target;
     bool bindmounted;
+    bool remove; /* unlink @file instead of creating it */
     GStatBuf sb;
     void *acl;
     char *tcon;
@@ -1049,6 +1058,20 @@ qemuNamespaceMknodOne(qemuNamespaceMknodItemPtr data)
 }
 
 
+static int
+qemuNamespaceUnlinkOne(qemuNamespaceMknodItemPtr data)
+{
+    VIR_DEBUG("Unlinking %s", data->file);
+    if (unlink(data->file) < 0 && errno != ENOENT) {
+        virReportSystemError(errno,
+                             _("Unable to remove device %s"), data->file);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static bool
 qemuNamespaceMknodItemNeedsBindMount(mode_t st_mode)
 {
@@ -1071,8 +1094,15 @@ qemuNamespaceMknodHelper(pid_t pid G_GNUC_UNUSED,
     qemuSecurityPostFork(data->driver->securityManager);
 
     for (i = 0; i < data->nitems; i++) {
-        if (qemuNamespaceMknodOne(&data->items[i]) < 0)
-            goto cleanup;
+        qemuNamespaceMknodItemPtr item = &data->items[i];
+
+        if (item->remove) {
+            if (qemuNamespaceUnlinkOne(item) < 0)
+                goto cleanup;
+        } else {
+            if (qemuNamespaceMknodOne(item) < 0)
+                goto cleanup;
+        }
     }
 
     ret = 0;
@@ -1158,6 +1188,37 @@ qemuNamespaceMknodItemInit(qemuNamespaceMknodItemPtr item,
 }
 
 
+/**
+ * qemuNamespacePathIsPrivate:
+ * @file: path to check
+ * @devMountsPath: list of preserved mount points
+ * @ndevMountsPath: length of @devMountsPath
+ *
+ * Returns true if @file lives in the domain's private /dev, that is
+ * it is under /dev but not under any other mount point preserved from
+ * the host.
+ */
+static bool
+qemuNamespacePathIsPrivate(const char *file,
+                           char * const *devMountsPath,
+                           size_t ndevMountsPath)
+{
+    size_t i;
+
+    if (!STRPREFIX(file, QEMU_DEVPREFIX))
+        return false;
+
+    for (i = 0; i < ndevMountsPath; i++) {
+        if (STREQ(devMountsPath[i], "/dev"))
+            continue;
+        if (STRPREFIX(file, devMountsPath[i]))
+            return false;
+    }
+
+    return true;
+}
+
+
 static int
 qemuNamespacePrepareOneItem(qemuNamespaceMknodDataPtr data,
                             virQEMUDriverConfigPtr cfg,
@@ -1168,12 +1229,11 @@ qemuNamespacePrepareOneItem(qemuNamespaceMknodDataPtr data,
 {
     long ttl = sysconf(_SC_SYMLOOP_MAX);
     g_autofree char *next = g_strdup(file);
-    size_t i;
 
     while (1) {
         g_auto(qemuNamespaceMknodItem) item = { 0 };
         bool isLink;
-        bool addToData = false;
+        bool addToData;
         int rc;
 
         rc = qemuNamespaceMknodItemInit(&item, cfg, vm, next);
@@ -1186,18 +1246,8 @@ qemuNamespacePrepareOneItem(qemuNamespaceMknodDataPtr data,
         }
 
         isLink = S_ISLNK(item.sb.st_mode);
-
-        if (STRPREFIX(next, QEMU_DEVPREFIX)) {
-            for (i = 0; i < ndevMountsPath; i++) {
-                if (STREQ(devMountsPath[i], "/dev"))
-                    continue;
-                if (STRPREFIX(next, devMountsPath[i]))
-                    break;
-            }
-
-            if (i == ndevMountsPath)
-                addToData = true;
-        }
+        addToData = qemuNamespacePathIsPrivate(next, devMountsPath,
+                                               ndevMountsPath);
 
         g_free(next);
         next = g_strdup(item.target);
@@ -1222,21 +1272,51 @@ qemuNamespacePrepareOneItem(qemuNamespaceMknodDataPtr data,
 
 
 static int
-qemuNamespaceMknodPaths(virDomainObjPtr vm,
-                        const char **paths)
+qemuNamespacePrepareUnlinkItem(qemuNamespaceMknodDataPtr data,
+                               const char *file,
+                               char * const *devMountsPath,
+                               size_t ndevMountsPath)
+{
+    g_auto(qemuNamespaceMknodItem) item = { 0 };
+
+    if (!qemuNamespacePathIsPrivate(file, devMountsPath, ndevMountsPath))
+        return 0;
+
+    item.file = g_strdup(file);
+    item.remove = true;
+
+    return VIR_APPEND_ELEMENT(data->items, data->nitems, item);
+}
+
+
+/**
+ * qemuNamespaceProcessPaths:
+ * @vm: domain object
+ * @type: operation to perform
+ * @paths: NULL terminated list of paths
+ *
+ * Creates or removes @paths in the mount namespace of @vm. A single
+ * helper process is forked for all of them, and none at all if none
+ * of @paths is in the private /dev.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise.
+ */
+static int
+qemuNamespaceProcessPaths(virDomainObjPtr vm,
+                          qemuNamespaceOpType type,
+                          const char **paths)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virQEMUDriverPtr driver = priv->driver;
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
     char **devMountsPath = NULL;
     size_t ndevMountsPath = 0;
-    size_t npaths = 0;
     qemuNamespaceMknodData data = { 0 };
     size_t i;
     int ret = -1;
 
-    npaths = virStringListLength(paths);
-    if (npaths == 0)
+    if (!paths || !paths[0])
         return 0;
 
     cfg = virQEMUDriverGetConfig(driver);
@@ -1248,12 +1328,29 @@ qemuNamespaceMknodPaths(virDomainObjPtr vm,
     data.driver = driver;
     data.vm = vm;
 
-    for (i = 0; i < npaths; i++) {
-        if (qemuNamespacePrepareOneItem(&data, cfg, vm, paths[i],
-                                        devMountsPath, ndevMountsPath) < 0)
+    for (i = 0; paths[i]; i++) {
+        int rc = -1;
+
+        switch (type) {
+        case QEMU_NAMESPACE_OP_MKNOD:
+            rc = qemuNamespacePrepareOneItem(&data, cfg, vm, paths[i],
+                                             devMountsPath, ndevMountsPath);
+            break;
+        case QEMU_NAMESPACE_OP_UNLINK:
+            rc = qemuNamespacePrepareUnlinkItem(&data, paths[i],
+                                                devMountsPath, ndevMountsPath);
+            break;
+        }
+
+        if (rc < 0)
             goto cleanup;
     }
 
+    if (data.nitems == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
     for (i = 0; i < data.nitems; i++) {
         qemuNamespaceMknodItemPtr item = &data.items[i];
         if (item->target &&
@@ -1293,8 +1390,9 @@ qemuNamespaceMknodPaths(virDomainObjPtr vm,
 
 
 static int
-qemuNamespaceMknodPaths(virDomainObjPtr vm G_GNUC_UNUSED,
-                        const char **paths G_GNUC_UNUSED)
+qemuNamespaceProcessPaths(virDomainObjPtr vm G_GNUC_UNUSED,
+                          qemuNamespaceOpType type G_GNUC_UNUSED,
+                          const char **paths G_GNUC_UNUSED)
 {
     virReportSystemError(ENOSYS, "%s",
                          _("Namespaces are not supported on this platform."));
@@ -1306,25 +1404,10 @@ qemuNamespaceMknodPaths(virDomainObjPtr vm G_GNUC_UNUSED,
 
 
 static int
-qemuNamespaceUnlinkHelper(pid_t pid G_GNUC_UNUSED,
-                          void *opaque)
+qemuNamespaceMknodPaths(virDomainObjPtr vm,
+                        const char **paths)
 {
-    char **paths = opaque;
-    size_t i;
-
-    for (i = 0; paths[i]; i++) {
-        const char *path = paths[i];
-
-        VIR_DEBUG("Unlinking %s", path);
-        if (unlink(path) < 0 && errno != ENOENT) {
-            virReportSystemError(errno,
-                                 _("Unable to remove device %s"), path);
-            return -1;
-        }
-    }
-
-    g_strfreev(paths);
-    return 0;
+    return qemuNamespaceProcessPaths(vm, QEMU_NAMESPACE_OP_MKNOD, paths);
 }
 
 
@@ -1332,54 +1415,7 @@ static int
 qemuNamespaceUnlinkPaths(virDomainObjPtr vm,
                          const char **paths)
 {
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverPtr driver = priv->driver;
-    g_autoptr(virQEMUDriverConfig) cfg = NULL;
-    VIR_AUTOSTRINGLIST unlinkPaths = NULL;
-    char **devMountsPath = NULL;
-    size_t ndevMountsPath = 0;
-    size_t npaths;
-    size_t i;
-    int ret = -1;
-
-    npaths = virStringListLength(paths);
-    if (!npaths)
-        return 0;
-
-    cfg = virQEMUDriverGetConfig(driver);
-
-    if (qemuDomainGetPreservedMounts(cfg, vm,
-                                     &devMountsPath, NULL,
-                                     &ndevMountsPath) < 0)
-        goto cleanup;
-
-    for (i = 0; i < npaths; i++) {
-        const char *file = paths[i];
-
-        if (STRPREFIX(file, QEMU_DEVPREFIX)) {
-            for (i = 0; i < ndevMountsPath; i++) {
-                if (STREQ(devMountsPath[i], "/dev"))
-                    continue;
-                if (STRPREFIX(file, devMountsPath[i]))
-                    break;
-            }
-
-            if (i == ndevMountsPath &&
-                virStringListAdd(&unlinkPaths, file) < 0)
-                return -1;
-        }
-    }
-
-    if (unlinkPaths &&
-        virProcessRunInMountNamespace(vm->pid,
-                                      qemuNamespaceUnlinkHelper,
-                                      unlinkPaths) < 0)
-        return -1;
-
-    ret = 0;
- cleanup:
-    virStringListFreeCount(devMountsPath, ndevMountsPath);
-    return ret;
+    return qemuNamespaceProcessPaths(vm, QEMU_NAMESPACE_OP_UNLINK, paths);
 }
 
 
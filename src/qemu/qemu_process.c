@@ -307,7 +307,7 @@ qemuProcessHandleMonitorEOF(qemuMonitorPtr mon,
     processEvent->eventType = QEMU_PROCESS_EVENT_MONITOR_EOF;
     processEvent->vm = virObjectRef(vm);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         virObjectUnref(vm);
         qemuProcessEventFree(processEvent);
         goto cleanup;
@@ -839,7 +839,7 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon G_GNUC_UNUSED,
          * deleted before handling watchdog event is finished.
          */
         processEvent->vm = virObjectRef(vm);
-        if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+        if (qemuProcessEventSubmit(driver, processEvent) < 0) {
             virObjectUnref(vm);
             qemuProcessEventFree(processEvent);
         }
@@ -972,7 +972,7 @@ qemuProcessHandleBlockJob(qemuMonitorPtr mon G_GNUC_UNUSED,
         processEvent->action = type;
         processEvent->status = status;
 
-        if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+        if (qemuProcessEventSubmit(driver, processEvent) < 0) {
             virObjectUnref(vm);
             goto cleanup;
         }
@@ -1033,7 +1033,7 @@ qemuProcessHandleJobStatusChange(qemuMonitorPtr mon G_GNUC_UNUSED,
         processEvent->vm = virObjectRef(vm);
         processEvent->data = virObjectRef(job);
 
-        if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+        if (qemuProcessEventSubmit(driver, processEvent) < 0) {
             virObjectUnref(vm);
             goto cleanup;
         }
@@ -1332,7 +1332,7 @@ qemuProcessHandleGuestPanic(qemuMonitorPtr mon G_GNUC_UNUSED,
      */
     processEvent->vm = virObjectRef(vm);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         virObjectUnref(vm);
         qemuProcessEventFree(processEvent);
     }
@@ -1369,7 +1369,7 @@ qemuProcessHandleDeviceDeleted(qemuMonitorPtr mon G_GNUC_UNUSED,
     processEvent->data = data;
     processEvent->vm = virObjectRef(vm);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         virObjectUnref(vm);
         goto error;
     }
@@ -1549,7 +1549,7 @@ qemuProcessHandleNicRxFilterChanged(qemuMonitorPtr mon G_GNUC_UNUSED,
     processEvent->data = data;
     processEvent->vm = virObjectRef(vm);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         virObjectUnref(vm);
         goto error;
     }
@@ -1587,7 +1587,7 @@ qemuProcessHandleSerialChanged(qemuMonitorPtr mon G_GNUC_UNUSED,
     processEvent->action = connected;
     processEvent->vm = virObjectRef(vm);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         virObjectUnref(vm);
         goto error;
     }
@@ -1793,7 +1793,7 @@ qemuProcessHandlePRManagerStatusChanged(qemuMonitorPtr mon G_GNUC_UNUSED,
     processEvent->eventType = QEMU_PROCESS_EVENT_PR_DISCONNECT;
     processEvent->vm = virObjectRef(vm);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         qemuProcessEventFree(processEvent);
         virObjectUnref(vm);
         goto cleanup;
@@ -1839,7 +1839,7 @@ qemuProcessHandleRdmaGidStatusChanged(qemuMonitorPtr mon G_GNUC_UNUSED,
     processEvent->vm = virObjectRef(vm);
     processEvent->data = g_steal_pointer(&info);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         qemuProcessEventFree(processEvent);
         virObjectUnref(vm);
         goto cleanup;
@@ -1867,7 +1867,7 @@ qemuProcessHandleGuestCrashloaded(qemuMonitorPtr mon G_GNUC_UNUSED,
     processEvent->eventType = QEMU_PROCESS_EVENT_GUEST_CRASHLOADED;
     processEvent->vm = virObjectRef(vm);
 
-    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+    if (qemuProcessEventSubmit(driver, processEvent) < 0) {
         virObjectUnref(vm);
         qemuProcessEventFree(processEvent);
     }
@@ -2838,7 +2838,8 @@ qemuProcessResctrlCreate(virQEMUDriverPtr driver,
     if (!vm->def->nresctrls)
         return 0;
 
-    /* Force capability refresh since resctrl info can change
+    /* Refresh capabilities since resctrl info can change, this is cheap
+     * unless it actually changed
      * XXX: move cache info into virresctrl so caps are not needed */
     caps = virQEMUDriverGetCapabilities(driver, true);
     if (!caps)
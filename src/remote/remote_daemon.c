@@ -1247,5 +1247,8 @@ int main(int argc, char **argv) {
     VIR_FREE(remote_config_file);
     daemonConfigFree(config);
 
+    /* Don't lose messages still queued by asynchronous logging */
+    virLogFlush();
+
     return ret;
 }
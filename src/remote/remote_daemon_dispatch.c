@@ -6756,19 +6756,161 @@ remoteDispatchNetworkGetDHCPLeases(virNetServerPtr server G_GNUC_UNUSED,
 }
 
 
+typedef struct _remoteDomainStatsRecords remoteDomainStatsRecords;
+struct _remoteDomainStatsRecords {
+    virDomainStatsRecordPtr *records;
+    u_int nrecords;
+};
+
+
+/*
+ * Encodes @data in the wire format of
+ * remote_connect_get_all_domain_stats_ret. Filling in that structure
+ * would need a copy of the name and string value of every single
+ * parameter, which are freed right after encoding. Here the XDR
+ * structures are built on stack one at a time, pointing to the
+ * original data, and encoded right away.
+ *
+ * @data must have been checked by remoteCheckDomainStatsRecords().
+ */
+static bool_t
+remoteEncodeDomainStatsRecords(XDR *xdrs,
+                               remoteDomainStatsRecords *data)
+{
+    size_t i;
+    size_t j;
+
+    if (xdrs->x_op != XDR_ENCODE)
+        return FALSE;
+
+    if (!xdr_u_int(xdrs, &data->nrecords))
+        return FALSE;
+
+    for (i = 0; i < data->nrecords; i++) {
+        virDomainStatsRecordPtr record = data->records[i];
+        remote_nonnull_domain dom = {
+            .name = record->dom->name,
+            .id = record->dom->id,
+        };
+        u_int nparams = 0;
+
+        memcpy(dom.uuid, record->dom->uuid, VIR_UUID_BUFLEN);
+
+        if (!xdr_remote_nonnull_domain(xdrs, &dom))
+            return FALSE;
+
+        /* skip unset parameters of sparse arrays */
+        for (j = 0; j < record->nparams; j++) {
+            if (record->params[j].type)
+                nparams++;
+        }
+
+        if (!xdr_u_int(xdrs, &nparams))
+            return FALSE;
+
+        for (j = 0; j < record->nparams; j++) {
+            virTypedParameterPtr param = record->params + j;
+            remote_typed_param val = {
+                .field = param->field,
+                .value.type = param->type,
+            };
+
+            switch (param->type) {
+            case 0:
+                continue;
+            case VIR_TYPED_PARAM_INT:
+                val.value.remote_typed_param_value_u.i = param->value.i;
+                break;
+            case VIR_TYPED_PARAM_UINT:
+                val.value.remote_typed_param_value_u.ui = param->value.ui;
+                break;
+            case VIR_TYPED_PARAM_LLONG:
+                val.value.remote_typed_param_value_u.l = param->value.l;
+                break;
+            case VIR_TYPED_PARAM_ULLONG:
+                val.value.remote_typed_param_value_u.ul = param->value.ul;
+                break;
+            case VIR_TYPED_PARAM_DOUBLE:
+                val.value.remote_typed_param_value_u.d = param->value.d;
+                break;
+            case VIR_TYPED_PARAM_BOOLEAN:
+                val.value.remote_typed_param_value_u.b = param->value.b;
+                break;
+            case VIR_TYPED_PARAM_STRING:
+                val.value.remote_typed_param_value_u.s = param->value.s;
+                break;
+            default:
+                return FALSE;
+            }
+
+            if (!xdr_remote_typed_param(xdrs, &val))
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/* Report the errors remoteEncodeDomainStatsRecords() can't */
+static int
+remoteCheckDomainStatsRecords(remoteDomainStatsRecords *data)
+{
+    size_t i;
+    size_t j;
+
+    if (data->nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of domain stats records is %d, "
+                         "which exceeds max limit: %d"),
+                       data->nrecords, REMOTE_DOMAIN_LIST_MAX);
+        return -1;
+    }
+
+    for (i = 0; i < data->nrecords; i++) {
+        virDomainStatsRecordPtr record = data->records[i];
+
+        if (record->nparams > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+            virReportError(VIR_ERR_RPC,
+                           _("too many parameters '%d' for limit '%d'"),
+                           record->nparams,
+                           REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+            return -1;
+        }
+
+        for (j = 0; j < record->nparams; j++) {
+            int type = record->params[j].type;
+
+            if (type < 0 || type > VIR_TYPED_PARAM_STRING) {
+                virReportError(VIR_ERR_RPC,
+                               _("unknown parameter type: %d"), type);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * The reply is encoded straight into @msg by
+ * remoteEncodeDomainStatsRecords() and @ret is left unused.
+ */
 static int
 remoteDispatchConnectGetAllDomainStats(virNetServerPtr server G_GNUC_UNUSED,
                                        virNetServerClientPtr client,
-                                       virNetMessagePtr msg G_GNUC_UNUSED,
+                                       virNetMessagePtr msg,
                                        virNetMessageErrorPtr rerr,
                                        remote_connect_get_all_domain_stats_args *args,
-                                       remote_connect_get_all_domain_stats_ret *ret)
+                                       remote_connect_get_all_domain_stats_ret *ret G_GNUC_UNUSED)
 {
     int rv = -1;
     size_t i;
     virDomainStatsRecordPtr *retStats = NULL;
     int nrecords = 0;
     virDomainPtr *doms = NULL;
+    remoteDomainStatsRecords data = { 0 };
     virConnectPtr conn = remoteGetHypervisorConn(client);
 
     if (!conn)
@@ -6795,44 +6937,26 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server G_GNUC_UNUSED,
             goto cleanup;
     }
 
-    if (nrecords) {
-        if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Number of domain stats records is %d, "
-                             "which exceeds max limit: %d"),
-                           nrecords, REMOTE_DOMAIN_LIST_MAX);
-            goto cleanup;
-        }
+    data.records = retStats;
+    data.nrecords = nrecords;
 
-        ret->retStats.retStats_val = g_new0(remote_domain_stats_record, nrecords);
-        ret->retStats.retStats_len = nrecords;
-
-        for (i = 0; i < nrecords; i++) {
-            remote_domain_stats_record *dst = ret->retStats.retStats_val + i;
+    if (remoteCheckDomainStatsRecords(&data) < 0)
+        goto cleanup;
 
-            make_nonnull_domain(&dst->dom, retStats[i]->dom);
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.status = VIR_NET_OK;
 
-            if (virTypedParamsSerialize(retStats[i]->params,
-                                        retStats[i]->nparams,
-                                        REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
-                                        (virTypedParameterRemotePtr *) &dst->params.params_val,
-                                        &dst->params.params_len,
-                                        VIR_TYPED_PARAM_STRING_OKAY) < 0)
-                goto cleanup;
-        }
-    } else {
-        ret->retStats.retStats_len = 0;
-        ret->retStats.retStats_val = NULL;
-    }
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg,
+                                   (xdrproc_t) remoteEncodeDomainStatsRecords,
+                                   &data) < 0)
+        goto cleanup;
 
-    rv = 0;
+    rv = 2;
 
  cleanup:
-    if (rv < 0) {
+    if (rv < 0)
         virNetMessageSaveError(rerr);
-        xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_ret,
-                 (char *) ret);
-    }
 
     virDomainStatsRecordListFree(retStats);
     virObjectListFree(doms);
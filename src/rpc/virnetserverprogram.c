@@ -451,6 +451,14 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     if (rv < 0)
         goto error;
 
+    /*
+     * If rv == 2, the dispatch func has already encoded the
+     * whole reply, header included, into 'msg' and 'ret' is
+     * unused.
+     */
+    if (rv == 2)
+        return virNetServerClientSendMessage(client, msg);
+
     /* Return header. We're re-using same message object, so
      * only need to tweak type/status fields */
     /*msg->header.prog = msg->header.prog;*/
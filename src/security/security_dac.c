@@ -90,6 +90,7 @@ struct _virSecurityDACChownList {
     virSecurityDACChownItemPtr *items;
     size_t nItems;
     bool lock;
+    bool parallel; /* Whether threads may be used to apply the items */
 };
 
 
@@ -200,6 +201,59 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
                                                   const virStorageSource *src,
                                                   const char *path,
                                                   bool recall);
+
+
+/* Items can be processed concurrently only if they are all distinct
+ * local files. Others are handled by the storage driver callback. */
+static bool
+virSecurityDACTransactionIsParallel(void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    g_autofree const char **paths = NULL;
+    size_t i;
+
+    if (!list->parallel)
+        return false;
+
+    paths = g_new0(const char *, list->nItems);
+
+    for (i = 0; i < list->nItems; i++) {
+        virSecurityDACChownItemPtr item = list->items[i];
+
+        if (item->src && !virStorageSourceIsLocalStorage(item->src))
+            return false;
+
+        paths[i] = item->path;
+    }
+
+    return virSecurityPathsAreDistinct(paths, list->nItems);
+}
+
+
+static int
+virSecurityDACTransactionRunItem(size_t idx,
+                                 void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    virSecurityDACChownItemPtr item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid,
+                                          remember);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path,
+                                                  remember);
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -221,6 +275,7 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    g_autofree bool *done = NULL;
     size_t i;
     int rv = 0;
     int ret = -1;
@@ -241,45 +296,26 @@ virSecurityDACTransactionRun(pid_t pid G_GNUC_UNUSED,
 
         for (i = 0; i < list->nItems; i++) {
             virSecurityDACChownItemPtr item = list->items[i];
-            size_t j;
-
-            for (j = 0; j < state->nfds; j++) {
-                if (STREQ_NULLABLE(item->path, state->paths[j]))
-                    break;
-            }
 
             /* If path wasn't locked, don't try to remember its label. */
-            if (j == state->nfds)
+            if (!virSecurityManagerMetadataLockStateHasPath(state, item->path))
                 item->remember = false;
         }
     }
 
-    for (i = 0; i < list->nItems; i++) {
-        virSecurityDACChownItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
+    done = g_new0(bool, list->nItems);
+    rv = virSecurityRunParallel(list->nItems,
+                                virSecurityDACTransactionIsParallel,
+                                virSecurityDACTransactionRunItem,
+                                list, done);
 
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid,
-                                            remember);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path,
-                                                        remember);
-        }
-
-        if (rv < 0)
-            break;
-    }
-
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecurityDACChownItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        if (!done[i - 1])
+            continue;
+
         if (!item->restore) {
             virSecurityDACRestoreFileLabelInternal(list->manager,
                                                    item->src,
@@ -650,10 +686,15 @@ virSecurityDACTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     }
 
     if (pid == -1) {
-        if (lock)
+        if (lock) {
             rc = virProcessRunInFork(virSecurityDACTransactionRun, list);
-        else
+        } else {
+            /* Threads are created only here, in the daemon itself. A
+             * child forked from a multithreaded process shouldn't do
+             * more than necessary before it exits. */
+            list->parallel = true;
             rc = virSecurityDACTransactionRun(pid, list);
+        }
     }
 
     if (rc < 0)
@@ -772,6 +813,7 @@ virSecurityDACSetOwnership(virSecurityManagerPtr mgr,
     virSecurityDACDataPtr priv = virSecurityManagerGetPrivateData(mgr);
     virErrorPtr origerr;
     struct stat sb;
+    bool haveStat = false;
     int refcount;
     int rc;
 
@@ -793,6 +835,7 @@ virSecurityDACSetOwnership(virSecurityManagerPtr mgr,
             virReportSystemError(errno, _("unable to stat: %s"), path);
             return -1;
         }
+        haveStat = true;
 
         refcount = virSecurityDACRememberLabel(priv, path, sb.st_uid, sb.st_gid);
         if (refcount == -2) {
@@ -815,6 +858,15 @@ virSecurityDACSetOwnership(virSecurityManagerPtr mgr,
         }
     }
 
+    /* The owner was fetched just above, don't stat the file again only
+     * to find out there's nothing to change. */
+    if (haveStat && !(src && priv->chownCallback) &&
+        sb.st_uid == uid && sb.st_gid == gid) {
+        VIR_DEBUG("DAC user and group on '%s' already set to '%ld:%ld'",
+                  path, (long)uid, (long)gid);
+        return 0;
+    }
+
     VIR_INFO("Setting DAC user and group on '%s' to '%ld:%ld'",
              NULLSTR(src ? src->path : path), (long)uid, (long)gid);
 
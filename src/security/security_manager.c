@@ -1298,24 +1298,87 @@ virSecurityManagerRestoreTPMLabels(virSecurityManagerPtr mgr,
 }
 
 
+#define METADATA_OFFSET 1
+#define METADATA_LEN 1
+
+/* How long to wait for a metadata lock held by somebody else, and the
+ * bounds of the exponential backoff between attempts. */
+#define METADATA_LOCK_TIMEOUT (10 * G_USEC_PER_SEC)
+#define METADATA_LOCK_BACKOFF_MIN 100
+#define METADATA_LOCK_BACKOFF_MAX (10 * 1000)
+
+typedef struct _virSecurityManagerMetadataLockItem virSecurityManagerMetadataLockItem;
+struct _virSecurityManagerMetadataLockItem {
+    const char *path;
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+    bool locked;
+};
+
+
 static int
-cmpstringp(const void *p1, const void *p2)
+virSecurityManagerMetadataLockItemCmp(const void *p1,
+                                      const void *p2)
 {
-    const char *s1 = *(char * const *) p1;
-    const char *s2 = *(char * const *) p2;
+    const virSecurityManagerMetadataLockItem *a = p1;
+    const virSecurityManagerMetadataLockItem *b = p2;
 
-    if (!s1 && !s2)
-        return 0;
+    return strcmp(a->path, b->path);
+}
+
+
+/**
+ * virSecurityManagerMetadataLockFD:
+ * @fd: FD to lock
+ * @path: path @fd was opened from
+ * @waited: incremented by the time spent waiting, in microseconds
+ *
+ * Acquire the metadata lock on @fd, waiting with an exponential backoff
+ * for up to METADATA_LOCK_TIMEOUT if another process holds it.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+virSecurityManagerMetadataLockFD(int fd,
+                                 const char *path,
+                                 long long *waited)
+{
+    gint64 start = 0;
+    gulong backoff = METADATA_LOCK_BACKOFF_MIN;
+
+    while (virFileLock(fd, false, METADATA_OFFSET, METADATA_LEN, false) < 0) {
+        gint64 now;
+
+        if (errno != EACCES && errno != EAGAIN) {
+            virReportSystemError(errno,
+                                 _("unable to lock %s for metadata change"),
+                                 path);
+            return -1;
+        }
 
-    if (!s1 || !s2)
-        return s2 ? -1 : 1;
+        now = g_get_monotonic_time();
+        if (!start)
+            start = now;
 
-    /* from man 3 qsort */
-    return strcmp(s1, s2);
+        if (now - start >= METADATA_LOCK_TIMEOUT) {
+            virReportSystemError(errno,
+                                 _("unable to lock %s for metadata change"),
+                                 path);
+            return -1;
+        }
+
+        /* File is locked. Try again. */
+        g_usleep(backoff);
+        backoff = MIN(backoff * 2, METADATA_LOCK_BACKOFF_MAX);
+    }
+
+    if (start)
+        *waited += g_get_monotonic_time() - start;
+
+    return 0;
 }
 
-#define METADATA_OFFSET 1
-#define METADATA_LEN 1
 
 /**
  * virSecurityManagerMetadataLock:
@@ -1327,6 +1390,10 @@ cmpstringp(const void *p1, const void *p2)
  * should be passed to virSecurityManagerMetadataUnlock.
  * Passed @paths must not be freed until the corresponding unlock call.
  *
+ * Paths referring to the same file are locked only once, which is
+ * reflected in virSecurityManagerMetadataLockStateHasPath() for each
+ * of them.
+ *
  * NOTE: this function is not thread safe (because of usage of
  * POSIX locks).
  *
@@ -1338,47 +1405,30 @@ virSecurityManagerMetadataLock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
                                const char **paths,
                                size_t npaths)
 {
+    g_autoptr(virHashTable) seen = virHashNew(NULL);
+    g_autoptr(virHashTable) locked = virHashNew(NULL);
+    g_autoptr(virHashTable) files = virHashNew(NULL);
+    g_autofree virSecurityManagerMetadataLockItem *items = NULL;
+    size_t nitems = 0;
     size_t i = 0;
     size_t nfds = 0;
+    size_t ncontended = 0;
+    long long waited = 0;
     int *fds = NULL;
     const char **locked_paths = NULL;
     virSecurityManagerMetadataLockStatePtr ret = NULL;
 
-    fds = g_new0(int, npaths);
-    locked_paths = g_new0(const char *, npaths);
-
-    /* Sort paths to lock in order to avoid deadlocks with other
-     * processes. For instance, if one process wants to lock
-     * paths A B and there's another that is trying to lock them
-     * in reversed order a deadlock might occur.  But if we sort
-     * the paths alphabetically then both processes will try lock
-     * paths in the same order and thus no deadlock can occur.
-     * Lastly, it makes searching for duplicate paths below
-     * simpler. */
-    qsort(paths, npaths, sizeof(*paths), cmpstringp);
+    items = g_new0(virSecurityManagerMetadataLockItem, npaths);
 
     for (i = 0; i < npaths; i++) {
         const char *p = paths[i];
         struct stat sb;
-        size_t j;
-        int retries = 10 * 1000;
-        int fd;
 
-        if (!p)
+        if (!p || virHashLookup(seen, p))
             continue;
 
-        /* If there's a duplicate path on the list, skip it over.
-         * Not only we would fail open()-ing it the second time,
-         * we would deadlock with ourselves trying to lock it the
-         * second time. After all, we've locked it when iterating
-         * over it the first time. */
-        for (j = 0; j < i; j++) {
-            if (STREQ_NULLABLE(p, paths[j]))
-                break;
-        }
-
-        if (i != j)
-            continue;
+        if (virHashAddEntry(seen, p, (void *) p) < 0)
+            return NULL;
 
         if (stat(p, &sb) < 0)
             continue;
@@ -1389,6 +1439,50 @@ virSecurityManagerMetadataLock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
             continue;
         }
 
+        items[nitems].path = p;
+        items[nitems].dev = sb.st_dev;
+        items[nitems].ino = sb.st_ino;
+        items[nitems].mode = sb.st_mode;
+        nitems++;
+    }
+
+    /* Sort paths to lock in order to avoid deadlocks with other
+     * processes. For instance, if one process wants to lock
+     * paths A B and there's another that is trying to lock them
+     * in reversed order a deadlock might occur.  But if we sort
+     * the paths alphabetically then both processes will try lock
+     * paths in the same order and thus no deadlock can occur.
+     * This is the order older daemons lock in, so keep it even
+     * though files are identified by their device and inode. */
+    qsort(items, nitems, sizeof(*items), virSecurityManagerMetadataLockItemCmp);
+
+    fds = g_new0(int, nitems);
+    locked_paths = g_new0(const char *, nitems);
+
+    for (i = 0; i < nitems; i++) {
+        const char *p = items[i].path;
+        g_autofree char *file = NULL;
+        size_t first;
+        long long fdWaited = 0;
+        int fd;
+
+        file = g_strdup_printf("%llu:%llu",
+                               (unsigned long long) items[i].dev,
+                               (unsigned long long) items[i].ino);
+
+        /* Another path to a file we've already seen. Don't lock it
+         * again, POSIX locks are per process so the second lock would
+         * succeed, but closing its FD would release both. */
+        if ((first = GPOINTER_TO_SIZE(virHashLookup(files, file))) > 0) {
+            if (items[first - 1].locked &&
+                virHashAddEntry(locked, p, (void *) p) < 0)
+                goto cleanup;
+            continue;
+        }
+
+        if (virHashAddEntry(files, file, GSIZE_TO_POINTER(i + 1)) < 0)
+            goto cleanup;
+
         if ((fd = open(p, O_RDWR)) < 0) {
             if (errno == EROFS) {
                 /* There is nothing we can do for RO filesystem. */
@@ -1396,7 +1490,7 @@ virSecurityManagerMetadataLock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
             }
 
 #ifndef WIN32
-            if (S_ISSOCK(sb.st_mode)) {
+            if (S_ISSOCK(items[i].mode)) {
                 /* Sockets can be opened only if there exists the
                  * other side that listens. */
                 continue;
@@ -1414,28 +1508,29 @@ virSecurityManagerMetadataLock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
             goto cleanup;
         }
 
-        do {
-            if (virFileLock(fd, false,
-                            METADATA_OFFSET, METADATA_LEN, false) < 0) {
-                if (retries && (errno == EACCES || errno == EAGAIN)) {
-                    /* File is locked. Try again. */
-                    retries--;
-                    g_usleep(1000);
-                    continue;
-                } else {
-                    virReportSystemError(errno,
-                                         _("unable to lock %s for metadata change"),
-                                         p);
-                    VIR_FORCE_CLOSE(fd);
-                    goto cleanup;
-                }
-            }
+        if (virSecurityManagerMetadataLockFD(fd, p, &fdWaited) < 0) {
+            VIR_FORCE_CLOSE(fd);
+            goto cleanup;
+        }
+
+        if (fdWaited > 0) {
+            ncontended++;
+            waited += fdWaited;
+        }
 
-            break;
-        } while (1);
+        if (virHashAddEntry(locked, p, (void *) p) < 0) {
+            VIR_FORCE_CLOSE(fd);
+            goto cleanup;
+        }
 
         locked_paths[nfds] = p;
         VIR_APPEND_ELEMENT_COPY_INPLACE(fds, nfds, fd);
+        items[i].locked = true;
+    }
+
+    if (ncontended > 0) {
+        VIR_DEBUG("Waited %lld us for %zu contended metadata locks out of %zu",
+                  waited, ncontended, nfds);
     }
 
     ret = g_new0(virSecurityManagerMetadataLockState, 1);
@@ -1443,6 +1538,7 @@ virSecurityManagerMetadataLock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     ret->paths = g_steal_pointer(&locked_paths);
     ret->fds = g_steal_pointer(&fds);
     ret->nfds = nfds;
+    ret->locked = g_steal_pointer(&locked);
     nfds = 0;
 
  cleanup:
@@ -1454,6 +1550,21 @@ virSecurityManagerMetadataLock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
 }
 
 
+/**
+ * virSecurityManagerMetadataLockStateHasPath:
+ * @state: state returned by virSecurityManagerMetadataLock
+ * @path: path to look up
+ *
+ * Returns true if the file referred to by @path was locked.
+ */
+bool
+virSecurityManagerMetadataLockStateHasPath(virSecurityManagerMetadataLockStatePtr state,
+                                           const char *path)
+{
+    return path && virHashLookup(state->locked, path);
+}
+
+
 void
 virSecurityManagerMetadataUnlock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
                                  virSecurityManagerMetadataLockStatePtr *state)
@@ -1482,5 +1593,6 @@ virSecurityManagerMetadataUnlock(virSecurityManagerPtr mgr G_GNUC_UNUSED,
 
     VIR_FREE((*state)->fds);
     VIR_FREE((*state)->paths);
+    virHashFree((*state)->locked);
     VIR_FREE(*state);
 }
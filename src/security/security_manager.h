@@ -220,6 +220,7 @@ struct _virSecurityManagerMetadataLockState {
     size_t nfds; /* Captures size of both @fds and @paths */
     int *fds;
     const char **paths;
+    virHashTablePtr locked; /* All paths to locked files */
 };
 
 
@@ -228,6 +229,10 @@ virSecurityManagerMetadataLock(virSecurityManagerPtr mgr,
                                const char **paths,
                                size_t npaths);
 
+bool
+virSecurityManagerMetadataLockStateHasPath(virSecurityManagerMetadataLockStatePtr state,
+                                           const char *path);
+
 void
 virSecurityManagerMetadataUnlock(virSecurityManagerPtr mgr,
                                  virSecurityManagerMetadataLockStatePtr *state);
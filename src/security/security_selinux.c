@@ -88,6 +88,7 @@ struct _virSecuritySELinuxContextList {
     virSecuritySELinuxContextItemPtr *items;
     size_t nItems;
     bool lock;
+    bool parallel; /* Whether threads may be used to apply the items */
 };
 
 #define SECURITY_SELINUX_VOID_DOI       "0"
@@ -232,6 +233,48 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
                                               bool recall);
 
 
+/* Items can be processed concurrently only if they are all distinct
+ * files, otherwise the order in which they are labelled matters. */
+static bool
+virSecuritySELinuxTransactionIsParallel(void *opaque)
+{
+    virSecuritySELinuxContextListPtr list = opaque;
+    g_autofree const char **paths = NULL;
+    size_t i;
+
+    if (!list->parallel)
+        return false;
+
+    paths = g_new0(const char *, list->nItems);
+
+    for (i = 0; i < list->nItems; i++)
+        paths[i] = list->items[i]->path;
+
+    return virSecurityPathsAreDistinct(paths, list->nItems);
+}
+
+
+static int
+virSecuritySELinuxTransactionRunItem(size_t idx,
+                                     void *opaque)
+{
+    virSecuritySELinuxContextListPtr list = opaque;
+    virSecuritySELinuxContextItemPtr item = list->items[idx];
+    const bool remember = item->remember && list->lock;
+
+    if (!item->restore) {
+        return virSecuritySELinuxSetFilecon(list->manager,
+                                            item->path,
+                                            item->tcon,
+                                            remember);
+    }
+
+    return virSecuritySELinuxRestoreFileLabel(list->manager,
+                                              item->path,
+                                              remember);
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -252,6 +295,7 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    g_autofree bool *done = NULL;
     size_t i;
     int rv;
     int ret = -1;
@@ -272,43 +316,26 @@ virSecuritySELinuxTransactionRun(pid_t pid G_GNUC_UNUSED,
 
         for (i = 0; i < list->nItems; i++) {
             virSecuritySELinuxContextItemPtr item = list->items[i];
-            size_t j;
-
-            for (j = 0; j < state->nfds; j++) {
-                if (STREQ_NULLABLE(item->path, state->paths[j]))
-                    break;
-            }
 
             /* If path wasn't locked, don't try to remember its label. */
-            if (j == state->nfds)
+            if (!virSecurityManagerMetadataLockStateHasPath(state, item->path))
                 item->remember = false;
         }
     }
 
-    rv = 0;
-    for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItemPtr item = list->items[i];
-        const bool remember = item->remember && list->lock;
-
-        if (!item->restore) {
-            rv = virSecuritySELinuxSetFilecon(list->manager,
-                                              item->path,
-                                              item->tcon,
-                                              remember);
-        } else {
-            rv = virSecuritySELinuxRestoreFileLabel(list->manager,
-                                                    item->path,
-                                                    remember);
-        }
-
-        if (rv < 0)
-            break;
-    }
+    done = g_new0(bool, list->nItems);
+    rv = virSecurityRunParallel(list->nItems,
+                                virSecuritySELinuxTransactionIsParallel,
+                                virSecuritySELinuxTransactionRunItem,
+                                list, done);
 
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecuritySELinuxContextItemPtr item = list->items[i - 1];
         const bool remember = item->remember && list->lock;
 
+        if (!done[i - 1])
+            continue;
+
         if (!item->restore) {
             virSecuritySELinuxRestoreFileLabel(list->manager,
                                                item->path,
@@ -1159,10 +1186,13 @@ virSecuritySELinuxTransactionCommit(virSecurityManagerPtr mgr G_GNUC_UNUSED,
     }
 
     if (pid == -1) {
-        if (lock)
+        if (lock) {
             rc = virProcessRunInFork(virSecuritySELinuxTransactionRun, list);
-        else
+        } else {
+            /* Not in a forked child, threads can be used. */
+            list->parallel = true;
             rc = virSecuritySELinuxTransactionRun(pid, list);
+        }
     }
 
     if (rc < 0)
@@ -1359,7 +1389,15 @@ virSecuritySELinuxSetFilecon(virSecurityManagerPtr mgr,
         }
     }
 
-    rc = virSecuritySELinuxSetFileconImpl(path, tcon, privileged);
+    /* The current label was fetched just above, don't rewrite it if
+     * it is in place already. Writing the label costs more than
+     * reading it, especially on network file systems. */
+    if (econ && STREQ(econ, tcon)) {
+        VIR_DEBUG("SELinux context on '%s' already set to '%s'", path, tcon);
+        rc = 0;
+    } else {
+        rc = virSecuritySELinuxSetFileconImpl(path, tcon, privileged);
+    }
     if (rc < 0)
         goto cleanup;
 
@@ -18,6 +18,8 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
@@ -25,6 +27,8 @@
 #include "virlog.h"
 #include "viruuid.h"
 #include "virhostuptime.h"
+#include "virthread.h"
+#include "virhash.h"
 
 #include "security_util.h"
 
@@ -525,3 +529,175 @@ virSecurityMoveRememberedLabel(const char *name,
 
     return 0;
 }
+
+
+/* Relabelling a file is mostly waiting for the file system, which is
+ * slow for network file systems in particular. Therefore, spread it
+ * over a few threads, but only if there's enough work to share. */
+#define SECURITY_PARALLEL_THREADS 8
+#define SECURITY_PARALLEL_MIN_ITEMS 4
+
+typedef struct _virSecurityParallelData virSecurityParallelData;
+struct _virSecurityParallelData {
+    virMutex lock;
+    size_t next;
+    size_t nitems;
+    bool failed;
+    virErrorPtr error;
+    virSecurityParallelCallback cb;
+    void *opaque;
+    bool *done;
+};
+
+
+static void
+virSecurityParallelWorker(void *opaque)
+{
+    virSecurityParallelData *data = opaque;
+
+    while (true) {
+        size_t idx;
+
+        virMutexLock(&data->lock);
+        if (data->failed || data->next == data->nitems) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        idx = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (data->cb(idx, data->opaque) < 0) {
+            virMutexLock(&data->lock);
+            if (!data->failed) {
+                data->failed = true;
+                virErrorPreserveLast(&data->error);
+            }
+            virMutexUnlock(&data->lock);
+            return;
+        }
+
+        data->done[idx] = true;
+    }
+}
+
+
+/**
+ * virSecurityRunParallel:
+ * @nitems: number of items to process
+ * @check: callback deciding whether items may be processed concurrently
+ * @cb: callback processing one item
+ * @opaque: opaque data passed to @check and @cb
+ * @done: array of @nitems elements
+ *
+ * Call @cb for each item index in [0, @nitems). If there are enough
+ * items and @check returns true, @cb is called from several threads at
+ * once, otherwise the items are processed in order by the calling
+ * thread. In either case, once @cb fails no more items are started.
+ * @check is not called at all for a few items, so any cost of deciding
+ * is paid only when threads would be used.
+ *
+ * On return, @done is set for every item @cb succeeded on, so that the
+ * caller can roll them back if needed.
+ *
+ * Returns: 0 on success,
+ *         -1 if @cb failed for any item, with its error reported.
+ */
+int
+virSecurityRunParallel(size_t nitems,
+                       virSecurityParallelCheck check,
+                       virSecurityParallelCallback cb,
+                       void *opaque,
+                       bool *done)
+{
+    virSecurityParallelData data = {
+        .nitems = nitems,
+        .cb = cb,
+        .opaque = opaque,
+        .done = done,
+    };
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t i;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+
+    if (nitems >= SECURITY_PARALLEL_MIN_ITEMS && check && check(opaque)) {
+        /* The calling thread does its share of work too */
+        size_t want = MIN(nitems, SECURITY_PARALLEL_THREADS) - 1;
+
+        threads = g_new0(virThread, want);
+        for (nthreads = 0; nthreads < want; nthreads++) {
+            if (virThreadCreateFull(&threads[nthreads], true,
+                                    virSecurityParallelWorker,
+                                    "sec-relabel", false, &data) < 0) {
+                /* Not fatal, just do with fewer threads */
+                VIR_DEBUG("Unable to create relabel thread: %s",
+                          g_strerror(errno));
+                break;
+            }
+        }
+    }
+
+    virSecurityParallelWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virMutexDestroy(&data.lock);
+
+    if (data.failed) {
+        virErrorRestore(&data.error);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virSecurityPathsAreDistinct:
+ * @paths: array of paths
+ * @npaths: number of items in @paths
+ *
+ * Check whether @paths refer to distinct files. The paths are compared
+ * by the device and inode they resolve to rather than by name, so that
+ * aliases such as symlinks, bind mounts or paths with '..' components
+ * are caught. Files reached through different aliases would otherwise
+ * be relabelled concurrently, racing on their remembered label.
+ *
+ * Returns: true if all @paths exist and are distinct,
+ *          false otherwise.
+ */
+bool
+virSecurityPathsAreDistinct(const char **paths,
+                            size_t npaths)
+{
+    g_autoptr(virHashTable) inodes = virHashNew(NULL);
+    size_t i;
+
+    for (i = 0; i < npaths; i++) {
+        g_autofree char *key = NULL;
+        struct stat sb;
+
+        if (!paths[i] || stat(paths[i], &sb) < 0)
+            return false;
+
+        key = g_strdup_printf("%llu:%llu",
+                              (unsigned long long)sb.st_dev,
+                              (unsigned long long)sb.st_ino);
+
+        if (virHashLookup(inodes, key)) {
+            VIR_DEBUG("'%s' and '%s' refer to the same file",
+                      (const char *)virHashLookup(inodes, key), paths[i]);
+            return false;
+        }
+
+        if (virHashAddEntry(inodes, key, (void *)paths[i]) < 0)
+            return false;
+    }
+
+    return true;
+}
@@ -32,3 +32,19 @@ int
 virSecurityMoveRememberedLabel(const char *name,
                                const char *src,
                                const char *dst);
+
+typedef int (*virSecurityParallelCallback)(size_t idx,
+                                           void *opaque);
+
+typedef bool (*virSecurityParallelCheck)(void *opaque);
+
+int
+virSecurityRunParallel(size_t nitems,
+                       virSecurityParallelCheck check,
+                       virSecurityParallelCallback cb,
+                       void *opaque,
+                       bool *done);
+
+bool
+virSecurityPathsAreDistinct(const char **paths,
+                            size_t npaths);
@@ -219,6 +219,86 @@ virBitmapClearBitExpand(virBitmapPtr bitmap,
 }
 
 
+/* Helper function. caller must ensure start <= end < bitmap->nbits */
+static void
+virBitmapUpdateRange(virBitmapPtr bitmap,
+                     size_t start,
+                     size_t end,
+                     bool set)
+{
+    size_t first = VIR_BITMAP_UNIT_OFFSET(start);
+    size_t last = VIR_BITMAP_UNIT_OFFSET(end);
+    unsigned long firstMask = -1UL << VIR_BITMAP_BIT_OFFSET(start);
+    unsigned long lastMask = -1UL >> (VIR_BITMAP_BITS_PER_UNIT - 1 -
+                                      VIR_BITMAP_BIT_OFFSET(end));
+
+    if (first == last) {
+        firstMask &= lastMask;
+        lastMask = 0;
+    }
+
+    if (set) {
+        bitmap->map[first] |= firstMask;
+        bitmap->map[last] |= lastMask;
+    } else {
+        bitmap->map[first] &= ~firstMask;
+        bitmap->map[last] &= ~lastMask;
+    }
+
+    if (last > first + 1) {
+        memset(bitmap->map + first + 1, set ? 0xff : 0,
+               (last - first - 1) * sizeof(bitmap->map[0]));
+    }
+}
+
+
+/**
+ * virBitmapSetRange:
+ * @bitmap: Pointer to bitmap
+ * @start: first bit position to set
+ * @end: last bit position to set
+ *
+ * Set bit positions @start to @end (inclusive) in @bitmap. This sets whole
+ * words at once and is preferable to setting the bits one by one.
+ *
+ * Returns 0 on if the bits are successfully set, -1 on error.
+ */
+int
+virBitmapSetRange(virBitmapPtr bitmap,
+                  size_t start,
+                  size_t end)
+{
+    if (end < start || bitmap->nbits <= end)
+        return -1;
+
+    virBitmapUpdateRange(bitmap, start, end, true);
+    return 0;
+}
+
+
+/**
+ * virBitmapClearRange:
+ * @bitmap: Pointer to bitmap
+ * @start: first bit position to clear
+ * @end: last bit position to clear
+ *
+ * Clear bit positions @start to @end (inclusive) in @bitmap.
+ *
+ * Returns 0 on if the bits are successfully cleared, -1 on error.
+ */
+int
+virBitmapClearRange(virBitmapPtr bitmap,
+                    size_t start,
+                    size_t end)
+{
+    if (end < start || bitmap->nbits <= end)
+        return -1;
+
+    virBitmapUpdateRange(bitmap, start, end, false);
+    return 0;
+}
+
+
 /* Helper function. caller must ensure b < bitmap->nbits */
 static bool
 virBitmapIsSet(virBitmapPtr bitmap, size_t b)
@@ -339,39 +419,27 @@ char *
 virBitmapFormat(virBitmapPtr bitmap)
 {
     g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
-    bool first = true;
-    int start, cur, prev;
+    ssize_t start;
+    ssize_t end;
 
-    if (!bitmap || (cur = virBitmapNextSetBit(bitmap, -1)) < 0) {
-        char *ret;
-        ret = g_strdup("");
-        return ret;
-    }
+    if (!bitmap || (start = virBitmapNextSetBit(bitmap, -1)) < 0)
+        return g_strdup("");
 
-    start = prev = cur;
-    while (prev >= 0) {
-        cur = virBitmapNextSetBit(bitmap, prev);
+    /* Walk the runs of set bits rather than the individual bits */
+    while (start >= 0) {
+        if ((end = virBitmapNextClearBit(bitmap, start)) < 0)
+            end = bitmap->nbits;
 
-        if (cur == prev + 1) {
-            prev = cur;
-            continue;
-        }
-
-        /* cur < 0 or cur > prev + 1 */
-
-        if (!first)
-            virBufferAddLit(&buf, ",");
-        else
-            first = false;
-
-        if (prev == start)
-            virBufferAsprintf(&buf, "%d", start);
+        if (end - 1 == start)
+            virBufferAsprintf(&buf, "%zd,", start);
         else
-            virBufferAsprintf(&buf, "%d-%d", start, prev);
+            virBufferAsprintf(&buf, "%zd-%zd,", start, end - 1);
 
-        start = prev = cur;
+        start = virBitmapNextSetBit(bitmap, end);
     }
 
+    virBufferTrim(&buf, ",");
+
     return virBufferContentAndReset(&buf);
 }
 
@@ -407,7 +475,6 @@ virBitmapParseSeparator(const char *str,
     bool neg = false;
     const char *cur = str;
     char *tmp;
-    size_t i;
     int start, last;
 
     *bitmap = virBitmapNew(bitmapSize);
@@ -466,10 +533,8 @@ virBitmapParseSeparator(const char *str,
 
             cur = tmp;
 
-            for (i = start; i <= last; i++) {
-                if (virBitmapSetBit(*bitmap, i) < 0)
-                    goto error;
-            }
+            if (virBitmapSetRange(*bitmap, start, last) < 0)
+                goto error;
 
             virSkipSpaces(&cur);
         }
@@ -542,7 +607,6 @@ virBitmapParseUnlimited(const char *str)
     bool neg = false;
     const char *cur = str;
     char *tmp;
-    size_t i;
     int start, last;
 
     if (!str)
@@ -599,10 +663,10 @@ virBitmapParseUnlimited(const char *str)
 
             cur = tmp;
 
-            for (i = start; i <= last; i++) {
-                if (virBitmapSetBitExpand(bitmap, i) < 0)
-                    goto error;
-            }
+            if (bitmap->nbits <= last && virBitmapExpand(bitmap, last) < 0)
+                goto error;
+
+            virBitmapUpdateRange(bitmap, start, last, true);
 
             virSkipSpaces(&cur);
         }
@@ -779,12 +843,11 @@ virBitmapEqual(virBitmapPtr b1,
 
     /* Now b1 is the smaller one, if not equal */
 
-    for (i = 0; i < b1->map_len; i++) {
-        if (b1->map[i] != b2->map[i])
-            return false;
-    }
+    if (b1->map_len &&
+        memcmp(b1->map, b2->map, b1->map_len * sizeof(b1->map[0])) != 0)
+        return false;
 
-    for (; i < b2->map_len; i++) {
+    for (i = b1->map_len; i < b2->map_len; i++) {
         if (b2->map[i])
             return false;
     }
@@ -945,7 +1008,6 @@ virBitmapNextSetBit(virBitmapPtr bitmap,
 ssize_t
 virBitmapLastSetBit(virBitmapPtr bitmap)
 {
-    ssize_t i;
     int unusedBits;
     ssize_t sz;
     unsigned long bits;
@@ -975,12 +1037,8 @@ virBitmapLastSetBit(virBitmapPtr bitmap)
     return -1;
 
  found:
-    for (i = VIR_BITMAP_BITS_PER_UNIT - 1; i >= 0; i--) {
-        if (bits & 1UL << i)
-            return i + sz * VIR_BITMAP_BITS_PER_UNIT;
-    }
-
-    return -1;
+    return VIR_BITMAP_BITS_PER_UNIT - 1 - __builtin_clzl(bits) +
+           sz * VIR_BITMAP_BITS_PER_UNIT;
 }
 
 
@@ -58,6 +58,15 @@ int virBitmapClearBit(virBitmapPtr bitmap, size_t b)
 int virBitmapClearBitExpand(virBitmapPtr bitmap, size_t b)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 
+/*
+ * Set or clear bit positions @start to @end (inclusive) in @bitmap
+ */
+int virBitmapSetRange(virBitmapPtr bitmap, size_t start, size_t end)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+
+int virBitmapClearRange(virBitmapPtr bitmap, size_t start, size_t end)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+
 /*
  * Get bit @b in @bitmap. Returns false if b is out of range.
  */
@@ -37,6 +37,11 @@
 # include <cap-ng.h>
 #endif
 
+#ifdef __linux__
+# include <sched.h>
+# include <sys/syscall.h>
+#endif
+
 #if defined(WITH_SECDRIVER_SELINUX)
 # include <selinux/selinux.h>
 #endif
@@ -599,6 +604,226 @@ virCommandMassClose(virCommandPtr cmd,
 
 # endif /* ! __FreeBSD__ */
 
+# if defined(__linux__) && defined(__NR_close_range) && defined(CLONE_VFORK)
+#  define WITH_EXEC_SPAWN 1
+
+#  ifndef CLOSE_RANGE_CLOEXEC
+#   define CLOSE_RANGE_CLOEXEC (1U << 2)
+#  endif
+
+/* The spawned child only runs a handful of syscalls before execve(),
+ * so a small stack is plenty. */
+#  define VIR_EXEC_SPAWN_STACK_SIZE (64 * 1024)
+
+typedef struct _virExecSpawnData virExecSpawnData;
+struct _virExecSpawnData {
+    virCommandPtr cmd;
+    const char *binary;
+    int childin;
+    int childout;
+    int childerr;
+    int err; /* errno of the failed step, set by the child */
+    bool execFailed; /* set by the child if execve() itself failed */
+};
+
+static int virExecSpawnSupport = -1;
+
+/* CLOSE_RANGE_CLOEXEC was added in Linux 5.11. A range that contains
+ * no FD lets us detect support without touching anything. */
+static bool
+virExecSpawnSupported(void)
+{
+    int support = g_atomic_int_get(&virExecSpawnSupport);
+
+    if (support < 0) {
+        support = syscall(__NR_close_range, ~0U, ~0U, CLOSE_RANGE_CLOEXEC) == 0;
+        g_atomic_int_set(&virExecSpawnSupport, support);
+        VIR_DEBUG("Fast spawn of child processes is %s",
+                  support ? "supported" : "not supported");
+    }
+
+    return support;
+}
+
+
+/*
+ * virExecCanSpawn:
+ *
+ * Returns true if @cmd needs no setup in the child other than setting
+ * up its FDs, working directory and umask, in which case it can be
+ * started by virExecSpawn.
+ */
+static bool
+virExecCanSpawn(virCommandPtr cmd)
+{
+    if (cmd->hook || cmd->handshake || cmd->pidfile ||
+        (cmd->flags & (VIR_EXEC_DAEMON | VIR_EXEC_CLEAR_CAPS)) ||
+        cmd->uid != (uid_t)-1 || cmd->gid != (gid_t)-1 ||
+        cmd->capabilities ||
+        cmd->maxMemLock || cmd->maxProcesses || cmd->maxFiles ||
+        cmd->setMaxCore)
+        return false;
+
+#  if defined(WITH_SECDRIVER_SELINUX)
+    if (cmd->seLinuxLabel)
+        return false;
+#  endif
+#  if defined(WITH_SECDRIVER_APPARMOR)
+    if (cmd->appArmorProfile)
+        return false;
+#  endif
+
+    return virExecSpawnSupported();
+}
+
+
+/* Runs in the child which shares its memory with the suspended parent
+ * until execve() succeeds. Only async-signal-safe calls which neither
+ * allocate nor take locks may be made here. */
+static int
+virExecSpawnChild(void *opaque)
+{
+    virExecSpawnData *data = opaque;
+    virCommandPtr cmd = data->cmd;
+    struct sigaction sig_action;
+    sigset_t newmask;
+    size_t i;
+
+    /* Clear out all signal handlers of the parent, they must not run
+     * on its memory once we unblock signals */
+    memset(&sig_action, 0, sizeof(sig_action));
+    sig_action.sa_handler = SIG_DFL;
+    sigemptyset(&sig_action.sa_mask);
+    for (i = 1; i < NSIG; i++)
+        ignore_value(sigaction(i, &sig_action, NULL));
+
+    if (cmd->mask)
+        umask(cmd->mask);
+
+    /* Instead of walking the FD table, let execve() close everything
+     * but stdio and the FDs we were asked to pass */
+    if (syscall(__NR_close_range, STDERR_FILENO + 1, ~0U, CLOSE_RANGE_CLOEXEC) < 0)
+        goto error;
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        if (virSetInherit(cmd->passfd[i].fd, true) < 0)
+            goto error;
+    }
+
+    if (prepareStdFd(data->childin, STDIN_FILENO) < 0)
+        goto error;
+    if (data->childout > 0 &&
+        prepareStdFd(data->childout, STDOUT_FILENO) < 0)
+        goto error;
+    if (data->childerr > 0 &&
+        prepareStdFd(data->childerr, STDERR_FILENO) < 0)
+        goto error;
+
+    if (cmd->pwd && chdir(cmd->pwd) < 0)
+        goto error;
+
+    sigemptyset(&newmask);
+    if (sigprocmask(SIG_SETMASK, &newmask, NULL) < 0)
+        goto error;
+
+    if (cmd->env)
+        execve(data->binary, cmd->args, cmd->env);
+    else
+        execv(data->binary, cmd->args);
+
+    /* Same exit codes as the fork() based path */
+    data->err = errno;
+    data->execFailed = true;
+    _exit(errno == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE);
+
+ error:
+    data->err = errno;
+    _exit(EXIT_CANCELED);
+}
+
+
+/*
+ * virExecSpawn:
+ * @cmd: command to run
+ * @binary: resolved path of the binary
+ * @childin, @childout, @childerr: FDs to become stdio of the child
+ *
+ * Start @cmd without copying the address space of the caller. The
+ * child is created with CLONE_VM | CLONE_VFORK, which suspends the
+ * caller until the child has called execve() or exited, and avoids
+ * duplicating page tables of large processes.
+ *
+ * Like with the fork() based path, failures in the child are reported
+ * as its exit status: EXIT_ENOENT or EXIT_CANNOT_INVOKE if execve()
+ * failed, EXIT_CANCELED if setting up the child failed before that.
+ *
+ * Returns the PID of the child, or -1 on error.
+ */
+static pid_t
+virExecSpawn(virCommandPtr cmd,
+             const char *binary,
+             int childin,
+             int childout,
+             int childerr)
+{
+    virExecSpawnData data = {
+        .cmd = cmd,
+        .binary = binary,
+        .childin = childin,
+        .childout = childout,
+        .childerr = childerr,
+    };
+    g_autofree char *stack = NULL;
+    sigset_t newmask;
+    sigset_t oldmask;
+    int saved_errno;
+    pid_t pid;
+
+    stack = g_new0(char, VIR_EXEC_SPAWN_STACK_SIZE);
+
+    /* Signal handlers must not run in the child while it still shares
+     * our memory, it unblocks signals right before execve() */
+    sigfillset(&newmask);
+    if (pthread_sigmask(SIG_SETMASK, &newmask, &oldmask) != 0) {
+        virReportSystemError(errno, "%s", _("cannot block signals"));
+        return -1;
+    }
+
+    pid = clone(virExecSpawnChild, stack + VIR_EXEC_SPAWN_STACK_SIZE,
+                CLONE_VM | CLONE_VFORK | SIGCHLD, &data);
+    saved_errno = errno;
+
+    ignore_value(pthread_sigmask(SIG_SETMASK, &oldmask, NULL));
+
+    if (pid < 0) {
+        virReportSystemError(saved_errno, "%s",
+                             _("cannot fork child process"));
+        return -1;
+    }
+
+    if (data.err) {
+        /* The child has already exited, leave the exit status to be
+         * collected by the caller, but keep the reason for the
+         * failure where the child would have printed it. */
+        g_autofree char *msg = NULL;
+
+        if (data.execFailed)
+            msg = g_strdup_printf("cannot execute binary %s: %s",
+                                  cmd->args[0], g_strerror(data.err));
+        else
+            msg = g_strdup_printf("cannot set up child process for %s: %s",
+                                  cmd->args[0], g_strerror(data.err));
+
+        VIR_DEBUG("%s", msg);
+        ignore_value(safewrite(childerr, msg, strlen(msg)));
+        ignore_value(safewrite(childerr, "\n", 1));
+    }
+
+    return pid;
+}
+# endif /* __linux__ && __NR_close_range && CLONE_VFORK */
+
+
 /*
  * virExec:
  * @cmd virCommandPtr containing all information about the program to
@@ -687,7 +912,12 @@ virExec(virCommandPtr cmd)
     if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
         goto cleanup;
 
-    pid = virFork();
+# ifdef WITH_EXEC_SPAWN
+    if (virExecCanSpawn(cmd))
+        pid = virExecSpawn(cmd, binary, childin, childout, childerr);
+    else
+# endif /* WITH_EXEC_SPAWN */
+        pid = virFork();
 
     if (pid < 0)
         goto cleanup;
@@ -826,6 +1056,7 @@ virExec(virCommandPtr cmd)
         VIR_DEBUG("Done hook %d", ret);
         if (ret < 0)
            goto fork_error;
+        ret = EXIT_CANCELED;
     }
 
 # if defined(WITH_SECDRIVER_SELINUX)
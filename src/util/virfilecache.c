@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -49,6 +50,10 @@ struct _virFileCache {
 
     virHashTablePtr table;
 
+    /* names being created by prefetch workers, see virFileCachePrefetch */
+    virHashTablePtr pending;
+    virCond cond;
+
     char *dir;
     char *suffix;
 
@@ -78,6 +83,8 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->pending);
+    virCondDestroy(&cache->cond);
 
     virFileCachePrivFree(cache);
 }
@@ -245,6 +252,15 @@ virFileCacheNew(const char *dir,
     if (!(cache->table = virHashNew(virObjectFreeHashData)))
         goto cleanup;
 
+    if (!(cache->pending = virHashNew(NULL)))
+        goto cleanup;
+
+    if (virCondInit(&cache->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        goto cleanup;
+    }
+
     cache->dir = g_strdup(dir);
 
     cache->suffix = g_strdup(suffix);
@@ -259,6 +275,22 @@ virFileCacheNew(const char *dir,
 }
 
 
+/* Wait until prefetch workers are done with @name, or with all names
+ * if @name is NULL.  Must be called with @cache locked. */
+static void
+virFileCacheWaitPending(virFileCachePtr cache,
+                        const char *name)
+{
+    while (name ? virHashHasEntry(cache->pending, name) :
+                  virHashSize(cache->pending) > 0) {
+        if (virCondWait(&cache->cond, &cache->parent.lock) < 0) {
+            VIR_WARN("Unable to wait for prefetched data");
+            return;
+        }
+    }
+}
+
+
 static void
 virFileCacheValidate(virFileCachePtr cache,
                      const char *name,
@@ -306,6 +338,8 @@ virFileCacheLookup(virFileCachePtr cache,
 
     virObjectLock(cache);
 
+    virFileCacheWaitPending(cache, name);
+
     data = virHashLookup(cache->table, name);
     virFileCacheValidate(cache, name, &data);
 
@@ -337,6 +371,8 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
 
     virObjectLock(cache);
 
+    virFileCacheWaitPending(cache, NULL);
+
     data = virHashSearch(cache->table, iter, iterData, &name);
     virFileCacheValidate(cache, name, &data);
 
@@ -347,6 +383,160 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
 }
 
 
+typedef struct _virFileCachePrefetchData virFileCachePrefetchData;
+typedef virFileCachePrefetchData *virFileCachePrefetchDataPtr;
+struct _virFileCachePrefetchData {
+    virFileCachePtr cache;
+    char **names;
+    size_t next;
+    size_t nworkers;
+};
+
+
+static void
+virFileCachePrefetchDataFree(virFileCachePrefetchDataPtr prefetch)
+{
+    virStringListFree(prefetch->names);
+    g_free(prefetch);
+}
+
+
+static void
+virFileCachePrefetchWorker(void *opaque)
+{
+    virFileCachePrefetchDataPtr prefetch = opaque;
+    virFileCachePtr cache = prefetch->cache;
+    bool last;
+
+    virObjectLock(cache);
+
+    while (prefetch->names[prefetch->next]) {
+        const char *name = prefetch->names[prefetch->next++];
+        void *data = NULL;
+        int rv;
+
+        /* Loading from the cache file is cheap compared to creating new
+         * data, so only the latter is done without holding the lock. */
+        if ((rv = virFileCacheLoad(cache, name, &data)) == 0) {
+            virObjectUnlock(cache);
+
+            if ((data = cache->handlers.newData(name, cache->priv)) &&
+                virFileCacheSave(cache, name, data) < 0) {
+                virObjectUnref(data);
+                data = NULL;
+            }
+
+            virObjectLock(cache);
+        }
+
+        if (data) {
+            VIR_DEBUG("Caching prefetched data '%p' for '%s'", data, name);
+            if (virHashAddEntry(cache->table, name, data) < 0)
+                virObjectUnref(data);
+        } else {
+            /* virFileCacheLookup() will try again and report the error */
+            VIR_WARN("Failed to prefetch data for '%s': %s",
+                     name, virGetLastErrorMessage());
+            virResetLastError();
+        }
+
+        virHashRemoveEntry(cache->pending, name);
+        virCondBroadcast(&cache->cond);
+    }
+
+    last = --prefetch->nworkers == 0;
+
+    virObjectUnlock(cache);
+
+    if (last)
+        virFileCachePrefetchDataFree(prefetch);
+    virObjectUnref(cache);
+}
+
+
+/**
+ * virFileCachePrefetch:
+ * @cache: existing cache object
+ * @names: NULL terminated list of names of the data to prefetch
+ * @nworkers: maximum number of threads to use
+ *
+ * Starts loading or creating data for all @names which are not cached
+ * yet in the background, using up to @nworkers threads so that data for
+ * several names is created in parallel.  The function doesn't wait for
+ * the threads to finish, virFileCacheLookup() and
+ * virFileCacheLookupByFunc() wait for the data they need instead.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFileCachePrefetch(virFileCachePtr cache,
+                     const char *const *names,
+                     size_t nworkers)
+{
+    virFileCachePrefetchDataPtr prefetch = NULL;
+    size_t nnames = 0;
+    size_t i;
+    int ret = -1;
+
+    prefetch = g_new0(virFileCachePrefetchData, 1);
+    prefetch->cache = cache;
+    prefetch->names = g_new0(char *, virStringListLength(names) + 1);
+
+    virObjectLock(cache);
+
+    for (i = 0; names[i]; i++) {
+        if (virHashLookup(cache->table, names[i]) ||
+            virHashHasEntry(cache->pending, names[i]))
+            continue;
+
+        if (virHashAddEntry(cache->pending, names[i], prefetch) < 0)
+            goto cleanup;
+
+        prefetch->names[nnames++] = g_strdup(names[i]);
+    }
+
+    if (nnames == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    nworkers = MAX(MIN(nworkers, nnames), 1);
+
+    for (i = 0; i < nworkers; i++) {
+        virThread thread;
+
+        virObjectRef(cache);
+        prefetch->nworkers++;
+
+        if (virThreadCreateFull(&thread, false, virFileCachePrefetchWorker,
+                                "cache-prefetch", false, prefetch) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create prefetch thread"));
+            prefetch->nworkers--;
+            virObjectUnref(cache);
+            break;
+        }
+    }
+
+    /* Whatever workers were started take care of all the names */
+    if (prefetch->nworkers > 0) {
+        VIR_DEBUG("Prefetching %zu names using %zu threads",
+                  nnames, prefetch->nworkers);
+        prefetch = NULL;
+        ret = 0;
+    }
+
+ cleanup:
+    if (prefetch) {
+        for (i = 0; i < nnames; i++)
+            virHashRemoveEntry(cache->pending, prefetch->names[i]);
+        virFileCachePrefetchDataFree(prefetch);
+    }
+    virObjectUnlock(cache);
+    return ret;
+}
+
+
 /**
  * virFileCacheGetPriv:
  * @cache: existing cache object
@@ -23,8 +23,11 @@
 #include <config.h>
 
 #include "virlease.h"
+#include "virleaseindex.h"
 
+#include <fcntl.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #include "virfile.h"
 #include "virstring.h"
@@ -41,6 +44,13 @@
  */
 #define VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX (32 * 1024 * 1024)
 
+/* Modification times are only as fine grained as the kernel's coarse
+ * clock, so a change done within the same tick as the last one may
+ * leave the time of the lease directory unchanged. The lease index
+ * waits this long after the last change, in us, before it records the
+ * time. */
+#define VIR_LEASE_INDEX_MTIME_SLACK (20 * 1000)
+
 
 int
 virLeaseReadCustomLeaseFile(virJSONValuePtr leases_array_new,
@@ -259,3 +269,249 @@ virLeaseNew(virJSONValuePtr *lease_ret,
     lease_new = NULL;
     return 0;
 }
+
+
+typedef struct {
+    const char *hostname;
+    const char *macaddr;
+    const char *ipaddr;
+    long long expirytime;
+} virLeaseIndexEntry;
+
+typedef struct {
+    virLeaseIndexHeader header;
+    virLeaseIndexRecord *records;
+    const char *strtab;
+} virLeaseIndexData;
+
+
+static int
+virLeaseIndexEntrySorter(const void *a,
+                         const void *b)
+{
+    const virLeaseIndexEntry *ea = a;
+    const virLeaseIndexEntry *eb = b;
+
+    return strcmp(ea->hostname, eb->hostname);
+}
+
+
+static int
+virLeaseIndexWriteHelper(int fd,
+                         const void *opaque)
+{
+    const virLeaseIndexData *data = opaque;
+
+    if (safewrite(fd, &data->header, sizeof(data->header)) < 0 ||
+        safewrite(fd, data->records,
+                  sizeof(*data->records) * data->header.nrecords) < 0 ||
+        safewrite(fd, data->strtab, data->header.strtabLen) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static uint32_t
+virLeaseIndexAddString(virBufferPtr strtab,
+                       const char *str)
+{
+    size_t offset;
+
+    if (!str || !*str)
+        return 0;
+
+    offset = virBufferUse(strtab);
+    virBufferAdd(strtab, str, strlen(str) + 1);
+
+    return offset;
+}
+
+
+/**
+ * virLeaseIndexWrite:
+ * @leasedir: directory holding the custom lease files
+ *
+ * Collect the leases from all custom lease (*.status) files in
+ * @leasedir and (re)write the lease index (VIR_LEASE_INDEX_FILE) in
+ * a subdirectory. The index is marked valid for the state of @leasedir
+ * before the lease files were read, so any change of the lease files
+ * made since then, even while the index is being built, makes readers
+ * ignore it until it is rewritten. See virleaseindex.h for the format.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLeaseIndexWrite(const char *leasedir)
+{
+    g_autofree char *indexdir = NULL;
+    g_autofree char *indexfile = NULL;
+    g_autofree char *tmpfile = NULL;
+    g_autofree virLeaseIndexEntry *entries = NULL;
+    g_autofree virLeaseIndexRecord *records = NULL;
+    g_autofree char *strtab_str = NULL;
+    g_auto(virBuffer) strtab = VIR_BUFFER_INITIALIZER;
+    virJSONValuePtr *docs = NULL;
+    size_t ndocs = 0;
+    size_t nentries = 0;
+    virLeaseIndexData data;
+    struct dirent *ent;
+    struct stat sb;
+    DIR *dir = NULL;
+    int fd = -1;
+    int rc;
+    int ret = -1;
+    size_t i;
+
+    indexdir = g_strdup_printf("%s/%s", leasedir, VIR_LEASE_INDEX_DIR);
+    indexfile = g_strdup_printf("%s/%s", leasedir, VIR_LEASE_INDEX_FILE);
+
+    /* Creating the directory changes @leasedir, so do it first */
+    if (g_mkdir_with_parents(indexdir, 0755) < 0) {
+        virReportSystemError(errno, _("cannot create directory '%s'"),
+                             indexdir);
+        goto cleanup;
+    }
+
+    if (virDirOpen(&dir, leasedir) < 0)
+        goto cleanup;
+
+    /* Take the time before reading any lease file. Wait until the tick
+     * of the last change has passed, so that any change from now on is
+     * guaranteed to result in a different time. */
+    for (;;) {
+        long long mtime;
+        long long elapsed;
+
+        if (fstat(dirfd(dir), &sb) < 0) {
+            virReportSystemError(errno, _("cannot stat '%s'"), leasedir);
+            goto cleanup;
+        }
+
+        mtime = sb.st_mtim.tv_sec * G_USEC_PER_SEC + sb.st_mtim.tv_nsec / 1000;
+        elapsed = g_get_real_time() - mtime;
+
+        /* A time in the future means a clock jump, waiting won't help */
+        if (elapsed < 0 || elapsed >= VIR_LEASE_INDEX_MTIME_SLACK)
+            break;
+
+        g_usleep(VIR_LEASE_INDEX_MTIME_SLACK - elapsed);
+    }
+
+    while ((rc = virDirRead(dir, &ent, leasedir)) > 0) {
+        g_autofree char *path = NULL;
+        g_autofree char *content = NULL;
+        g_autoptr(virJSONValue) leases = NULL;
+
+        if (!virStringHasSuffix(ent->d_name, ".status"))
+            continue;
+
+        path = g_strdup_printf("%s/%s", leasedir, ent->d_name);
+
+        if (virFileReadAll(path, VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX,
+                           &content) < 0)
+            goto cleanup;
+
+        /* Files are empty until the first lease is handed out and
+         * leaseshelper itself rewrites files that contain garbage */
+        if (!*content ||
+            !(leases = virJSONValueFromString(content)) ||
+            !virJSONValueIsArray(leases)) {
+            virResetLastError();
+            continue;
+        }
+
+        for (i = 0; i < virJSONValueArraySize(leases); i++) {
+            virJSONValuePtr lease = virJSONValueArrayGet(leases, i);
+            virLeaseIndexEntry entry = { 0 };
+
+            if (!(entry.ipaddr = virJSONValueObjectGetString(lease, "ip-address")) ||
+                virJSONValueObjectGetNumberLong(lease, "expiry-time",
+                                                &entry.expirytime) < 0)
+                continue;
+
+            entry.hostname = NULLSTR_EMPTY(virJSONValueObjectGetString(lease, "hostname"));
+            entry.macaddr = virJSONValueObjectGetString(lease, "mac-address");
+
+            if (VIR_APPEND_ELEMENT(entries, nentries, entry) < 0)
+                goto cleanup;
+        }
+
+        /* The entries point into the parsed leases, keep them around */
+        if (VIR_APPEND_ELEMENT(docs, ndocs, leases) < 0)
+            goto cleanup;
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    if (nentries > UINT32_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("too many leases to index"));
+        goto cleanup;
+    }
+
+    qsort(entries, nentries, sizeof(*entries), virLeaseIndexEntrySorter);
+
+    /* Offset 0 is reserved for the empty string */
+    virBufferAdd(&strtab, "", 1);
+    records = g_new0(virLeaseIndexRecord, nentries);
+    for (i = 0; i < nentries; i++) {
+        records[i].expirytime = entries[i].expirytime;
+        records[i].hostname = virLeaseIndexAddString(&strtab, entries[i].hostname);
+        records[i].macaddr = virLeaseIndexAddString(&strtab, entries[i].macaddr);
+        records[i].ipaddr = virLeaseIndexAddString(&strtab, entries[i].ipaddr);
+    }
+
+    if (virBufferUse(&strtab) > UINT32_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("too many leases to index"));
+        goto cleanup;
+    }
+
+    memset(&data, 0, sizeof(data));
+    memcpy(data.header.magic, VIR_LEASE_INDEX_MAGIC, VIR_LEASE_INDEX_MAGIC_LEN);
+    data.header.version = VIR_LEASE_INDEX_VERSION;
+    data.header.nrecords = nentries;
+    data.header.strtabLen = virBufferUse(&strtab);
+    data.header.dirMtimeSec = sb.st_mtim.tv_sec;
+    data.header.dirMtimeNsec = sb.st_mtim.tv_nsec;
+    data.records = records;
+    data.strtab = strtab_str = virBufferContentAndReset(&strtab);
+
+    tmpfile = g_strdup_printf("%s.XXXXXX", indexfile);
+    if ((fd = g_mkstemp_full(tmpfile, O_RDWR | O_CLOEXEC, 0644)) < 0) {
+        virReportSystemError(errno, _("cannot create '%s'"), tmpfile);
+        VIR_FREE(tmpfile);
+        goto cleanup;
+    }
+
+    if (virLeaseIndexWriteHelper(fd, &data) < 0 ||
+        g_fsync(fd) < 0) {
+        virReportSystemError(errno, _("cannot write '%s'"), tmpfile);
+        goto cleanup;
+    }
+
+    if (rename(tmpfile, indexfile) < 0) {
+        virReportSystemError(errno, _("cannot rename '%s' to '%s'"),
+                             tmpfile, indexfile);
+        goto cleanup;
+    }
+    VIR_FREE(tmpfile);
+
+    if (VIR_CLOSE(fd) < 0) {
+        virReportSystemError(errno, _("cannot close '%s'"), indexfile);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (tmpfile)
+        unlink(tmpfile);
+    VIR_DIR_CLOSE(dir);
+    for (i = 0; i < ndocs; i++)
+        virJSONValueFree(docs[i]);
+    VIR_FREE(docs);
+    return ret;
+}
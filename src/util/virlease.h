@@ -40,3 +40,5 @@ int virLeaseNew(virJSONValuePtr *lease_ret,
                 const char *hostname,
                 const char *iaid,
                 const char *server_duid);
+
+int virLeaseIndexWrite(const char *leasedir);
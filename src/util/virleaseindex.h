@@ -0,0 +1,72 @@
+/*
+ * virleaseindex.h: on-disk format of the DHCP lease index
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+/* This header is shared with the NSS plugin which must not pull in
+ * glib or any other part of libvirt, so keep it self contained. */
+
+#include <stdint.h>
+
+/*
+ * The lease index is written by leaseshelper next to the custom lease
+ * (*.status) files every time a lease changes. It aggregates the
+ * leases of all networks so that the NSS plugin can resolve a name
+ * without opening and parsing each lease file.
+ *
+ * The file consists of a header, followed by @nrecords records sorted
+ * by hostname (using strcmp), followed by a table of NUL terminated
+ * strings which the records refer to by offset. Leases without a
+ * hostname refer to an empty string. All integers are stored in host
+ * byte order as the file is never shared between hosts.
+ *
+ * The index is only valid as long as the lease directory is unchanged
+ * since it was scanned, which is recorded in @dirMtimeSec and
+ * @dirMtimeNsec. Readers must ignore the index if the modification
+ * time of the directory does not match. The time is taken before the
+ * lease files are read, so a lease file replaced while the index is
+ * being built makes the new index stale right away. For the same
+ * reason the index lives in a subdirectory: putting it into place
+ * must not change the modification time of the lease directory.
+ */
+
+#define VIR_LEASE_INDEX_DIR "leases.index.d"
+#define VIR_LEASE_INDEX_FILE VIR_LEASE_INDEX_DIR "/leases.index"
+#define VIR_LEASE_INDEX_MAGIC "LVLEASE\0"
+#define VIR_LEASE_INDEX_MAGIC_LEN 8
+#define VIR_LEASE_INDEX_VERSION 1
+
+typedef struct _virLeaseIndexHeader virLeaseIndexHeader;
+struct _virLeaseIndexHeader {
+    char magic[VIR_LEASE_INDEX_MAGIC_LEN];
+    uint32_t version;
+    uint32_t nrecords;
+    int64_t dirMtimeSec;
+    int64_t dirMtimeNsec;
+    uint64_t strtabLen;
+};
+
+typedef struct _virLeaseIndexRecord virLeaseIndexRecord;
+struct _virLeaseIndexRecord {
+    int64_t expirytime;
+    uint32_t hostname; /* offsets into the string table */
+    uint32_t macaddr;
+    uint32_t ipaddr;
+    uint32_t padding;
+};
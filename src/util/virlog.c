@@ -26,6 +26,7 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 #if WITH_SYSLOG_H
 # include <syslog.h>
@@ -81,7 +82,13 @@ struct _virLogFilter {
     virLogPriority priority;
 };
 
-static int virLogFiltersSerial = 1;
+/*
+ * Bumped whenever anything affecting the priority a source logs at
+ * changes (filters, outputs, default priority). Exported so that the
+ * VIR_DEBUG & co. macros can check whether a source is up to date
+ * without a function call.
+ */
+int virLogFiltersSerial = 1;
 static virLogFilterPtr *virLogFilters;
 static size_t virLogNbFilters;
 
@@ -127,6 +134,55 @@ static void virLogOutputToFd(virLogSourcePtr src,
  */
 virMutex virLogMutex;
 
+/*
+ * Asynchronous logging: messages are formatted by the emitting thread,
+ * queued in a bounded lock-free ring and written to the outputs by a
+ * dedicated writer thread. Producers never block; if the ring is full
+ * the message is dropped and accounted for in virLogAsyncDropped.
+ *
+ * The ring is a bounded queue in the style of D. Vyukov's MPMC queue:
+ * each slot carries a sequence number telling whether it is free for
+ * the producer owning position @seq or holds a message for the consumer
+ * at position @seq - 1. Messages are normally consumed by the writer
+ * thread only, but a dying process drains the queue from whichever
+ * thread is crashing or exiting.
+ */
+#define VIR_LOG_ASYNC_QUEUE_SIZE 4096 /* must be a power of two */
+#define VIR_LOG_ASYNC_IDLE_MS 100
+#define VIR_LOG_ASYNC_FLUSH_MS 1000
+
+typedef struct _virLogAsyncMessage virLogAsyncMessage;
+typedef virLogAsyncMessage *virLogAsyncMessagePtr;
+struct _virLogAsyncMessage {
+    virLogSourcePtr source;
+    virLogPriority priority;
+    const char *filename;
+    int linenr;
+    const char *funcname;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    virLogMetadataPtr metadata;
+    char *str;
+    char *msg;
+};
+
+typedef struct _virLogAsyncSlot virLogAsyncSlot;
+struct _virLogAsyncSlot {
+    int seq; /* accessed atomically, compared as unsigned */
+    virLogAsyncMessagePtr msg;
+};
+
+static int virLogAsync; /* bool, accessed atomically */
+static int virLogAsyncStarted; /* bool, accessed atomically */
+static virLogAsyncSlot virLogAsyncRing[VIR_LOG_ASYNC_QUEUE_SIZE];
+static int virLogAsyncHead; /* next position to enqueue */
+static int virLogAsyncTail; /* next position to dequeue */
+static int virLogAsyncWritten; /* positions written to outputs */
+static int virLogAsyncDropped;
+static int virLogAsyncIdle; /* writer thread waits for virLogAsyncCond */
+static virMutex virLogAsyncMutex;
+static virCond virLogAsyncCond;      /* signals new messages */
+static virCond virLogAsyncFlushCond; /* signals progress of the writer */
+
 void
 virLogLock(void)
 {
@@ -247,9 +303,17 @@ virLogPriorityString(virLogPriority lvl)
 static int
 virLogOnceInit(void)
 {
-    if (virMutexInit(&virLogMutex) < 0)
+    size_t i;
+
+    if (virMutexInit(&virLogMutex) < 0 ||
+        virMutexInit(&virLogAsyncMutex) < 0 ||
+        virCondInit(&virLogAsyncCond) < 0 ||
+        virCondInit(&virLogAsyncFlushCond) < 0)
         return -1;
 
+    for (i = 0; i < VIR_LOG_ASYNC_QUEUE_SIZE; i++)
+        virLogAsyncRing[i].seq = i;
+
     virLogLock();
     virLogDefaultPriority = VIR_LOG_DEFAULT;
 
@@ -284,6 +348,9 @@ virLogReset(void)
         return -1;
 
     virLogLock();
+    /* The writer thread does not survive fork(), so this also makes
+     * sure a child only ever logs synchronously */
+    g_atomic_int_set(&virLogAsync, 0);
     virLogResetFilters();
     virLogResetOutputs();
     virLogDefaultPriority = VIR_LOG_DEFAULT;
@@ -313,7 +380,10 @@ virLogSetDefaultPriority(virLogPriority priority)
     if (virLogInitialize() < 0)
         return -1;
 
+    virLogLock();
     virLogDefaultPriority = priority;
+    virLogFiltersSerial++;
+    virLogUnlock();
     return 0;
 }
 
@@ -376,6 +446,7 @@ virLogResetOutputs(void)
     virLogOutputListFree(virLogOutputs, virLogNbOutputs);
     virLogOutputs = NULL;
     virLogNbOutputs = 0;
+    virLogFiltersSerial++;
 }
 
 
@@ -457,12 +528,18 @@ virLogHostnameString(char **rawmsg,
 }
 
 
+/*
+ * Computes the lowest priority @source needs to emit messages at, which
+ * is given by the filters, but also by the outputs: there's no point in
+ * formatting debug messages if no output takes them.
+ */
 static void
 virLogSourceUpdate(virLogSourcePtr source)
 {
     virLogLock();
     if (source->serial < virLogFiltersSerial) {
         unsigned int priority = virLogDefaultPriority;
+        unsigned int outputPriority = VIR_LOG_ERROR;
         size_t i;
 
         for (i = 0; i < virLogNbFilters; i++) {
@@ -472,80 +549,38 @@ virLogSourceUpdate(virLogSourcePtr source)
             }
         }
 
-        source->priority = priority;
+        /* without outputs, everything goes to stderr */
+        if (virLogNbOutputs == 0)
+            outputPriority = VIR_LOG_DEBUG;
+        for (i = 0; i < virLogNbOutputs; i++)
+            outputPriority = MIN(outputPriority,
+                                 MAX(virLogOutputs[i]->priority, VIR_LOG_DEBUG));
+
+        source->priority = MAX(priority, outputPriority);
         source->serial = virLogFiltersSerial;
     }
     virLogUnlock();
 }
 
 
-/**
- * virLogVMessage:
- * @source: where is that message coming from
- * @priority: the priority level
- * @filename: file where the message was emitted
- * @linenr: line where the message was emitted
- * @funcname: the function emitting the (debug) message
- * @metadata: NULL or metadata array, terminated by an item with NULL key
- * @fmt: the string format
- * @vargs: format args
- *
- * Call the libvirt logger with some information. Based on the configuration
- * the message may be stored, sent to output or just discarded
+/*
+ * Push the message to the outputs defined, if none exist then
+ * use stderr. Must be called with virLogLock held.
  */
 static void
-G_GNUC_PRINTF(7, 0)
-virLogVMessage(virLogSourcePtr source,
+virLogDispatch(virLogSourcePtr source,
                virLogPriority priority,
                const char *filename,
                int linenr,
                const char *funcname,
+               const char *timestamp,
                virLogMetadataPtr metadata,
-               const char *fmt,
-               va_list vargs)
+               const char *str,
+               const char *msg)
 {
     static bool logInitMessageStderr = true;
-    char *str = NULL;
-    char *msg = NULL;
-    char timestamp[VIR_TIME_STRING_BUFLEN];
     size_t i;
-    int saved_errno = errno;
-
-    if (virLogInitialize() < 0)
-        return;
 
-    if (fmt == NULL)
-        return;
-
-    /*
-     * 3 intentionally non-thread safe variable reads.
-     * Since writes to the variable are serialized on
-     * virLogLock, worst case result is a log message
-     * is accidentally dropped or emitted, if another
-     * thread is updating log filter list concurrently
-     * with a log message emission.
-     */
-    if (source->serial < virLogFiltersSerial)
-        virLogSourceUpdate(source);
-    if (priority < source->priority)
-        goto cleanup;
-
-    /*
-     * serialize the error message, add level and timestamp
-     */
-    str = g_strdup_vprintf(fmt, vargs);
-
-    virLogFormatString(&msg, linenr, funcname, priority, str);
-
-    if (virTimeStringNowRaw(timestamp) < 0)
-        timestamp[0] = '\0';
-
-    virLogLock();
-
-    /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
-     */
     for (i = 0; i < virLogNbOutputs; i++) {
         if (priority >= virLogOutputs[i]->priority) {
             if (virLogOutputs[i]->logInitMessage) {
@@ -600,6 +635,486 @@ virLogVMessage(virLogSourcePtr source,
                          timestamp, metadata,
                          str, msg, (void *) STDERR_FILENO);
     }
+}
+
+
+static virLogMetadataPtr
+virLogMetadataCopy(virLogMetadataPtr metadata)
+{
+    virLogMetadataPtr ret;
+    size_t n = 0;
+    size_t i;
+
+    if (!metadata)
+        return NULL;
+
+    while (metadata[n].key)
+        n++;
+
+    ret = g_new0(virLogMetadata, n + 1);
+    for (i = 0; i < n; i++) {
+        ret[i].key = g_strdup(metadata[i].key);
+        ret[i].s = g_strdup(metadata[i].s);
+        ret[i].iv = metadata[i].iv;
+    }
+
+    return ret;
+}
+
+
+static void
+virLogAsyncMessageFree(virLogAsyncMessagePtr msg)
+{
+    size_t i;
+
+    if (!msg)
+        return;
+
+    for (i = 0; msg->metadata && msg->metadata[i].key; i++) {
+        g_free((char *)msg->metadata[i].key);
+        g_free((char *)msg->metadata[i].s);
+    }
+    g_free(msg->metadata);
+    g_free(msg->str);
+    g_free(msg->msg);
+    g_free(msg);
+}
+
+
+/*
+ * Lock-free, can be called from any thread. Returns false if the
+ * ring is full, in which case the caller keeps ownership of @msg.
+ */
+static bool
+virLogAsyncEnqueue(virLogAsyncMessagePtr msg)
+{
+    unsigned int pos = g_atomic_int_get(&virLogAsyncHead);
+    virLogAsyncSlot *slot;
+
+    for (;;) {
+        int diff;
+
+        slot = &virLogAsyncRing[pos & (VIR_LOG_ASYNC_QUEUE_SIZE - 1)];
+        diff = (int)((unsigned int)g_atomic_int_get(&slot->seq) - pos);
+
+        if (diff == 0) {
+            if (g_atomic_int_compare_and_exchange(&virLogAsyncHead,
+                                                  (int)pos, (int)(pos + 1)))
+                break;
+        } else if (diff < 0) {
+            /* the writer did not consume this slot yet */
+            return false;
+        }
+
+        pos = g_atomic_int_get(&virLogAsyncHead);
+    }
+
+    slot->msg = msg;
+    g_atomic_int_set(&slot->seq, (int)(pos + 1));
+
+    if (g_atomic_int_get(&virLogAsyncIdle)) {
+        virMutexLock(&virLogAsyncMutex);
+        virCondSignal(&virLogAsyncCond);
+        virMutexUnlock(&virLogAsyncMutex);
+    }
+
+    return true;
+}
+
+
+/*
+ * Lock-free, can be called from any thread. Returns NULL if the ring
+ * is empty.
+ */
+static virLogAsyncMessagePtr
+virLogAsyncDequeue(void)
+{
+    unsigned int pos = g_atomic_int_get(&virLogAsyncTail);
+    virLogAsyncSlot *slot;
+    virLogAsyncMessagePtr msg;
+
+    for (;;) {
+        int diff;
+
+        slot = &virLogAsyncRing[pos & (VIR_LOG_ASYNC_QUEUE_SIZE - 1)];
+        diff = (int)((unsigned int)g_atomic_int_get(&slot->seq) - (pos + 1));
+
+        if (diff == 0) {
+            if (g_atomic_int_compare_and_exchange(&virLogAsyncTail,
+                                                  (int)pos, (int)(pos + 1)))
+                break;
+        } else if (diff < 0) {
+            return NULL;
+        }
+
+        pos = g_atomic_int_get(&virLogAsyncTail);
+    }
+
+    msg = g_steal_pointer(&slot->msg);
+    g_atomic_int_set(&slot->seq, (int)(pos + VIR_LOG_ASYNC_QUEUE_SIZE));
+
+    return msg;
+}
+
+
+static void
+virLogAsyncWriteFd(int fd,
+                   virLogAsyncMessagePtr msg)
+{
+    if (fd < 0)
+        return;
+
+    ignore_value(safewrite(fd, msg->timestamp, strlen(msg->timestamp)));
+    ignore_value(safewrite(fd, ": ", 2));
+    ignore_value(safewrite(fd, msg->msg, strlen(msg->msg)));
+}
+
+
+/*
+ * Writes whatever is left in the queue straight to the outputs backed
+ * by a file descriptor, without taking any lock or allocating memory,
+ * so that the messages leading to a crash are not lost. Other outputs
+ * are skipped as they can't be written to safely at this point. The
+ * messages are not freed either since the allocator may be unusable.
+ */
+static void
+virLogAsyncDrainUnlocked(void)
+{
+    virLogAsyncMessagePtr msg;
+    size_t i;
+
+    while ((msg = virLogAsyncDequeue())) {
+        for (i = 0; i < virLogNbOutputs; i++) {
+            virLogOutputPtr output = virLogOutputs[i];
+
+            if (msg->priority < output->priority)
+                continue;
+
+            if (output->dest == VIR_LOG_TO_STDERR ||
+                output->dest == VIR_LOG_TO_FILE)
+                virLogAsyncWriteFd((intptr_t) output->data, msg);
+        }
+
+        if (virLogNbOutputs == 0)
+            virLogAsyncWriteFd(STDERR_FILENO, msg);
+
+        g_atomic_int_inc(&virLogAsyncWritten);
+    }
+}
+
+
+#ifndef WIN32
+static const int virLogAsyncFatalSignals[] = {
+    SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV,
+};
+
+
+static void
+virLogAsyncFatalSignal(int sig)
+{
+    virLogAsyncDrainUnlocked();
+
+    /* The handler was reset to the default action on entry */
+    raise(sig);
+}
+
+
+/*
+ * Drain the queue before the process dies of a fatal signal, including
+ * the SIGABRT raised by abort(). Signals the application handles itself
+ * are left alone.
+ */
+static void
+virLogAsyncInstallSignalHandlers(void)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(virLogAsyncFatalSignals); i++) {
+        struct sigaction sa;
+        struct sigaction old;
+
+        if (sigaction(virLogAsyncFatalSignals[i], NULL, &old) < 0 ||
+            (old.sa_flags & SA_SIGINFO) ||
+            old.sa_handler != SIG_DFL)
+            continue;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = virLogAsyncFatalSignal;
+        sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+        sigemptyset(&sa.sa_mask);
+
+        ignore_value(sigaction(virLogAsyncFatalSignals[i], &sa, NULL));
+    }
+}
+#else /* WIN32 */
+static void
+virLogAsyncInstallSignalHandlers(void)
+{
+}
+#endif /* WIN32 */
+
+
+static void
+virLogAsyncAtExit(void)
+{
+    virLogFlush();
+}
+
+
+static void
+virLogAsyncReportDropped(unsigned int dropped)
+{
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    g_autofree char *str = NULL;
+    g_autofree char *msg = NULL;
+
+    str = g_strdup_printf("%u log messages dropped, log queue is full",
+                          dropped);
+    virLogFormatString(&msg, __LINE__, __func__, VIR_LOG_WARN, str);
+    if (virTimeStringNowRaw(timestamp) < 0)
+        timestamp[0] = '\0';
+
+    virLogDispatch(&virLogSelf, VIR_LOG_WARN, __FILE__, __LINE__, __func__,
+                   timestamp, NULL, str, msg);
+}
+
+
+static void
+virLogAsyncWriter(void *opaque G_GNUC_UNUSED)
+{
+    unsigned int reported = 0;
+
+    for (;;) {
+        virLogAsyncMessagePtr msg;
+        unsigned int dropped;
+        unsigned long long now;
+
+        while ((msg = virLogAsyncDequeue())) {
+            virLogLock();
+            virLogDispatch(msg->source, msg->priority,
+                           msg->filename, msg->linenr, msg->funcname,
+                           msg->timestamp, msg->metadata,
+                           msg->str, msg->msg);
+            virLogUnlock();
+            virLogAsyncMessageFree(msg);
+            g_atomic_int_inc(&virLogAsyncWritten);
+        }
+
+        dropped = (unsigned int)g_atomic_int_get(&virLogAsyncDropped);
+        if (dropped != reported) {
+            virLogLock();
+            virLogAsyncReportDropped(dropped - reported);
+            virLogUnlock();
+            reported = dropped;
+        }
+
+        virMutexLock(&virLogAsyncMutex);
+        virCondBroadcast(&virLogAsyncFlushCond);
+
+        g_atomic_int_set(&virLogAsyncIdle, 1);
+        /* re-check after announcing we're idle to not miss a wakeup */
+        if (g_atomic_int_get(&virLogAsyncTail) == g_atomic_int_get(&virLogAsyncHead) &&
+            virTimeMillisNow(&now) == 0)
+            ignore_value(virCondWaitUntil(&virLogAsyncCond, &virLogAsyncMutex,
+                                          now + VIR_LOG_ASYNC_IDLE_MS));
+        g_atomic_int_set(&virLogAsyncIdle, 0);
+
+        virMutexUnlock(&virLogAsyncMutex);
+    }
+}
+
+
+/**
+ * virLogFlush:
+ *
+ * Waits until all messages queued by the asynchronous logging mode at
+ * the time of the call have been written to the outputs, but no longer
+ * than a second. No-op in synchronous mode.
+ */
+void
+virLogFlush(void)
+{
+    unsigned int target;
+    unsigned long long deadline;
+
+    if (!g_atomic_int_get(&virLogAsyncStarted))
+        return;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return;
+    deadline += VIR_LOG_ASYNC_FLUSH_MS;
+
+    target = (unsigned int)g_atomic_int_get(&virLogAsyncHead);
+
+    virMutexLock(&virLogAsyncMutex);
+    virCondSignal(&virLogAsyncCond);
+    while ((int)((unsigned int)g_atomic_int_get(&virLogAsyncWritten) - target) < 0) {
+        if (virCondWaitUntil(&virLogAsyncFlushCond, &virLogAsyncMutex,
+                             deadline) < 0)
+            break;
+    }
+    virMutexUnlock(&virLogAsyncMutex);
+}
+
+
+/**
+ * virLogSetAsync:
+ * @async: whether to log asynchronously
+ *
+ * Switches between writing messages to the outputs from the emitting
+ * thread and handing them over to a dedicated writer thread. In the
+ * latter mode, warnings and lower priority messages are dropped rather
+ * than blocking the caller if the writer cannot keep up; errors are
+ * always written synchronously, once the queue has been flushed.
+ *
+ * Enabling the mode also makes sure the queue is flushed when the
+ * process exits and drained to the file descriptor based outputs when
+ * it dies of a fatal signal, including abort().
+ *
+ * Returns 0 on success, -1 in case of error.
+ */
+int
+virLogSetAsync(bool async)
+{
+    virThread thread;
+
+    if (virLogInitialize() < 0)
+        return -1;
+
+    if (async && !g_atomic_int_get(&virLogAsyncStarted)) {
+        if (virThreadCreateFull(&thread, false, virLogAsyncWriter,
+                                "log-writer", false, NULL) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create log writer thread"));
+            return -1;
+        }
+        g_atomic_int_set(&virLogAsyncStarted, 1);
+
+        ignore_value(atexit(virLogAsyncAtExit));
+        virLogAsyncInstallSignalHandlers();
+    }
+
+    if (!async)
+        virLogFlush();
+
+    g_atomic_int_set(&virLogAsync, async ? 1 : 0);
+    return 0;
+}
+
+
+bool
+virLogGetAsync(void)
+{
+    return g_atomic_int_get(&virLogAsync) != 0;
+}
+
+
+/**
+ * virLogGetAsyncDropped:
+ *
+ * Returns the number of messages dropped so far by the asynchronous
+ * logging mode because the queue was full.
+ */
+unsigned int
+virLogGetAsyncDropped(void)
+{
+    return (unsigned int)g_atomic_int_get(&virLogAsyncDropped);
+}
+
+
+/**
+ * virLogVMessage:
+ * @source: where is that message coming from
+ * @priority: the priority level
+ * @filename: file where the message was emitted
+ * @linenr: line where the message was emitted
+ * @funcname: the function emitting the (debug) message
+ * @metadata: NULL or metadata array, terminated by an item with NULL key
+ * @fmt: the string format
+ * @vargs: format args
+ *
+ * Call the libvirt logger with some information. Based on the configuration
+ * the message may be stored, sent to output or just discarded
+ */
+static void
+G_GNUC_PRINTF(7, 0)
+virLogVMessage(virLogSourcePtr source,
+               virLogPriority priority,
+               const char *filename,
+               int linenr,
+               const char *funcname,
+               virLogMetadataPtr metadata,
+               const char *fmt,
+               va_list vargs)
+{
+    char *str = NULL;
+    char *msg = NULL;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    int saved_errno = errno;
+
+    /* A source can only be up to date once logging is initialized,
+     * so disabled messages don't even need to go through virOnce */
+    if (source->serial == virLogFiltersSerial && priority < source->priority)
+        return;
+
+    if (virLogInitialize() < 0)
+        return;
+
+    if (fmt == NULL)
+        return;
+
+    /*
+     * 3 intentionally non-thread safe variable reads.
+     * Since writes to the variable are serialized on
+     * virLogLock, worst case result is a log message
+     * is accidentally dropped or emitted, if another
+     * thread is updating log filter list concurrently
+     * with a log message emission.
+     */
+    if (source->serial < virLogFiltersSerial)
+        virLogSourceUpdate(source);
+    if (priority < source->priority)
+        goto cleanup;
+
+    /*
+     * serialize the error message, add level and timestamp
+     */
+    str = g_strdup_vprintf(fmt, vargs);
+
+    virLogFormatString(&msg, linenr, funcname, priority, str);
+
+    if (virTimeStringNowRaw(timestamp) < 0)
+        timestamp[0] = '\0';
+
+    if (g_atomic_int_get(&virLogAsync)) {
+        if (priority < VIR_LOG_ERROR) {
+            virLogAsyncMessagePtr amsg = g_new0(virLogAsyncMessage, 1);
+
+            amsg->source = source;
+            amsg->priority = priority;
+            amsg->filename = filename;
+            amsg->linenr = linenr;
+            amsg->funcname = funcname;
+            memcpy(amsg->timestamp, timestamp, sizeof(timestamp));
+            amsg->metadata = virLogMetadataCopy(metadata);
+            amsg->str = g_steal_pointer(&str);
+            amsg->msg = g_steal_pointer(&msg);
+
+            if (!virLogAsyncEnqueue(amsg)) {
+                g_atomic_int_inc(&virLogAsyncDropped);
+                virLogAsyncMessageFree(amsg);
+            }
+            goto cleanup;
+        }
+
+        /* errors may be the last thing we log before dying, make sure
+         * they hit the outputs, after whatever was queued before them */
+        virLogFlush();
+    }
+
+    virLogLock();
+    virLogDispatch(source, priority, filename, linenr, funcname,
+                   timestamp, metadata, str, msg);
     virLogUnlock();
 
  cleanup:
@@ -1196,8 +1711,8 @@ virLogParseDefaultPriority(const char *priority)
 /**
  * virLogSetFromEnv:
  *
- * Sets virLogDefaultPriority, virLogFilters and virLogOutputs based on
- * environment variables.
+ * Sets virLogDefaultPriority, virLogFilters, virLogOutputs and the
+ * asynchronous logging mode based on environment variables.
  */
 void
 virLogSetFromEnv(void)
@@ -1216,6 +1731,9 @@ virLogSetFromEnv(void)
     debugEnv = getenv("LIBVIRT_LOG_OUTPUTS");
     if (debugEnv && *debugEnv)
         virLogSetOutputs(debugEnv);
+    debugEnv = getenv("LIBVIRT_LOG_ASYNC");
+    if (debugEnv && *debugEnv)
+        ignore_value(virLogSetAsync(STRNEQ(debugEnv, "0")));
 }
 
 
@@ -1400,6 +1918,7 @@ virLogDefineOutputs(virLogOutputPtr *outputs, size_t noutputs)
 
     virLogOutputs = outputs;
     virLogNbOutputs = noutputs;
+    virLogFiltersSerial++;
 
     virLogUnlock();
     return 0;
@@ -77,14 +77,32 @@ struct _virLogSource {
         .serial = 0, \
     }
 
+extern int virLogFiltersSerial;
+
+/*
+ * Whether a message of @priority from @src may be logged at all. Sources
+ * which are not up to date with the current filters and outputs always
+ * pass, virLogMessage() then refreshes them. Since this is checked at the
+ * call site, the arguments of disabled messages are not even evaluated.
+ */
+#define VIR_LOG_SOURCE_ENABLED(src, prio) \
+    ((src)->serial < virLogFiltersSerial || (prio) >= (src)->priority)
+
+#define VIR_LOG_INT(src, prio, filename, linenr, funcname, ...) \
+    do { \
+        if (VIR_LOG_SOURCE_ENABLED(src, prio)) \
+            virLogMessage(src, prio, filename, linenr, funcname, NULL, \
+                          __VA_ARGS__); \
+    } while (0)
+
 #define VIR_DEBUG_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_DEBUG, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_INT(src, VIR_LOG_DEBUG, filename, linenr, funcname, __VA_ARGS__)
 #define VIR_INFO_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_INFO, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_INT(src, VIR_LOG_INFO, filename, linenr, funcname, __VA_ARGS__)
 #define VIR_WARN_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_WARN, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_INT(src, VIR_LOG_WARN, filename, linenr, funcname, __VA_ARGS__)
 #define VIR_ERROR_INT(src, filename, linenr, funcname, ...) \
-    virLogMessage(src, VIR_LOG_ERROR, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_INT(src, VIR_LOG_ERROR, filename, linenr, funcname, __VA_ARGS__)
 
 #define VIR_DEBUG(...) \
     VIR_DEBUG_INT(&virLogSelf, __FILE__, __LINE__, __func__, __VA_ARGS__)
@@ -152,6 +170,10 @@ char *virLogGetOutputs(void);
 virLogPriority virLogGetDefaultPriority(void);
 int virLogSetDefaultPriority(virLogPriority priority);
 void virLogSetFromEnv(void);
+int virLogSetAsync(bool async);
+bool virLogGetAsync(void);
+unsigned int virLogGetAsyncDropped(void);
+void virLogFlush(void);
 void virLogOutputFree(virLogOutputPtr output);
 void virLogOutputListFree(virLogOutputPtr *list, int count);
 void virLogFilterFree(virLogFilterPtr filter);
@@ -40,7 +40,7 @@ virNetDevBandwidthFree(virNetDevBandwidthPtr def)
 }
 
 static void
-virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
+virNetDevBandwidthCmdAddOptimalQuantum(virBufferPtr buf,
                                        const virNetDevBandwidthRate *rate)
 {
     const unsigned long long mtu = 1500;
@@ -58,18 +58,74 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
     if (!r2q)
         r2q = 1;
 
-    virCommandAddArg(cmd, "quantum");
-    virCommandAddArgFormat(cmd, "%llu", r2q);
+    virBufferAsprintf(buf, " quantum %llu", r2q);
 }
 
 /**
- * virNetDevBandwidthManipulateFilter:
+ * virNetDevBandwidthRunBatch:
+ * @ifname: interface the commands in @batch operate on
+ * @batch: tc commands, one per line
+ * @ignore_errors: whether failing commands should be ignored
+ *
+ * Setting up QoS on an interface takes up to eight tc commands.
+ * Instead of spawning a tc process for each of them, the commands
+ * in @batch are fed into a single 'tc -batch' run. Without
+ * @ignore_errors, tc stops at the first failing command and the
+ * failure is reported. With @ignore_errors, tc is told to try all
+ * the commands ('-force') and its exit status is ignored, which
+ * is what we want when tearing things down: remove as much as
+ * possible.
+ *
+ * tc splits batch lines at whitespace, treats quotes specially and
+ * ignores everything after a '#' starting a word, so @ifname must
+ * not contain any of those. Such a name is refused rather than
+ * letting tc misparse the commands.
+ *
+ * The @batch buffer is emptied.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise (with error reported).
+ */
+static int
+virNetDevBandwidthRunBatch(const char *ifname,
+                           virBufferPtr batch,
+                           bool ignore_errors)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = virBufferContentAndReset(batch);
+    const char *c;
+    int dummy; /* for ignoring the exit status */
+
+    if (!input)
+        return 0;
+
+    for (c = ifname; *c; c++) {
+        if (g_ascii_isspace(*c) || strchr("#\"'\\", *c)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("Unable to set bandwidth for interface '%s' "
+                             "because its name contains whitespace, quotes, "
+                             "'#' or '\\'"),
+                           ifname);
+            return -1;
+        }
+    }
+
+    cmd = virCommandNew(TC);
+    if (ignore_errors)
+        virCommandAddArg(cmd, "-force");
+    virCommandAddArgList(cmd, "-batch", "-", NULL);
+    virCommandSetInputBuffer(cmd, input);
+
+    return virCommandRun(cmd, ignore_errors ? &dummy : NULL);
+}
+
+/**
+ * virNetDevBandwidthFilterAdd:
+ * @batch: where to append the tc command
  * @ifname: interface to operate on
  * @ifmac_ptr: MAC of the interface to create filter over
  * @id: filter ID
  * @class_id: where to place traffic
- * @remove_old: whether to remove the filter
- * @create_new: whether to create the filter
  *
  * TC filters are as crucial for traffic shaping as QDiscs. While
  * QDiscs act like black boxes deciding which packets should be
@@ -86,80 +142,46 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
  * an @id which should be unique (per @ifname). And @class_id
  * tells into which QDisc should filter place the traffic.
  *
- * This function can be used for both, removing stale filter
- * (@remove_old set to true) and creating new one (@create_new
- * set to true). Both at once for the same price!
- *
- * Returns: 0 on success,
- *         -1 otherwise (with error reported).
+ * Use virNetDevBandwidthFilterDel() to remove the filter again.
  */
-static int ATTRIBUTE_NONNULL(1)
-virNetDevBandwidthManipulateFilter(const char *ifname,
-                                   const virMacAddr *ifmac_ptr,
-                                   unsigned int id,
-                                   const char *class_id,
-                                   bool remove_old,
-                                   bool create_new)
+static void
+virNetDevBandwidthFilterAdd(virBufferPtr batch,
+                            const char *ifname,
+                            const virMacAddr *ifmac_ptr,
+                            unsigned int id,
+                            const char *class_id)
 {
-    int ret = -1;
-    char *filter_id = NULL;
-    virCommandPtr cmd = NULL;
     unsigned char ifmac[VIR_MAC_BUFLEN];
-    char *mac[2] = {NULL, NULL};
-
-    if (!(remove_old || create_new)) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("filter creation API error"));
-        goto cleanup;
-    }
-
-    /* u32 filters must have 800:: prefix. Don't ask. */
-    filter_id = g_strdup_printf("800::%u", id);
-
-    if (remove_old) {
-        int cmd_ret = 0;
-
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "del", "dev", ifname,
-                             "prio", "2", "handle",  filter_id, "u32", NULL);
-
-        if (virCommandRun(cmd, &cmd_ret) < 0)
-            goto cleanup;
 
-    }
-
-    if (create_new) {
-        virMacAddrGetRaw(ifmac_ptr, ifmac);
-
-        mac[0] = g_strdup_printf("0x%02x%02x%02x%02x", ifmac[2],
-                                 ifmac[3], ifmac[4], ifmac[5]);
-        mac[1] = g_strdup_printf("0x%02x%02x", ifmac[0], ifmac[1]);
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        /* Okay, this not nice. But since libvirt does not necessarily track
-         * interface IP address(es), and tc fw filter simply refuse to use
-         * ebtables marks, we need to use u32 selector to match MAC address.
-         * If libvirt will ever know something, remove this FIXME
-         */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "protocol", "ip",
-                             "prio", "2", "handle", filter_id, "u32",
-                             "match", "u16", "0x0800", "0xffff", "at", "-2",
-                             "match", "u32", mac[0], "0xffffffff", "at", "-12",
-                             "match", "u16", mac[1], "0xffff", "at", "-14",
-                             "flowid", class_id, NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-    }
+    virMacAddrGetRaw(ifmac_ptr, ifmac);
+
+    /* Okay, this not nice. But since libvirt does not necessarily track
+     * interface IP address(es), and tc fw filter simply refuse to use
+     * ebtables marks, we need to use u32 selector to match MAC address.
+     * If libvirt will ever know something, remove this FIXME
+     *
+     * u32 filters must have 800:: prefix. Don't ask.
+     */
+    virBufferAsprintf(batch,
+                      "filter add dev %s protocol ip prio 2 handle 800::%u u32 "
+                      "match u16 0x0800 0xffff at -2 "
+                      "match u32 0x%02x%02x%02x%02x 0xffffffff at -12 "
+                      "match u16 0x%02x%02x 0xffff at -14 "
+                      "flowid %s\n",
+                      ifname, id,
+                      ifmac[2], ifmac[3], ifmac[4], ifmac[5],
+                      ifmac[0], ifmac[1],
+                      class_id);
+}
 
-    ret = 0;
- cleanup:
-    VIR_FREE(mac[1]);
-    VIR_FREE(mac[0]);
-    VIR_FREE(filter_id);
-    virCommandFree(cmd);
-    return ret;
+static void
+virNetDevBandwidthFilterDel(virBufferPtr batch,
+                            const char *ifname,
+                            unsigned int id)
+{
+    virBufferAsprintf(batch,
+                      "filter del dev %s prio 2 handle 800::%u u32\n",
+                      ifname, id);
 }
 
 
@@ -192,17 +214,12 @@ virNetDevBandwidthSet(const char *ifname,
                       bool hierarchical_class,
                       bool swapped)
 {
-    int ret = -1;
     virNetDevBandwidthRatePtr rx = NULL, tx = NULL; /* From domain POV */
-    virCommandPtr cmd = NULL;
-    char *average = NULL;
-    char *peak = NULL;
-    char *burst = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
 
     if (!bandwidth) {
         /* nothing to be enabled */
-        ret = 0;
-        goto cleanup;
+        return 0;
     }
 
     if (geteuid() != 0) {
@@ -230,18 +247,9 @@ virNetDevBandwidthSet(const char *ifname,
     virNetDevBandwidthClear(ifname);
 
     if (tx && tx->average) {
-        average = g_strdup_printf("%llukbps", tx->average);
-        if (tx->peak)
-            peak = g_strdup_printf("%llukbps", tx->peak);
-        if (tx->burst)
-            burst = g_strdup_printf("%llukb", tx->burst);
-
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "root",
-                             "handle", "1:", "htb", "default",
-                             hierarchical_class ? "2" : "1", NULL);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&batch,
+                          "qdisc add dev %s root handle 1: htb default %s\n",
+                          ifname, hierarchical_class ? "2" : "1");
 
         /* If we are creating a hierarchical class, all non guaranteed traffic
          * goes to the 1:2 class which will adjust 'rate' dynamically as NICs
@@ -307,88 +315,53 @@ virNetDevBandwidthSet(const char *ifname,
          * it before you dig into the code.
          */
         if (hierarchical_class) {
-            virCommandFree(cmd);
-            cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                                 "1:", "classid", "1:1", "htb", "rate", average,
-                                 "ceil", peak ? peak : average, NULL);
-            virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-            if (virCommandRun(cmd, NULL) < 0)
-                goto cleanup;
+            virBufferAsprintf(&batch,
+                              "class add dev %s parent 1: classid 1:1 htb "
+                              "rate %llukbps ceil %llukbps",
+                              ifname, tx->average,
+                              tx->peak ? tx->peak : tx->average);
+            virNetDevBandwidthCmdAddOptimalQuantum(&batch, tx);
+            virBufferAddLit(&batch, "\n");
         }
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:1" : "1:", "classid",
-                             hierarchical_class ? "1:2" : "1:1", "htb",
-                             "rate", average, NULL);
-
-        if (peak)
-            virCommandAddArgList(cmd, "ceil", peak, NULL);
-        if (burst)
-            virCommandAddArgList(cmd, "burst", burst, NULL);
-
-        virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:2" : "1:1",
-                             "handle", "2:", "sfq", "perturb",
-                             "10", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "1:0", "protocol", "all", "prio", "1", "handle",
-                             "1", "fw", "flowid", "1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        VIR_FREE(average);
-        VIR_FREE(peak);
-        VIR_FREE(burst);
-    }
+        virBufferAsprintf(&batch,
+                          "class add dev %s parent %s classid %s htb "
+                          "rate %llukbps",
+                          ifname,
+                          hierarchical_class ? "1:1" : "1:",
+                          hierarchical_class ? "1:2" : "1:1",
+                          tx->average);
 
-    if (rx) {
-        average = g_strdup_printf("%llukbps", rx->average);
-        burst = g_strdup_printf("%llukb", rx->burst ? rx->burst : rx->average);
+        if (tx->peak)
+            virBufferAsprintf(&batch, " ceil %llukbps", tx->peak);
+        if (tx->burst)
+            virBufferAsprintf(&batch, " burst %llukb", tx->burst);
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname,
-                                 "ingress", NULL);
+        virNetDevBandwidthCmdAddOptimalQuantum(&batch, tx);
+        virBufferAddLit(&batch, "\n");
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&batch,
+                          "qdisc add dev %s parent %s handle 2: sfq perturb 10\n",
+                          ifname, hierarchical_class ? "1:2" : "1:1");
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        /* Set filter to match all ingress traffic */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "ffff:", "protocol", "all", "u32", "match", "u32",
-                             "0", "0", "police", "rate", average,
-                             "burst", burst, "mtu", "64kb", "drop", "flowid",
-                             ":1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&batch,
+                          "filter add dev %s parent 1:0 protocol all prio 1 "
+                          "handle 1 fw flowid 1\n",
+                          ifname);
     }
 
-    ret = 0;
+    if (rx) {
+        virBufferAsprintf(&batch, "qdisc add dev %s ingress\n", ifname);
+
+        /* Set filter to match all ingress traffic */
+        virBufferAsprintf(&batch,
+                          "filter add dev %s parent ffff: protocol all u32 "
+                          "match u32 0 0 police rate %llukbps burst %llukb "
+                          "mtu 64kb drop flowid :1\n",
+                          ifname, rx->average,
+                          rx->burst ? rx->burst : rx->average);
+    }
 
- cleanup:
-    virCommandFree(cmd);
-    VIR_FREE(average);
-    VIR_FREE(peak);
-    VIR_FREE(burst);
-    return ret;
+    return virNetDevBandwidthRunBatch(ifname, &batch, false);
 }
 
 /**
@@ -404,30 +377,15 @@ virNetDevBandwidthSet(const char *ifname,
 int
 virNetDevBandwidthClear(const char *ifname)
 {
-    int ret = 0;
-    int dummy; /* for ignoring the exit status */
-    virCommandPtr cmd = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
 
     if (!ifname)
        return 0;
 
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", ifname, "root", NULL);
-
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
-
-    virCommandFree(cmd);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc",  "del", "dev", ifname, "ingress", NULL);
-
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
+    virBufferAsprintf(&batch, "qdisc del dev %s root\n", ifname);
+    virBufferAsprintf(&batch, "qdisc del dev %s ingress\n", ifname);
 
-    virCommandFree(cmd);
-
-    return ret;
+    return virNetDevBandwidthRunBatch(ifname, &batch, true);
 }
 
 /*
@@ -531,12 +489,8 @@ virNetDevBandwidthPlug(const char *brname,
                        virNetDevBandwidthPtr bandwidth,
                        unsigned int id)
 {
-    int ret = -1;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *qdisc_id = NULL;
-    char *floor = NULL;
-    char *ceil = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
+    g_autofree char *class_id = NULL;
     char ifmacStr[VIR_MAC_STRING_BUFLEN];
 
     if (id <= 2) {
@@ -555,43 +509,24 @@ virNetDevBandwidthPlug(const char *brname,
     }
 
     class_id = g_strdup_printf("1:%x", id);
-    qdisc_id = g_strdup_printf("%x:", id);
-    floor = g_strdup_printf("%llukbps", bandwidth->in->floor);
-    ceil = g_strdup_printf("%llukbps", net_bandwidth->in->peak ?
-                           net_bandwidth->in->peak :
-                           net_bandwidth->in->average);
 
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "add", "dev", brname, "parent", "1:1",
-                         "classid", class_id, "htb", "rate", floor,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
+    virBufferAsprintf(&batch,
+                      "class add dev %s parent 1:1 classid %s htb "
+                      "rate %llukbps ceil %llukbps",
+                      brname, class_id, bandwidth->in->floor,
+                      net_bandwidth->in->peak ?
+                      net_bandwidth->in->peak :
+                      net_bandwidth->in->average);
+    virNetDevBandwidthCmdAddOptimalQuantum(&batch, bandwidth->in);
+    virBufferAddLit(&batch, "\n");
 
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
+    virBufferAsprintf(&batch,
+                      "qdisc add dev %s parent %s handle %x: sfq perturb 10\n",
+                      brname, class_id, id);
 
-    virCommandFree(cmd);
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "add", "dev", brname, "parent",
-                         class_id, "handle", qdisc_id, "sfq", "perturb",
-                         "10", NULL);
-
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    if (virNetDevBandwidthManipulateFilter(brname, ifmac_ptr, id,
-                                           class_id, false, true) < 0)
-        goto cleanup;
-
-    ret = 0;
-
- cleanup:
-    VIR_FREE(ceil);
-    VIR_FREE(floor);
-    VIR_FREE(qdisc_id);
-    VIR_FREE(class_id);
-    virCommandFree(cmd);
-    return ret;
+    virNetDevBandwidthFilterAdd(&batch, brname, ifmac_ptr, id, class_id);
+
+    return virNetDevBandwidthRunBatch(brname, &batch, false);
 }
 
 /*
@@ -607,48 +542,20 @@ int
 virNetDevBandwidthUnplug(const char *brname,
                          unsigned int id)
 {
-    int ret = -1;
-    int cmd_ret = 0;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *qdisc_id = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
 
     if (id <= 2) {
         virReportError(VIR_ERR_INTERNAL_ERROR, _("Invalid class ID %d"), id);
         return -1;
     }
 
-    class_id = g_strdup_printf("1:%x", id);
-    qdisc_id = g_strdup_printf("%x:", id);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", brname,
-                         "handle", qdisc_id, NULL);
+    virBufferAsprintf(&batch, "qdisc del dev %s handle %x:\n", brname, id);
+    virNetDevBandwidthFilterDel(&batch, brname, id);
+    virBufferAsprintf(&batch, "class del dev %s classid 1:%x\n", brname, id);
 
     /* Don't threat tc errors as fatal, but
      * try to remove as much as possible */
-    if (virCommandRun(cmd, &cmd_ret) < 0)
-        goto cleanup;
-
-    if (virNetDevBandwidthManipulateFilter(brname, NULL, id,
-                                           NULL, true, false) < 0)
-        goto cleanup;
-
-    virCommandFree(cmd);
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "del", "dev", brname,
-                         "classid", class_id, NULL);
-
-    if (virCommandRun(cmd, &cmd_ret) < 0)
-        goto cleanup;
-
-    ret = 0;
-
- cleanup:
-    VIR_FREE(qdisc_id);
-    VIR_FREE(class_id);
-    virCommandFree(cmd);
-    return ret;
+    return virNetDevBandwidthRunBatch(brname, &batch, true);
 }
 
 /**
@@ -671,35 +578,19 @@ virNetDevBandwidthUpdateRate(const char *ifname,
                              virNetDevBandwidthPtr bandwidth,
                              unsigned long long new_rate)
 {
-    int ret = -1;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *rate = NULL;
-    char *ceil = NULL;
-
-    class_id = g_strdup_printf("1:%x", id);
-    rate = g_strdup_printf("%llukbps", new_rate);
-    ceil = g_strdup_printf("%llukbps", bandwidth->in->peak ?
-                           bandwidth->in->peak :
-                           bandwidth->in->average);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "change", "dev", ifname,
-                         "classid", class_id, "htb", "rate", rate,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
-
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    ret = 0;
-
- cleanup:
-    virCommandFree(cmd);
-    VIR_FREE(class_id);
-    VIR_FREE(rate);
-    VIR_FREE(ceil);
-    return ret;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
+
+    virBufferAsprintf(&batch,
+                      "class change dev %s classid 1:%x htb "
+                      "rate %llukbps ceil %llukbps",
+                      ifname, id, new_rate,
+                      bandwidth->in->peak ?
+                      bandwidth->in->peak :
+                      bandwidth->in->average);
+    virNetDevBandwidthCmdAddOptimalQuantum(&batch, bandwidth->in);
+    virBufferAddLit(&batch, "\n");
+
+    return virNetDevBandwidthRunBatch(ifname, &batch, false);
 }
 
 /**
@@ -724,17 +615,17 @@ virNetDevBandwidthUpdateFilter(const char *ifname,
                                const virMacAddr *ifmac_ptr,
                                unsigned int id)
 {
-    int ret = -1;
-    char *class_id = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
+    g_autofree char *class_id = NULL;
 
     class_id = g_strdup_printf("1:%x", id);
 
-    if (virNetDevBandwidthManipulateFilter(ifname, ifmac_ptr, id,
-                                           class_id, true, true) < 0)
-        goto cleanup;
+    /* The old filter may be missing, ignore errors in removing it */
+    virNetDevBandwidthFilterDel(&batch, ifname, id);
+    if (virNetDevBandwidthRunBatch(ifname, &batch, true) < 0)
+        return -1;
+
+    virNetDevBandwidthFilterAdd(&batch, ifname, ifmac_ptr, id, class_id);
 
-    ret = 0;
- cleanup:
-    VIR_FREE(class_id);
-    return ret;
+    return virNetDevBandwidthRunBatch(ifname, &batch, false);
 }
@@ -29,6 +29,8 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virnetlink.h"
 #include "datatypes.h"
 
 #include <unistd.h>
@@ -947,3 +949,162 @@ virNetDevTapInterfaceStats(const char *ifname G_GNUC_UNUSED,
 }
 
 #endif /* __linux__ */
+
+
+struct _virNetDevTapStats {
+    /* interface name -> virDomainInterfaceStats as seen by the host */
+    virHashTablePtr ifaces;
+};
+
+
+void
+virNetDevTapStatsFree(virNetDevTapStatsPtr snapshot)
+{
+    if (!snapshot)
+        return;
+
+    virHashFree(snapshot->ifaces);
+    g_free(snapshot);
+}
+
+
+#if defined(__linux__) && defined(WITH_LIBNL)
+static int
+virNetDevTapStatsParseLink(struct nlmsghdr *resp,
+                           void *opaque)
+{
+    virNetDevTapStatsPtr snapshot = opaque;
+    struct nlattr *tb[IFLA_MAX + 1] = { NULL, };
+    struct rtnl_link_stats64 link;
+    g_autofree virDomainInterfaceStatsPtr stats = NULL;
+
+    if (resp->nlmsg_type != RTM_NEWLINK)
+        return 0;
+
+    if (nlmsg_parse(resp, sizeof(struct ifinfomsg), tb, IFLA_MAX, NULL) < 0)
+        return 0;
+
+    /* Links without statistics are left out of the snapshot, looking
+     * them up falls back to /proc/net/dev. */
+    if (!tb[IFLA_IFNAME] || !tb[IFLA_STATS64] ||
+        nla_len(tb[IFLA_STATS64]) < (int) sizeof(link))
+        return 0;
+
+    memcpy(&link, nla_data(tb[IFLA_STATS64]), sizeof(link));
+
+    /* Compute the values the same way /proc/net/dev does */
+    stats = g_new0(virDomainInterfaceStats, 1);
+    stats->rx_bytes = link.rx_bytes;
+    stats->rx_packets = link.rx_packets;
+    stats->rx_errs = link.rx_errors;
+    stats->rx_drop = link.rx_dropped + link.rx_missed_errors;
+    stats->tx_bytes = link.tx_bytes;
+    stats->tx_packets = link.tx_packets;
+    stats->tx_errs = link.tx_errors;
+    stats->tx_drop = link.tx_dropped;
+
+    if (virHashUpdateEntry(snapshot->ifaces,
+                           nla_get_string(tb[IFLA_IFNAME]), stats) < 0)
+        return -1;
+
+    stats = NULL;
+    return 0;
+}
+
+
+/**
+ * virNetDevTapStatsNew:
+ *
+ * Take a snapshot of RX/TX statistics of all interfaces on the host
+ * with a single RTM_GETLINK dump. This is meant for callers that
+ * need statistics of many interfaces at once: querying each of them
+ * with virNetDevTapInterfaceStats() reads and parses whole
+ * /proc/net/dev every time.
+ *
+ * Returns the snapshot to be used with virNetDevTapStatsLookup(), or
+ * NULL on error (with error reported).
+ */
+virNetDevTapStatsPtr
+virNetDevTapStatsNew(void)
+{
+    g_autoptr(virNetDevTapStats) snapshot = NULL;
+    g_autoptr(virNetlinkMsg) nl_msg = NULL;
+    struct ifinfomsg ifinfo = {
+        .ifi_family = AF_UNSPEC,
+    };
+
+    snapshot = g_new0(virNetDevTapStats, 1);
+    snapshot->ifaces = virHashNew(g_free);
+
+    nl_msg = nlmsg_alloc_simple(RTM_GETLINK, NLM_F_DUMP | NLM_F_REQUEST);
+    if (!nl_msg) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nl_msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return NULL;
+    }
+
+    if (virNetlinkDumpCommand(nl_msg, virNetDevTapStatsParseLink,
+                              0, 0, NETLINK_ROUTE, 0, snapshot) < 0)
+        return NULL;
+
+    return g_steal_pointer(&snapshot);
+}
+#else
+virNetDevTapStatsPtr
+virNetDevTapStatsNew(void)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Unable to dump interface statistics on this platform"));
+    return NULL;
+}
+#endif /* defined(__linux__) && defined(WITH_LIBNL) */
+
+
+/**
+ * virNetDevTapStatsLookup:
+ * @snapshot: snapshot taken by virNetDevTapStatsNew() (may be NULL)
+ * @ifname: interface
+ * @stats: where to store statistics
+ * @swapped: whether to swap RX/TX fields
+ *
+ * Same as virNetDevTapInterfaceStats() but takes the statistics
+ * from @snapshot. Interfaces missing in @snapshot, e.g. because they
+ * were created after it was taken, and all interfaces if @snapshot
+ * is NULL are queried using virNetDevTapInterfaceStats().
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+int
+virNetDevTapStatsLookup(virNetDevTapStatsPtr snapshot,
+                        const char *ifname,
+                        virDomainInterfaceStatsPtr stats,
+                        bool swapped)
+{
+    virDomainInterfaceStatsPtr host = NULL;
+
+    if (snapshot && ifname)
+        host = virHashLookup(snapshot->ifaces, ifname);
+
+    if (!host)
+        return virNetDevTapInterfaceStats(ifname, stats, swapped);
+
+    if (swapped) {
+        stats->rx_bytes = host->tx_bytes;
+        stats->rx_packets = host->tx_packets;
+        stats->rx_errs = host->tx_errs;
+        stats->rx_drop = host->tx_drop;
+        stats->tx_bytes = host->rx_bytes;
+        stats->tx_packets = host->rx_packets;
+        stats->tx_errs = host->rx_errs;
+        stats->tx_drop = host->rx_drop;
+    } else {
+        *stats = *host;
+    }
+
+    return 0;
+}
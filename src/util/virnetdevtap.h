@@ -109,3 +109,17 @@ int virNetDevTapInterfaceStats(const char *ifname,
                                virDomainInterfaceStatsPtr stats,
                                bool swapped)
     G_GNUC_WARN_UNUSED_RESULT;
+
+typedef struct _virNetDevTapStats virNetDevTapStats;
+typedef virNetDevTapStats *virNetDevTapStatsPtr;
+
+virNetDevTapStatsPtr virNetDevTapStatsNew(void);
+
+void virNetDevTapStatsFree(virNetDevTapStatsPtr snapshot);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virNetDevTapStats, virNetDevTapStatsFree);
+
+int virNetDevTapStatsLookup(virNetDevTapStatsPtr snapshot,
+                            const char *ifname,
+                            virDomainInterfaceStatsPtr stats,
+                            bool swapped)
+    G_GNUC_WARN_UNUSED_RESULT;
@@ -76,7 +76,8 @@ int virNetlinkDumpCommand(struct nl_msg *nl_msg,
                           virNetlinkDumpCallback callback,
                           uint32_t src_pid, uint32_t dst_pid,
                           unsigned int protocol, unsigned int groups,
-                          void *opaque);
+                          void *opaque)
+    G_GNUC_NO_INLINE;
 
 typedef struct _virNetlinkNewLinkData virNetlinkNewLinkData;
 typedef virNetlinkNewLinkData *virNetlinkNewLinkDataPtr;
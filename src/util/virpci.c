@@ -34,6 +34,7 @@
 #include "vircommand.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virkmod.h"
 #include "virstring.h"
 #include "viralloc.h"
@@ -92,6 +93,10 @@ struct _virPCIDeviceList {
 
     size_t count;
     virPCIDevicePtr *devs;
+
+    /* Devices in @devs indexed by their address formatted using
+     * VIR_PCI_DEVICE_ADDRESS_FMT. The hash table doesn't own them. */
+    virHashTablePtr index;
 };
 
 
@@ -1558,6 +1563,11 @@ virPCIDeviceListNew(void)
     if (!(list = virObjectLockableNew(virPCIDeviceListClass)))
         return NULL;
 
+    if (!(list->index = virHashNew(NULL))) {
+        virObjectUnref(list);
+        return NULL;
+    }
+
     return list;
 }
 
@@ -1574,18 +1584,30 @@ virPCIDeviceListDispose(void *obj)
 
     list->count = 0;
     VIR_FREE(list->devs);
+    virHashFree(list->index);
 }
 
 int
 virPCIDeviceListAdd(virPCIDeviceListPtr list,
                     virPCIDevicePtr dev)
 {
-    if (virPCIDeviceListFind(list, dev)) {
+    g_autofree char *key = virPCIDeviceAddressAsString(&dev->address);
+
+    if (virHashHasEntry(list->index, key)) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Device %s is already in use"), dev->name);
         return -1;
     }
-    return VIR_APPEND_ELEMENT(list->devs, list->count, dev);
+
+    if (virHashAddEntry(list->index, key, dev) < 0)
+        return -1;
+
+    if (VIR_APPEND_ELEMENT(list->devs, list->count, dev) < 0) {
+        virHashRemoveEntry(list->index, key);
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -1628,12 +1650,17 @@ virPCIDeviceListStealIndex(virPCIDeviceListPtr list,
                            int idx)
 {
     virPCIDevicePtr ret;
+    g_autofree char *key = NULL;
 
     if (idx < 0 || idx >= list->count)
         return NULL;
 
     ret = list->devs[idx];
     VIR_DELETE_ELEMENT(list->devs, idx, list->count);
+
+    key = virPCIDeviceAddressAsString(&ret->address);
+    virHashRemoveEntry(list->index, key);
+
     return ret;
 }
 
@@ -1654,14 +1681,16 @@ virPCIDeviceListDel(virPCIDeviceListPtr list,
 int
 virPCIDeviceListFindIndex(virPCIDeviceListPtr list, virPCIDevicePtr dev)
 {
+    virPCIDevicePtr other;
     size_t i;
 
+    /* Only the position of the device is looked up by a linear
+     * scan, comparing pointers is cheap. */
+    if (!(other = virPCIDeviceListFind(list, dev)))
+        return -1;
+
     for (i = 0; i < list->count; i++) {
-        virPCIDevicePtr other = list->devs[i];
-        if (other->address.domain   == dev->address.domain &&
-            other->address.bus      == dev->address.bus    &&
-            other->address.slot     == dev->address.slot   &&
-            other->address.function == dev->address.function)
+        if (list->devs[i] == other)
             return i;
     }
     return -1;
@@ -1675,29 +1704,24 @@ virPCIDeviceListFindByIDs(virPCIDeviceListPtr list,
                           unsigned int slot,
                           unsigned int function)
 {
-    size_t i;
+    virPCIDeviceAddress addr = {
+        .domain = domain,
+        .bus = bus,
+        .slot = slot,
+        .function = function,
+    };
+    g_autofree char *key = virPCIDeviceAddressAsString(&addr);
 
-    for (i = 0; i < list->count; i++) {
-        virPCIDevicePtr other = list->devs[i];
-        if (other->address.domain   == domain &&
-            other->address.bus      == bus    &&
-            other->address.slot     == slot   &&
-            other->address.function == function)
-            return list->devs[i];
-    }
-    return NULL;
+    return virHashLookup(list->index, key);
 }
 
 
 virPCIDevicePtr
 virPCIDeviceListFind(virPCIDeviceListPtr list, virPCIDevicePtr dev)
 {
-    int idx;
+    g_autofree char *key = virPCIDeviceAddressAsString(&dev->address);
 
-    if ((idx = virPCIDeviceListFindIndex(list, dev)) >= 0)
-        return list->devs[idx];
-    else
-        return NULL;
+    return virHashLookup(list->index, key);
 }
 
 
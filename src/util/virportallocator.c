@@ -42,6 +42,7 @@ typedef virPortAllocator *virPortAllocatorPtr;
 struct _virPortAllocator {
     virObjectLockable parent;
     virBitmapPtr bitmap;
+    virBitmapPtr probing; /* ports being probed by virPortAllocatorAcquire */
 };
 
 struct _virPortAllocatorRange {
@@ -60,6 +61,7 @@ virPortAllocatorDispose(void *obj)
     virPortAllocatorPtr pa = obj;
 
     virBitmapFree(pa->bitmap);
+    virBitmapFree(pa->probing);
 }
 
 static virPortAllocatorPtr
@@ -71,6 +73,7 @@ virPortAllocatorNew(void)
         return NULL;
 
     pa->bitmap = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS);
+    pa->probing = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS);
 
     return pa;
 }
@@ -201,12 +204,22 @@ virPortAllocatorGet(void)
     return virPortAllocatorInstance;
 }
 
+/*
+ * Ports reserved in the bitmap are skipped using a next-clear-bit
+ * search. A free candidate is marked in the probing bitmap before its
+ * availability on the host is probed by binding to it, so that the
+ * probing itself, which involves several syscalls per port, can be
+ * done without holding the allocator lock. Concurrent callers therefore
+ * never probe the same port and do not wait for each other's probes.
+ * The port is only reserved once the probe succeeded, unless
+ * virPortAllocatorSetUsed claimed it in the meantime.
+ */
 int
 virPortAllocatorAcquire(const virPortAllocatorRange *range,
                         unsigned short *port)
 {
     int ret = -1;
-    size_t i;
+    ssize_t i;
     virPortAllocatorPtr pa = virPortAllocatorGet();
 
     *port = 0;
@@ -216,33 +229,57 @@ virPortAllocatorAcquire(const virPortAllocatorRange *range,
 
     virObjectLock(pa);
 
-    for (i = range->start; i <= range->end && !*port; i++) {
+    i = range->start;
+    while ((i = virBitmapNextClearBit(pa->bitmap, i - 1)) >= 0 &&
+           i <= range->end) {
         bool used = false, v6used = false;
+        int rc;
 
-        if (virBitmapIsBitSet(pa->bitmap, i))
+        /* Another caller is probing this port already */
+        if (virBitmapIsBitSet(pa->probing, i)) {
+            i++;
             continue;
+        }
 
-        if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
-            virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
+        if (virBitmapSetBit(pa->probing, i) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to reserve port %zd"), i);
             goto cleanup;
+        }
+
+        virObjectUnlock(pa);
+
+        rc = virPortAllocatorBindToPort(&v6used, i, AF_INET6);
+        if (rc == 0)
+            rc = virPortAllocatorBindToPort(&used, i, AF_INET);
+
+        virObjectLock(pa);
+
+        ignore_value(virBitmapClearBit(pa->probing, i));
 
-        if (!used && !v6used) {
-            /* Add port to bitmap of reserved ports */
+        if (rc < 0)
+            goto cleanup;
+
+        /* The port may have been claimed by virPortAllocatorSetUsed
+         * while it was being probed */
+        if (!used && !v6used && !virBitmapIsBitSet(pa->bitmap, i)) {
             if (virBitmapSetBit(pa->bitmap, i) < 0) {
                 virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Failed to reserve port %zu"), i);
+                               _("Failed to reserve port %zd"), i);
                 goto cleanup;
             }
+
             *port = i;
             ret = 0;
+            goto cleanup;
         }
-    }
 
-    if (*port == 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unable to find an unused port in range '%s' (%d-%d)"),
-                       range->name, range->start, range->end);
+        i++;
     }
+
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("Unable to find an unused port in range '%s' (%d-%d)"),
+                   range->name, range->start, range->end);
  cleanup:
     virObjectUnlock(pa);
     return ret;
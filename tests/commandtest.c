@@ -1182,6 +1182,99 @@ test28(const void *unused G_GNUC_UNUSED)
 }
 
 
+static int
+test29Hook(void *opaque G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+# define TEST29_SPAWNS 200
+
+/*
+ * Measure how long it takes to start and reap a trivial child. A
+ * pre-exec hook forces the fork() based path, without one the command
+ * can be started without copying our address space.
+ */
+static int test29(const void *unused G_GNUC_UNUSED)
+{
+    size_t i;
+    int j;
+
+    for (j = 0; j < 2; j++) {
+        bool hook = j == 1;
+        gint64 start = g_get_monotonic_time();
+
+        for (i = 0; i < TEST29_SPAWNS; i++) {
+            g_autoptr(virCommand) cmd = virCommandNew("true");
+            int status;
+
+            if (hook)
+                virCommandSetPreExecHook(cmd, test29Hook, NULL);
+
+            if (virCommandRun(cmd, &status) < 0)
+                return -1;
+            if (status != 0) {
+                printf("Unexpected exit status %d\n", status);
+                return -1;
+            }
+        }
+
+        VIR_TEST_DEBUG("%s: %d spawns, %.1f us per spawn",
+                       hook ? "fork" : "spawn", TEST29_SPAWNS,
+                       (double)(g_get_monotonic_time() - start) / TEST29_SPAWNS);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Failures in the child must be reported with the same exit status
+ * regardless of how the child was started.
+ */
+static int test30(const void *unused G_GNUC_UNUSED)
+{
+    struct {
+        const char *binary;
+        const char *pwd;
+        int status;
+    } cases[] = {
+        { "/nonexistent/binary", NULL, EXIT_ENOENT },
+        { "/dev/null", NULL, EXIT_CANNOT_INVOKE },
+        { "true", "/nonexistent/directory", EXIT_CANCELED },
+    };
+    size_t i;
+    int j;
+
+    for (j = 0; j < 2; j++) {
+        bool hook = j == 1;
+
+        for (i = 0; i < G_N_ELEMENTS(cases); i++) {
+            g_autoptr(virCommand) cmd = virCommandNew(cases[i].binary);
+            g_autofree char *errbuf = NULL;
+            int status;
+
+            if (hook)
+                virCommandSetPreExecHook(cmd, test29Hook, NULL);
+            if (cases[i].pwd)
+                virCommandSetWorkingDirectory(cmd, cases[i].pwd);
+            virCommandSetErrorBuffer(cmd, &errbuf);
+
+            if (virCommandRun(cmd, &status) < 0)
+                return -1;
+            if (status != cases[i].status) {
+                printf("%s: expected exit status %d for %s, got %d\n",
+                       hook ? "fork" : "spawn", cases[i].status,
+                       cases[i].binary, status);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -1280,6 +1373,8 @@ mymain(void)
     DO_TEST(test26);
     DO_TEST(test27);
     DO_TEST(test28);
+    DO_TEST(test29);
+    DO_TEST(test30);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -626,6 +626,52 @@ cpuTestCPUID(bool guest, const void *arg)
 }
 
 
+/* Measures host CPU decoding, which is done on every domain start with
+ * host-model CPU and while probing capabilities. */
+static int
+cpuTestCPUIDBenchmark(const void *arg)
+{
+    const char *const *hosts = arg;
+    long long elapsed = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; hosts && hosts[i]; i++) {
+        g_autofree char *hostFile = NULL;
+        g_autofree char *host = NULL;
+        virCPUDataPtr hostData = NULL;
+        gint64 start;
+
+        hostFile = g_strdup_printf("%s/cputestdata/x86_64-cpuid-%s.xml",
+                                   abs_srcdir, hosts[i]);
+
+        if (virTestLoadFile(hostFile, &host) < 0 ||
+            !(hostData = virCPUDataParse(host)))
+            return -1;
+
+        start = g_get_monotonic_time();
+        for (j = 0; j < 100; j++) {
+            g_autoptr(virCPUDef) cpu = virCPUDefNew();
+
+            cpu->arch = hostData->arch;
+            cpu->type = VIR_CPU_TYPE_HOST;
+
+            if (cpuDecode(cpu, hostData, NULL) < 0) {
+                virCPUDataFree(hostData);
+                return -1;
+            }
+        }
+        elapsed += g_get_monotonic_time() - start;
+
+        virCPUDataFree(hostData);
+    }
+
+    VIR_TEST_DEBUG("decoding %zu CPUs 100 times took %lld us", i, elapsed);
+
+    return 0;
+}
+
+
 static int
 cpuTestHostCPUID(const void *arg)
 {
@@ -973,6 +1019,7 @@ mymain(void)
     virDomainCapsCPUModelsPtr models = NULL;
     virDomainCapsCPUModelsPtr haswell = NULL;
     virDomainCapsCPUModelsPtr ppc_models = NULL;
+    VIR_AUTOSTRINGLIST x86Hosts = NULL;
     int ret = 0;
 
 #if WITH_QEMU
@@ -1080,6 +1127,9 @@ mymain(void)
 
 #define DO_TEST_CPUID(arch, host, json) \
     do { \
+        if (arch == VIR_ARCH_X86_64 && \
+            virStringListAdd(&x86Hosts, host) < 0) \
+            ret = -1; \
         DO_TEST(arch, cpuTestHostCPUID, host, host, \
                 NULL, NULL, 0, 0); \
         DO_TEST(arch, cpuTestGuestCPUID, host, host, \
@@ -1279,6 +1329,10 @@ mymain(void)
     DO_TEST_CPUID(VIR_ARCH_X86_64, "Ice-Lake-Server", JSON_MODELS);
     DO_TEST_CPUID(VIR_ARCH_X86_64, "Cooperlake", JSON_MODELS);
 
+    if (virTestRun("x86 CPUID decoding benchmark",
+                   cpuTestCPUIDBenchmark, x86Hosts) < 0)
+        ret = -1;
+
  cleanup:
 #if WITH_QEMU
     qemuTestDriverFree(&driver);
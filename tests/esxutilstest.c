@@ -8,9 +8,11 @@
 
 # include "internal.h"
 # include "viralloc.h"
+# include "viruuid.h"
+# include "virxml.h"
 # include "vmx/vmx.h"
 # include "esx/esx_util.h"
-# include "esx/esx_vi_types.h"
+# include "esx/esx_vi.h"
 
 struct testPath {
     const char *datastorePath;
@@ -238,6 +240,223 @@ testConvertWindows1252ToUTF8(const void *data G_GNUC_UNUSED)
 
 
 
+# define UPDATE_VAL(_type, _value) \
+    "<val xsi:type='" _type "'>" _value "</val>"
+
+# define UPDATE_CHANGE(_name, _op, _val) \
+    "<changeSet><name>" _name "</name><op>" _op "</op>" _val "</changeSet>"
+
+# define UPDATE_OBJECT(_kind, _id, _changes) \
+    "<objectSet><kind>" _kind "</kind>" \
+    "<obj type='VirtualMachine'>" _id "</obj>" _changes "</objectSet>"
+
+# define UPDATE_SET(_version, _objects) \
+    "<returnval xmlns:xsi='http://www.w3.org/2001/XMLSchema-instance'>" \
+    "<version>" _version "</version><filterSet>" \
+    "<filter type='PropertyFilter'>session[1]1</filter>" _objects \
+    "</filterSet></returnval>"
+
+# define UPDATE_ENTER(_id, _name, _uuid, _powerState) \
+    UPDATE_OBJECT("enter", _id, \
+        UPDATE_CHANGE("configStatus", "assign", \
+                      UPDATE_VAL("ManagedEntityStatus", "green")) \
+        UPDATE_CHANGE("name", "assign", UPDATE_VAL("xsd:string", _name)) \
+        UPDATE_CHANGE("runtime.powerState", "assign", \
+                      UPDATE_VAL("VirtualMachinePowerState", _powerState)) \
+        UPDATE_CHANGE("config.uuid", "assign", \
+                      UPDATE_VAL("xsd:string", _uuid)))
+
+static const char *updateSetInitial =
+    UPDATE_SET("1",
+               UPDATE_ENTER("1", "vm1", "564d1a6c-7c3a-0a41-51f5-9c3e4f3d2a01",
+                            "poweredOn")
+               UPDATE_ENTER("2", "vm2", "564d1a6c-7c3a-0a41-51f5-9c3e4f3d2a02",
+                            "poweredOff"));
+
+static const char *updateSetModify =
+    UPDATE_SET("2",
+               UPDATE_OBJECT("modify", "1",
+                             UPDATE_CHANGE("runtime.powerState", "assign",
+                                           UPDATE_VAL("VirtualMachinePowerState",
+                                                      "suspended")))
+               UPDATE_OBJECT("leave", "2", ""));
+
+static const char *updateSetUnexpected =
+    UPDATE_SET("3",
+               UPDATE_OBJECT("modify", "1",
+                             UPDATE_CHANGE("guest.hostName", "assign",
+                                           UPDATE_VAL("xsd:string", "vm1"))));
+
+static int
+testInventoryCacheApply(esxVI_InventoryCache *cache, const char *xml,
+                        int expected)
+{
+    int result = -1;
+    xmlDocPtr doc = NULL;
+    xmlXPathContextPtr ctxt = NULL;
+    esxVI_UpdateSet *updateSet = NULL;
+
+    if (!(doc = virXMLParseStringCtxt(xml, "(update set)", &ctxt)) ||
+        esxVI_UpdateSet_Deserialize(ctxt->node, &updateSet) < 0) {
+        goto cleanup;
+    }
+
+    if (esxVI_InventoryCache_Update(cache, updateSet,
+                                    cache->generation) != expected) {
+        goto cleanup;
+    }
+
+    result = 0;
+
+ cleanup:
+    esxVI_UpdateSet_Free(&updateSet);
+    xmlXPathFreeContext(ctxt);
+    xmlFreeDoc(doc);
+
+    return result;
+}
+
+static int
+testInventoryCache(const void *data G_GNUC_UNUSED)
+{
+    int result = -1;
+    esxVI_InventoryCache *cache = NULL;
+    esxVI_String *propertyNameList = NULL;
+    esxVI_String *uncachedPropertyNameList = NULL;
+    esxVI_ObjectContent *virtualMachineList = NULL;
+    esxVI_ObjectContent *virtualMachine = NULL;
+    esxVI_VirtualMachinePowerState powerState;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    char *name = NULL;
+    int id = -1;
+    size_t count = 0;
+
+    if (!(cache = esxVI_InventoryCache_New()) ||
+        esxVI_String_AppendValueListToList(&propertyNameList,
+                                           "name\0"
+                                           "runtime.powerState\0") < 0 ||
+        esxVI_String_AppendValueListToList(&uncachedPropertyNameList,
+                                           "name\0"
+                                           "guest.net\0") < 0) {
+        goto cleanup;
+    }
+
+    /* Nothing is served before the first update set arrived */
+    if (esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, propertyNameList, &virtualMachineList) != 0 ||
+        testInventoryCacheApply(cache, updateSetInitial, 0) < 0 ||
+        esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, propertyNameList, &virtualMachineList) != 1) {
+        goto cleanup;
+    }
+
+    for (virtualMachine = virtualMachineList; virtualMachine;
+         virtualMachine = virtualMachine->_next) {
+        VIR_FREE(name);
+
+        if (esxVI_GetVirtualMachineIdentity(virtualMachine, &id, &name,
+                                            NULL) < 0 ||
+            esxVI_GetVirtualMachinePowerState(virtualMachine,
+                                              &powerState) < 0) {
+            goto cleanup;
+        }
+
+        if ((id == 1 && (STRNEQ(name, "vm1") ||
+                         powerState != esxVI_VirtualMachinePowerState_PoweredOn)) ||
+            (id == 2 && (STRNEQ(name, "vm2") ||
+                         powerState != esxVI_VirtualMachinePowerState_PoweredOff)) ||
+            id < 1 || id > 2) {
+            goto cleanup;
+        }
+
+        /* Only the requested properties are returned */
+        if (!virtualMachine->propSet || !virtualMachine->propSet->_next ||
+            virtualMachine->propSet->_next->_next) {
+            goto cleanup;
+        }
+
+        count++;
+    }
+
+    esxVI_ObjectContent_Free(&virtualMachineList);
+
+    if (count != 2 ||
+        esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, uncachedPropertyNameList, &virtualMachineList) != 0) {
+        goto cleanup;
+    }
+
+    /* Modifications and removals are applied in place */
+    if (testInventoryCacheApply(cache, updateSetModify, 0) < 0 ||
+        esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, propertyNameList, &virtualMachineList) != 1 ||
+        !virtualMachineList || virtualMachineList->_next ||
+        esxVI_GetVirtualMachinePowerState(virtualMachineList,
+                                          &powerState) < 0 ||
+        powerState != esxVI_VirtualMachinePowerState_Suspended) {
+        goto cleanup;
+    }
+
+    esxVI_ObjectContent_Free(&virtualMachineList);
+
+    if (virUUIDParse("564d1a6c-7c3a-0a41-51f5-9c3e4f3d2a01", uuid) < 0 ||
+        esxVI_InventoryCache_LookupVirtualMachineByUuid
+          (cache, uuid, propertyNameList, &virtualMachine) != 1 ||
+        STRNEQ(virtualMachine->obj->value, "1")) {
+        goto cleanup;
+    }
+
+    esxVI_ObjectContent_Free(&virtualMachine);
+
+    /* A miss is left to the server, the machine might be elsewhere */
+    if (virUUIDParse("564d1a6c-7c3a-0a41-51f5-9c3e4f3d2a02", uuid) < 0 ||
+        esxVI_InventoryCache_LookupVirtualMachineByUuid
+          (cache, uuid, propertyNameList, &virtualMachine) != 0 ||
+        virtualMachine) {
+        goto cleanup;
+    }
+
+    /* After invalidation only an update that started later counts */
+    esxVI_InventoryCache_Invalidate(cache);
+
+    if (esxVI_InventoryCache_Update(cache, NULL, cache->generation - 1) < 0 ||
+        esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, propertyNameList, &virtualMachineList) != 0 ||
+        esxVI_InventoryCache_Update(cache, NULL, cache->generation) < 0 ||
+        esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, propertyNameList, &virtualMachineList) != 1) {
+        goto cleanup;
+    }
+
+    esxVI_ObjectContent_Free(&virtualMachineList);
+
+    /* Changes that cannot be applied force a resync */
+    if (testInventoryCacheApply(cache, updateSetUnexpected, -1) < 0 ||
+        STRNEQ(cache->version, "") ||
+        esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, propertyNameList, &virtualMachineList) != 0 ||
+        testInventoryCacheApply(cache, updateSetInitial, 0) < 0 ||
+        esxVI_InventoryCache_LookupVirtualMachineList
+          (cache, propertyNameList, &virtualMachineList) != 1 ||
+        !virtualMachineList || !virtualMachineList->_next) {
+        goto cleanup;
+    }
+
+    result = 0;
+
+ cleanup:
+    virObjectUnref(cache);
+    esxVI_String_Free(&propertyNameList);
+    esxVI_String_Free(&uncachedPropertyNameList);
+    esxVI_ObjectContent_Free(&virtualMachineList);
+    esxVI_ObjectContent_Free(&virtualMachine);
+    VIR_FREE(name);
+
+    return result;
+}
+
+
+
 static int
 mymain(void)
 {
@@ -257,6 +476,7 @@ mymain(void)
     DO_TEST(ConvertDateTimeToCalendarTime);
     DO_TEST(EscapeDatastoreItem);
     DO_TEST(ConvertWindows1252ToUTF8);
+    DO_TEST(InventoryCache);
 
     return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
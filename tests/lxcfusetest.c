@@ -0,0 +1,294 @@
+/*
+ * lxcfusetest.c: test the /proc virtualization of LXC containers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_LXC
+
+# include "internal.h"
+# include "lxc/lxc_fuse.h"
+# include "virstring.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+struct testInfo {
+    const char *name;
+    const char *cpus;
+};
+
+
+static int
+testProcFormat(const void *opaque)
+{
+    const struct testInfo *info = opaque;
+    g_autofree char *inFile = NULL;
+    g_autofree char *outFile = NULL;
+    g_autofree char *host = NULL;
+    g_autofree char *actual = NULL;
+    g_autoptr(virBitmap) cpus = NULL;
+    g_autoptr(virDomainDef) def = NULL;
+    struct virLXCMeminfo meminfo = {
+        .memtotal = 1048576,
+        .memusage = 524288,
+        .cached = 102400,
+        .active_anon = 200000,
+        .inactive_anon = 100000,
+        .active_file = 50000,
+        .inactive_file = 40000,
+        .unevictable = 1000,
+        .swaptotal = 2097152,
+        .swapusage = 600000,
+    };
+
+    inFile = g_strdup_printf("%s/lxcfusedata/%s.in", abs_srcdir, info->name);
+    outFile = g_strdup_printf("%s/lxcfusedata/%s.out", abs_srcdir, info->name);
+
+    if (virTestLoadFile(inFile, &host) < 0)
+        return -1;
+
+    if (info->cpus &&
+        virBitmapParse(info->cpus, &cpus, VIR_DOMAIN_CPUMASK_LEN) < 0)
+        return -1;
+
+    switch ((virLXCProcFile) virLXCProcFileTypeFromString(info->name)) {
+    case VIR_LXC_PROC_MEMINFO:
+        if (!(def = virDomainDefNew()))
+            return -1;
+        def->mem.hard_limit = 1048576;
+        def->mem.swap_hard_limit = 2097152;
+        actual = lxcProcMeminfoFormat(host, def, &meminfo);
+        break;
+    case VIR_LXC_PROC_CPUINFO:
+        actual = lxcProcCpuinfoFormat(host, cpus);
+        break;
+    case VIR_LXC_PROC_STAT:
+        actual = lxcProcStatFormat(host, cpus);
+        break;
+    case VIR_LXC_PROC_UPTIME:
+    case VIR_LXC_PROC_LOADAVG:
+    case VIR_LXC_PROC_LAST:
+        break;
+    }
+
+    if (!actual) {
+        VIR_TEST_DEBUG("unexpected file '%s'", info->name);
+        return -1;
+    }
+
+    return virTestCompareToFile(actual, outFile);
+}
+
+
+static int
+testProcUptime(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *actual = NULL;
+
+    /* Up for 3723.45s on 2 CPUs, 1500s of which were used */
+    actual = lxcProcUptimeFormat(3723450000LL, 1500000000000ULL, 2);
+    if (virTestCompareToString("3723.45 5946.90\n", actual) < 0)
+        return -1;
+    VIR_FREE(actual);
+
+    /* More CPU time used than available must not underflow */
+    actual = lxcProcUptimeFormat(1000000LL, 5000000000ULL, 1);
+    return virTestCompareToString("1.00 0.00\n", actual);
+}
+
+
+static int
+testProcLoadavg(const void *opaque G_GNUC_UNUSED)
+{
+    struct virLXCLoadavg loadavg = { { 0 } };
+    long long now = 1000000;
+    unsigned long long usage = 0;
+    g_autofree char *actual = NULL;
+    size_t i;
+
+    lxcProcLoadavgUpdate(&loadavg, usage, now);
+
+    /* Samples closer than the sampling interval are ignored */
+    lxcProcLoadavgUpdate(&loadavg, usage + 1000000000ULL, now + 1000000);
+    if (loadavg.sample != now) {
+        VIR_TEST_DEBUG("sample taken too early");
+        return -1;
+    }
+
+    /* Keep two CPUs busy for a minute */
+    for (i = 0; i < 12; i++) {
+        now += 5 * 1000 * 1000;
+        usage += 10 * 1000 * 1000 * 1000ULL;
+        lxcProcLoadavgUpdate(&loadavg, usage, now);
+    }
+
+    actual = lxcProcLoadavgFormat(&loadavg, "3.10 2.00 1.50 2/345 6789\n");
+    if (virTestCompareToString("1.27 0.36 0.13 2/345 6789\n", actual) < 0)
+        return -1;
+    VIR_FREE(actual);
+
+    actual = lxcProcLoadavgFormat(&loadavg, NULL);
+    return virTestCompareToString("1.27 0.36 0.13 0/0 0\n", actual);
+}
+
+
+static char *
+testProcSnapshotGenerate(long long now G_GNUC_UNUSED,
+                         void *opaque)
+{
+    int *generation = opaque;
+
+    if (*generation < 0)
+        return NULL;
+
+    return g_strdup_printf("generation %d\n", ++*generation);
+}
+
+
+# define CHECK_READ(offset, now, expected) \
+    do { \
+        int len = lxcProcSnapshotRead(&snapshot, buf, 4, offset, now, \
+                                      testProcSnapshotGenerate, \
+                                      &generation); \
+        if (len != (int)strlen(expected) || \
+            memcmp(buf, expected, len) != 0) { \
+            VIR_TEST_DEBUG("read at %d, time %lld: expected '%s', got '%.*s'", \
+                           (int)offset, (long long)now, expected, \
+                           len < 0 ? 0 : len, buf); \
+            goto cleanup; \
+        } \
+    } while (0)
+
+static int
+testProcSnapshot(const void *opaque G_GNUC_UNUSED)
+{
+    struct virLXCProcSnapshot snapshot = { 0 };
+    long long now = 1000000;
+    int generation = 0;
+    char buf[4];
+    int ret = -1;
+
+    /* The first read generates the contents */
+    CHECK_READ(0, now, "gene");
+    CHECK_READ(4, now, "rati");
+
+    /* Fresh reads share the snapshot until it gets old */
+    CHECK_READ(0, now + LXC_FUSE_CACHE_INTERVAL - 1, "gene");
+    CHECK_READ(10, now + LXC_FUSE_CACHE_INTERVAL - 1, " 1\n");
+
+    /* Reads further into the file keep using the old snapshot */
+    CHECK_READ(8, now + LXC_FUSE_CACHE_INTERVAL, "on 1");
+    CHECK_READ(13, now + LXC_FUSE_CACHE_INTERVAL, "");
+
+    /* A fresh read of an old snapshot generates new contents */
+    now += LXC_FUSE_CACHE_INTERVAL;
+    CHECK_READ(0, now, "gene");
+    CHECK_READ(8, now, "on 2");
+
+    /* Failing to generate new contents keeps the old ones */
+    generation = -1;
+    if (lxcProcSnapshotRead(&snapshot, buf, sizeof(buf), 0,
+                            now + LXC_FUSE_CACHE_INTERVAL,
+                            testProcSnapshotGenerate, &generation) != -1) {
+        VIR_TEST_DEBUG("failure to generate contents not reported");
+        goto cleanup;
+    }
+    if (snapshot.stamp != now ||
+        STRNEQ_NULLABLE(snapshot.content, "generation 2\n")) {
+        VIR_TEST_DEBUG("snapshot changed by a failed generation");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    g_free(snapshot.content);
+    return ret;
+}
+
+# undef CHECK_READ
+
+
+/* Formatting cost must not depend on how often the files are read,
+ * as monitoring agents poll them every second. */
+static int
+testProcFormatCost(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *inFile = NULL;
+    g_autofree char *host = NULL;
+    g_autoptr(virBitmap) cpus = NULL;
+    gint64 start;
+    size_t i;
+
+    inFile = g_strdup_printf("%s/lxcfusedata/stat.in", abs_srcdir);
+    if (virTestLoadFile(inFile, &host) < 0 ||
+        virBitmapParse("1,3", &cpus, VIR_DOMAIN_CPUMASK_LEN) < 0)
+        return -1;
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < 10000; i++) {
+        g_autofree char *actual = lxcProcStatFormat(host, cpus);
+        if (!actual)
+            return -1;
+    }
+    VIR_TEST_DEBUG("formatting /proc/stat 10000 times took %lld us",
+                   (long long)(g_get_monotonic_time() - start));
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+# define DO_TEST(name, cpus) \
+    do { \
+        static struct testInfo info = { name, cpus }; \
+        if (virTestRun("Format /proc/" name, testProcFormat, &info) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST("meminfo", NULL);
+    DO_TEST("cpuinfo", "1,3");
+    DO_TEST("stat", "1,3");
+
+    if (virTestRun("Format /proc/uptime", testProcUptime, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Format /proc/loadavg", testProcLoadavg, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Format cost", testProcFormatCost, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Snapshot of /proc files", testProcSnapshot, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_LXC */
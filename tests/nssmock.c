@@ -55,9 +55,16 @@ getrealpath(char **newpath,
             const char *path)
 {
     if (STRPREFIX(path, LEASEDIR)) {
-        *newpath = g_strdup_printf("%s/nssdata/%s",
-                                   abs_srcdir,
-                                   path + strlen(LEASEDIR));
+        const char *leasedir = getenv("LIBVIRT_NSS_LEASEDIR");
+
+        if (leasedir)
+            *newpath = g_strdup_printf("%s/%s",
+                                       leasedir,
+                                       path + strlen(LEASEDIR));
+        else
+            *newpath = g_strdup_printf("%s/nssdata/%s",
+                                       abs_srcdir,
+                                       path + strlen(LEASEDIR));
     } else {
         *newpath = g_strdup(path);
     }
@@ -65,6 +72,33 @@ getrealpath(char **newpath,
     return 0;
 }
 
+/* Replace the lease file named by LIBVIRT_NSS_REPLACE_LEASE_FILE the
+ * way leaseshelper does, the first time another lease file is opened.
+ * This lets tests race a lease event with building the lease index. */
+static void
+replaceLeaseFile(const char *path)
+{
+    const char *victim = getenv("LIBVIRT_NSS_REPLACE_LEASE_FILE");
+    g_autofree char *tmp = NULL;
+    int fd;
+
+    if (!victim ||
+        !virStringHasSuffix(path, ".status") ||
+        STREQ(path, victim))
+        return;
+
+    tmp = g_strdup_printf("%s.new", victim);
+
+    if ((fd = real_open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+        close(fd) < 0 ||
+        rename(tmp, victim) < 0) {
+        fprintf(stderr, "Cannot replace %s\n", victim);
+        abort();
+    }
+
+    g_unsetenv("LIBVIRT_NSS_REPLACE_LEASE_FILE");
+}
+
 int
 open(const char *path, int flags, ...)
 {
@@ -73,6 +107,8 @@ open(const char *path, int flags, ...)
 
     init_syms();
 
+    replaceLeaseFile(path);
+
     if (STRPREFIX(path, LEASEDIR) &&
         getrealpath(&newpath, path) < 0)
         return -1;
@@ -24,6 +24,9 @@
 
 # include "libvirt_nss.h"
 # include "virsocket.h"
+# include "virfile.h"
+# include "virlease.h"
+# include "virleaseindex.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -157,8 +160,108 @@ testGetHostByName(const void *opaque)
     return 0;
 }
 
+
+/* Copies the test lease files into @leasedir and builds the lease index
+ * there. The lease files are then emptied without touching the
+ * directory, so lookups only succeed if they are served from the
+ * index. */
 static int
-mymain(void)
+testPrepareLeaseIndex(const char *leasedir)
+{
+    const char *files[] = {
+        "virbr0.status", "virbr0.macs", "virbr1.status", "virbr1.macs",
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(files); i++) {
+        g_autofree char *src = g_strdup_printf("%s/nssdata/%s", abs_srcdir, files[i]);
+        g_autofree char *dst = g_strdup_printf("%s/%s", leasedir, files[i]);
+        g_autofree char *content = NULL;
+
+        if (virFileReadAll(src, 1024 * 1024, &content) < 0 ||
+            virFileWriteStr(dst, content, 0644) < 0)
+            return -1;
+    }
+
+    if (virLeaseIndexWrite(leasedir) < 0)
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(files); i++) {
+        g_autofree char *dst = g_strdup_printf("%s/%s", leasedir, files[i]);
+
+        if (virStringHasSuffix(dst, ".status") &&
+            virFileWriteStr(dst, "", 0) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Returns 1 if the lease index in @leasedir is valid for the current
+ * state of the directory, 0 if it is stale and -1 on error. */
+static int
+testLeaseIndexIsValid(const char *leasedir)
+{
+    g_autofree char *indexfile = NULL;
+    virLeaseIndexHeader hdr;
+    struct stat sb;
+    VIR_AUTOCLOSE fd = -1;
+
+    indexfile = g_strdup_printf("%s/%s", leasedir, VIR_LEASE_INDEX_FILE);
+
+    if ((fd = open(indexfile, O_RDONLY)) < 0 ||
+        saferead(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        stat(leasedir, &sb) < 0) {
+        fprintf(stderr, "Cannot read %s\n", indexfile);
+        return -1;
+    }
+
+    return hdr.dirMtimeSec == sb.st_mtim.tv_sec &&
+           hdr.dirMtimeNsec == sb.st_mtim.tv_nsec;
+}
+
+
+/* A lease file replaced while the index is being built must leave the
+ * index stale, while an index built undisturbed must be valid. */
+static int
+testLeaseIndexRace(const void *opaque)
+{
+    const char *leasedir = opaque;
+    g_autofree char *victim = g_strdup_printf("%s/virbr1.status", leasedir);
+    int rc;
+
+    g_setenv("LIBVIRT_NSS_REPLACE_LEASE_FILE", victim, TRUE);
+    rc = virLeaseIndexWrite(leasedir);
+
+    if (getenv("LIBVIRT_NSS_REPLACE_LEASE_FILE")) {
+        g_unsetenv("LIBVIRT_NSS_REPLACE_LEASE_FILE");
+        fprintf(stderr, "Lease file was not replaced\n");
+        return -1;
+    }
+
+    if (rc < 0 ||
+        (rc = testLeaseIndexIsValid(leasedir)) < 0)
+        return -1;
+
+    if (rc) {
+        fprintf(stderr, "Index built during a lease file change is valid\n");
+        return -1;
+    }
+
+    if (virLeaseIndexWrite(leasedir) < 0 ||
+        (rc = testLeaseIndexIsValid(leasedir)) < 0)
+        return -1;
+
+    if (!rc) {
+        fprintf(stderr, "Index built without changes is stale\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+testLookups(void)
 {
     int ret = 0;
 
@@ -183,6 +286,39 @@ mymain(void)
     DO_TEST("suse", AF_INET, "192.168.122.3");
 # endif /* defined(LIBVIRT_NSS_GUEST) */
 
+    return ret;
+}
+
+# define LEASEDIRTEMPLATE abs_builddir "/nssleasedir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char leasedir[] = LEASEDIRTEMPLATE;
+    int ret = 0;
+
+    if (testLookups() < 0)
+        ret = -1;
+
+    if (!g_mkdtemp(leasedir)) {
+        fprintf(stderr, "Cannot create nssleasedir");
+        abort();
+    }
+
+    if (testPrepareLeaseIndex(leasedir) < 0) {
+        ret = -1;
+    } else {
+        g_setenv("LIBVIRT_NSS_LEASEDIR", leasedir, TRUE);
+        if (testLookups() < 0)
+            ret = -1;
+
+        if (virTestRun("Lease index race", testLeaseIndexRace, leasedir) < 0)
+            ret = -1;
+    }
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(leasedir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
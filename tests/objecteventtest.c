@@ -23,6 +23,7 @@
 
 #include "testutils.h"
 
+#include "domain_event.h"
 #include "virerror.h"
 #include "virxml.h"
 
@@ -472,6 +473,138 @@ testDomainStartStopEvent(const void *data)
     return ret;
 }
 
+typedef struct {
+    int events;
+    unsigned long long actual;
+} balloonEventCounter;
+
+static void
+domainBalloonChangeCb(virConnectPtr conn G_GNUC_UNUSED,
+                      virDomainPtr dom G_GNUC_UNUSED,
+                      unsigned long long actual,
+                      void *opaque)
+{
+    balloonEventCounter *counter = opaque;
+
+    counter->events++;
+    counter->actual = actual;
+}
+
+static int
+domainLifecycleCountCb(virConnectPtr conn G_GNUC_UNUSED,
+                       virDomainPtr dom G_GNUC_UNUSED,
+                       int event G_GNUC_UNUSED,
+                       int detail G_GNUC_UNUSED,
+                       void *opaque)
+{
+    int *count = opaque;
+
+    (*count)++;
+    return 0;
+}
+
+#define TEST_BALLOON_EVENTS 10000
+
+static int
+testDomainBalloonCoalesce(const void *data)
+{
+    const objecteventTest *test = data;
+    virConnectPtr conn2 = NULL;
+    virObjectEventStatePtr state = NULL;
+    balloonEventCounter coalesced = { 0 };
+    balloonEventCounter all = { 0 };
+    int lifecycle = 0;
+    int coalescedId = -1;
+    int allId = -1;
+    int lifecycleId = -1;
+    virDomainPtr dom;
+    size_t i;
+    int ret = -1;
+
+    if (!(dom = virDomainLookupByName(test->conn, "test")))
+        return -1;
+
+    if (!(conn2 = virConnectOpen("test:///default?coalesce_events=1")))
+        goto cleanup;
+
+    if (!(state = virObjectEventStateNew()))
+        goto cleanup;
+
+    if (virDomainEventStateRegisterID(conn2, state, dom,
+                           VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE,
+                           VIR_DOMAIN_EVENT_CALLBACK(&domainBalloonChangeCb),
+                           &coalesced, NULL, &coalescedId) < 0 ||
+        virDomainEventStateRegisterID(test->conn, state, dom,
+                           VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE,
+                           VIR_DOMAIN_EVENT_CALLBACK(&domainBalloonChangeCb),
+                           &all, NULL, &allId) < 0 ||
+        virDomainEventStateRegisterID(test->conn, state, dom,
+                           VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                           VIR_DOMAIN_EVENT_CALLBACK(&domainLifecycleCountCb),
+                           &lifecycle, NULL, &lifecycleId) < 0)
+        goto cleanup;
+
+    /* Queue a storm of balloon events interleaved with lifecycle events
+     * before letting the event loop dispatch them. Only the last balloon
+     * event may be delivered to the connection which asked for
+     * coalescing, but every event must be delivered to the other one. */
+    for (i = 1; i <= TEST_BALLOON_EVENTS; i++)
+        virObjectEventStateQueue(state,
+                                 virDomainEventBalloonChangeNewFromDom(dom, 1024 + i));
+    virObjectEventStateQueue(state,
+                             virDomainEventLifecycleNewFromDom(dom,
+                                 VIR_DOMAIN_EVENT_SUSPENDED,
+                                 VIR_DOMAIN_EVENT_SUSPENDED_PAUSED));
+    virObjectEventStateQueue(state,
+                             virDomainEventBalloonChangeNewFromDom(dom, 2048));
+    virObjectEventStateQueue(state,
+                             virDomainEventLifecycleNewFromDom(dom,
+                                 VIR_DOMAIN_EVENT_RESUMED,
+                                 VIR_DOMAIN_EVENT_RESUMED_UNPAUSED));
+    virObjectEventStateQueue(state,
+                             virDomainEventBalloonChangeNewFromDom(dom, 4096));
+
+    if (virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (coalesced.events != 1 || coalesced.actual != 4096) {
+        VIR_TEST_DEBUG("Expected a single coalesced balloon event with "
+                       "4096 KiB, got %d events, last with %llu KiB",
+                       coalesced.events, coalesced.actual);
+        goto cleanup;
+    }
+
+    if (all.events != TEST_BALLOON_EVENTS + 2 || all.actual != 4096) {
+        VIR_TEST_DEBUG("Expected %d balloon events with the last one "
+                       "4096 KiB, got %d events, last with %llu KiB",
+                       TEST_BALLOON_EVENTS + 2,
+                       all.events, all.actual);
+        goto cleanup;
+    }
+
+    if (lifecycle != 2) {
+        VIR_TEST_DEBUG("Expected 2 lifecycle events, got %d", lifecycle);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (state) {
+        if (coalescedId >= 0)
+            virObjectEventStateDeregisterID(conn2, state, coalescedId, true);
+        if (allId >= 0)
+            virObjectEventStateDeregisterID(test->conn, state, allId, true);
+        if (lifecycleId >= 0)
+            virObjectEventStateDeregisterID(test->conn, state, lifecycleId, true);
+        virObjectUnref(state);
+    }
+    if (conn2)
+        virConnectClose(conn2);
+    virDomainFree(dom);
+
+    return ret;
+}
+
 static int
 testNetworkCreateXML(const void *data)
 {
@@ -726,6 +859,70 @@ testStoragePoolStartStopEvent(const void *data)
     return ret;
 }
 
+#define TEST_REFRESH_EVENTS 10
+
+static int
+testStoragePoolRefreshCoalesce(const void *data)
+{
+    const objecteventTest *test = data;
+    virConnectPtr conn2 = NULL;
+    int coalesced = 0;
+    int all = 0;
+    int coalescedId = -1;
+    int allId = -1;
+    size_t i;
+    int ret = -1;
+
+    if (!test->pool)
+        return -1;
+
+    if (!(conn2 = virConnectOpen("test:///default?coalesce_events=1")))
+        return -1;
+
+    coalescedId = virConnectStoragePoolEventRegisterAny(conn2, NULL,
+                      VIR_STORAGE_POOL_EVENT_ID_REFRESH,
+                      VIR_STORAGE_POOL_EVENT_CALLBACK(&storagePoolRefreshCb),
+                      &coalesced, NULL);
+    allId = virConnectStoragePoolEventRegisterAny(test->conn, test->pool,
+                      VIR_STORAGE_POOL_EVENT_ID_REFRESH,
+                      VIR_STORAGE_POOL_EVENT_CALLBACK(&storagePoolRefreshCb),
+                      &all, NULL);
+    if (coalescedId < 0 || allId < 0)
+        goto cleanup;
+
+    if (virStoragePoolCreate(test->pool, 0) < 0)
+        goto cleanup;
+
+    /* Each refresh queues an event before the event loop gets to run.
+     * The connection which asked for coalescing must be told about the
+     * last one only, the other one about all of them. */
+    for (i = 0; i < TEST_REFRESH_EVENTS; i++) {
+        if (virStoragePoolRefresh(test->pool, 0) < 0)
+            break;
+    }
+    virStoragePoolDestroy(test->pool);
+
+    if (i < TEST_REFRESH_EVENTS ||
+        virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (coalesced != 1 || all != TEST_REFRESH_EVENTS) {
+        VIR_TEST_DEBUG("Expected 1 coalesced and %d other refresh events, "
+                       "got %d and %d",
+                       TEST_REFRESH_EVENTS, coalesced, all);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (coalescedId >= 0)
+        virConnectStoragePoolEventDeregisterAny(conn2, coalescedId);
+    if (allId >= 0)
+        virConnectStoragePoolEventDeregisterAny(test->conn, allId);
+    virConnectClose(conn2);
+    return ret;
+}
+
 static int
 testStoragePoolBuild(const void *data)
 {
@@ -864,6 +1061,9 @@ mymain(void)
         ret = EXIT_FAILURE;
     if (virTestRun("Domain start stop events", testDomainStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
+    if (virTestRun("Domain balloon events coalescing",
+                   testDomainBalloonCoalesce, &test) < 0)
+        ret = EXIT_FAILURE;
 
     /* Network event tests */
     /* Tests requiring the test network not to be set up */
@@ -898,6 +1098,9 @@ mymain(void)
     if (virTestRun("Storage pool start stop events ",
                    testStoragePoolStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
+    if (virTestRun("Storage pool refresh events coalescing",
+                   testStoragePoolRefreshCoalesce, &test) < 0)
+        ret = EXIT_FAILURE;
     /* Storage pool build and delete events */
     if (virTestRun("Storage pool build event ",
                    testStoragePoolBuild, &test) < 0)
@@ -72,6 +72,19 @@ virHashTablePtr xattr_paths = NULL;
 virHashTablePtr chown_paths = NULL;
 
 
+/* Number of chown() calls made so far. */
+size_t chown_calls = 0;
+
+/* If set, the first chown() waits for another one to come in while
+ * it's still running, which tells whether paths are chowned from
+ * multiple threads at once. The wait is bounded so that a serial
+ * caller is merely slowed down rather than blocked forever. */
+bool chown_rendezvous = false;
+bool chown_overlapped = false;
+size_t chown_running = 0;
+#define CHOWN_RENDEZVOUS_TIMEOUT 5000 /* ms */
+
+
 static void
 init_hash(void)
 {
@@ -238,7 +251,7 @@ int virFileRemoveXAttr(const char *path,
 \
             sb->st_mode = S_IFREG | 0666; \
             sb->st_size = 123456; \
-            sb->st_ino = 1; \
+            sb->st_ino = g_str_hash(path); \
 \
             if (!(val = virHashLookup(chown_paths, path))) { \
                 /* New path. Set the defaults */ \
@@ -277,6 +290,24 @@ mock_chown(const char *path,
     virMutexLock(&m);
     init_hash();
 
+    chown_calls++;
+    chown_running++;
+
+    if (chown_rendezvous && !chown_overlapped) {
+        size_t waited = 0;
+
+        if (chown_running > 1)
+            chown_overlapped = true;
+
+        while (!chown_overlapped && waited++ < CHOWN_RENDEZVOUS_TIMEOUT) {
+            virMutexUnlock(&m);
+            g_usleep(1000);
+            virMutexLock(&m);
+        }
+    }
+
+    chown_running--;
+
     if (virHashUpdateEntry(chown_paths, path, val) < 0)
         goto cleanup;
     val = NULL;
@@ -469,10 +500,55 @@ void freePaths(void)
     virHashFree(chown_paths);
     virHashFree(xattr_paths);
     chown_paths = xattr_paths = NULL;
+    chown_calls = 0;
+    chown_rendezvous = chown_overlapped = false;
     virMutexUnlock(&m);
 }
 
 
+/**
+ * countChowns:
+ *
+ * Returns the number of chown() calls made since the last call
+ * and resets the counter.
+ */
+size_t countChowns(void)
+{
+    size_t ret;
+
+    virMutexLock(&m);
+    ret = chown_calls;
+    chown_calls = 0;
+    virMutexUnlock(&m);
+
+    return ret;
+}
+
+
+/**
+ * checkParallelChown:
+ * @enable: whether to start or finish the check
+ *
+ * With @enable set, make the next chown() wait for another one to
+ * run concurrently. With @enable unset, stop waiting.
+ *
+ * Returns: true if two chown() calls ran at the same time since
+ * the check was started, false otherwise.
+ */
+bool checkParallelChown(bool enable)
+{
+    bool ret;
+
+    virMutexLock(&m);
+    ret = chown_overlapped;
+    chown_rendezvous = enable;
+    chown_overlapped = false;
+    virMutexUnlock(&m);
+
+    return ret;
+}
+
+
 int
 virProcessRunInFork(virProcessForkCallback cb,
                     void *opaque)
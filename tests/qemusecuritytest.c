@@ -31,6 +31,7 @@
 struct testData {
     virQEMUDriverPtr driver;
     const char *file; /* file name to load VM def XML from; qemuxml2argvdata/ */
+    bool rememberOwner;
 };
 
 
@@ -130,6 +131,67 @@ testDomain(const void *opaque)
 }
 
 
+/* Labelling a domain again must not chown any path, since they all
+ * have the right owner already. Without remembering owners, the
+ * transaction is applied by the daemon itself, using threads. */
+static int
+testDomainRelabel(const void *opaque)
+{
+    const struct testData *data = opaque;
+    g_autoptr(virDomainObj) vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    size_t nchowns;
+    int ret = -1;
+
+    if (prepareObjects(data->driver, data->file, &vm) < 0)
+        return -1;
+
+    priv = vm->privateData;
+    priv->rememberOwner = data->rememberOwner;
+
+    if (g_setenv(ENVVAR, "1", FALSE) == FALSE)
+        return -1;
+
+    checkParallelChown(!data->rememberOwner);
+
+    if (qemuSecuritySetAllLabel(data->driver, vm, NULL, false) < 0)
+        goto cleanup;
+
+    if (!data->rememberOwner && !checkParallelChown(false)) {
+        fprintf(stderr, "Paths were not chowned in parallel\n");
+        goto cleanup;
+    }
+
+    if (countChowns() == 0) {
+        fprintf(stderr, "No path was chowned\n");
+        goto cleanup;
+    }
+
+    if (qemuSecuritySetAllLabel(data->driver, vm, NULL, false) < 0)
+        goto cleanup;
+
+    if ((nchowns = countChowns()) > 0) {
+        fprintf(stderr, "Relabelling chowned %zu paths\n", nchowns);
+        goto cleanup;
+    }
+
+    if (data->rememberOwner) {
+        /* Every owner was remembered twice, so restore twice */
+        qemuSecurityRestoreAllLabel(data->driver, vm, false);
+        qemuSecurityRestoreAllLabel(data->driver, vm, false);
+
+        if (checkPaths(NULL) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    g_unsetenv(ENVVAR);
+    freePaths();
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -212,6 +274,19 @@ mymain(void)
     DO_TEST_DOMAIN("x86_64-q35-graphics");
     DO_TEST_DOMAIN("x86_64-q35-headless");
 
+#define DO_TEST_RELABEL(f) \
+    do { \
+        struct testData data = {.driver = &driver, .file = f}; \
+        if (virTestRun("relabel " f, testDomainRelabel, &data) < 0) \
+            ret = -1; \
+        data.rememberOwner = true; \
+        if (virTestRun("relabel " f " remembering owner", \
+                       testDomainRelabel, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_RELABEL("disk-scsi");
+
  cleanup:
     qemuTestDriverFree(&driver);
     return ret;
@@ -23,3 +23,7 @@
 extern int checkPaths(const char **paths);
 
 extern void freePaths(void);
+
+extern size_t countChowns(void);
+
+extern bool checkParallelChown(bool enable);
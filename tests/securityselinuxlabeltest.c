@@ -304,6 +304,20 @@ testSELinuxLabeling(const void *opaque)
     if (testSELinuxCheckLabels(files, nfiles) < 0)
         goto cleanup;
 
+    /* Label everything again within a transaction, as done when
+     * starting a domain. All labels are in place already. */
+    if (virSecurityManagerTransactionStart(mgr) < 0)
+        goto cleanup;
+    if (virSecurityManagerSetAllLabel(mgr, def, NULL, false, false) < 0) {
+        virSecurityManagerTransactionAbort(mgr);
+        goto cleanup;
+    }
+    if (virSecurityManagerTransactionCommit(mgr, -1, false) < 0)
+        goto cleanup;
+
+    if (testSELinuxCheckLabels(files, nfiles) < 0)
+        goto cleanup;
+
     ret = 0;
 
  cleanup:
@@ -708,6 +708,130 @@ test16(const void *opaque G_GNUC_UNUSED)
 }
 
 
+/* virBitmapSetRange/virBitmapClearRange */
+static int
+test17(const void *opaque G_GNUC_UNUSED)
+{
+    size_t size = 200;
+    g_autoptr(virBitmap) map = virBitmapNew(size);
+    g_autoptr(virBitmap) ref = virBitmapNew(size);
+    size_t start;
+    size_t end;
+    size_t i;
+
+    for (start = 0; start < size; start++) {
+        for (end = start; end < size; end++) {
+            virBitmapClearAll(map);
+            virBitmapClearAll(ref);
+
+            if (virBitmapSetRange(map, start, end) < 0)
+                return -1;
+
+            for (i = start; i <= end; i++)
+                ignore_value(virBitmapSetBit(ref, i));
+
+            if (!virBitmapEqual(map, ref)) {
+                fprintf(stderr, "\n setting range %zu-%zu failed\n",
+                        start, end);
+                return -1;
+            }
+
+            virBitmapSetAll(map);
+            virBitmapSetAll(ref);
+
+            if (virBitmapClearRange(map, start, end) < 0)
+                return -1;
+
+            for (i = start; i <= end; i++)
+                ignore_value(virBitmapClearBit(ref, i));
+
+            if (!virBitmapEqual(map, ref)) {
+                fprintf(stderr, "\n clearing range %zu-%zu failed\n",
+                        start, end);
+                return -1;
+            }
+        }
+    }
+
+    if (virBitmapSetRange(map, 0, size) == 0 ||
+        virBitmapClearRange(map, size, size) == 0 ||
+        virBitmapSetRange(map, 2, 1) == 0) {
+        fprintf(stderr, "\n out of range bits were accepted\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Timing of the bulk operations on a map sized like a big host */
+static int
+test18(const void *opaque G_GNUC_UNUSED)
+{
+    const char *pinnings[] = {
+        "0-4095",
+        "0-1023,2048-3071,^512",
+        "0,2,4,6,8,10,12,14,16,18,20,22,24,26,28,30,1024,2048,4095",
+    };
+    size_t iterations = 1000;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < G_N_ELEMENTS(pinnings); i++) {
+        g_autoptr(virBitmap) map = NULL;
+        g_autoptr(virBitmap) other = NULL;
+        g_autofree char *str = NULL;
+        gint64 start;
+        gint64 parse;
+        gint64 format;
+        gint64 bulk;
+
+        start = g_get_monotonic_time();
+        for (j = 0; j < iterations; j++) {
+            virBitmapFree(map);
+            if (virBitmapParse(pinnings[i], &map, 4096) < 0)
+                return -1;
+        }
+        parse = g_get_monotonic_time() - start;
+
+        start = g_get_monotonic_time();
+        for (j = 0; j < iterations; j++) {
+            VIR_FREE(str);
+            str = virBitmapFormat(map);
+        }
+        format = g_get_monotonic_time() - start;
+
+        /* The formatted string has to describe the very same map */
+        if (virBitmapParse(str, &other, 4096) < 0)
+            return -1;
+
+        if (!virBitmapEqual(map, other)) {
+            fprintf(stderr, "\n formatting '%s' gave '%s'\n",
+                    pinnings[i], str);
+            return -1;
+        }
+
+        start = g_get_monotonic_time();
+        for (j = 0; j < iterations; j++) {
+            if (!virBitmapEqual(map, other) ||
+                !virBitmapOverlaps(map, other) ||
+                virBitmapCountBits(map) != virBitmapCountBits(other) ||
+                virBitmapLastSetBit(map) != virBitmapLastSetBit(other))
+                return -1;
+            virBitmapIntersect(other, map);
+        }
+        bulk = g_get_monotonic_time() - start;
+
+        VIR_TEST_DEBUG("'%s': parse %lld us, format %lld us, bulk %lld us "
+                       "per %zu iterations",
+                       str, (long long)parse, (long long)format,
+                       (long long)bulk, iterations);
+    }
+
+    return 0;
+}
+
+
 #define TESTBINARYOP(A, B, RES, FUNC) \
     testBinaryOpData.a = A; \
     testBinaryOpData.b = B; \
@@ -783,6 +907,10 @@ mymain(void)
 
     if (virTestRun("test16", test16, NULL) < 0)
         ret = -1;
+    if (virTestRun("test17", test17, NULL) < 0)
+        ret = -1;
+    if (virTestRun("test18", test18, NULL) < 0)
+        ret = -1;
 
     return ret;
 }
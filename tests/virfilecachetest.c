@@ -196,6 +196,42 @@ testFileCache(const void *opaque)
 }
 
 
+static int
+testFileCachePrefetch(const void *opaque)
+{
+    virFileCachePtr cache = (virFileCachePtr) opaque;
+    testFileCachePrivPtr testPriv = virFileCacheGetPriv(cache);
+    const char *names[] = { "prefetchA", "prefetchB", "cacheValid", NULL };
+    size_t i;
+
+    testPriv->dataSaved = false;
+    testPriv->newData = "ddd\n";
+    testPriv->expectData = "ddd\n";
+
+    if (virFileCachePrefetch(cache, names, 2) < 0)
+        return -1;
+
+    /* Lookups wait for the prefetch threads, "cacheValid" was already
+     * cached by the previous test and must not be created again */
+    for (i = 0; i < 2; i++) {
+        g_autoptr(virObject) obj = virFileCacheLookup(cache, names[i]);
+        testFileCacheObjPtr data = (testFileCacheObjPtr) obj;
+
+        if (!data || STRNEQ_NULLABLE(data->data, "ddd\n")) {
+            fprintf(stderr, "Expect prefetched data for '%s'.\n", names[i]);
+            return -1;
+        }
+    }
+
+    if (!testPriv->dataSaved) {
+        fprintf(stderr, "Expect prefetched data to be saved.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -224,6 +260,9 @@ mymain(void)
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
 
+    if (virTestRun("prefetch", testFileCachePrefetch, cache) < 0)
+        ret = -1;
+
     virObjectUnref(cache);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
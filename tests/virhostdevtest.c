@@ -52,6 +52,7 @@ VIR_LOG_INIT("tests.hostdevtest");
     CHECK_LIST_COUNT(list, cnt, virNVMeDeviceListCount)
 
 # define TEST_STATE_DIR abs_builddir "/hostdevmgr"
+# define TEST_NVFS 2000
 static const char *drv_name = "test_driver";
 static const char *dom_name = "test_domain";
 static const unsigned char *uuid =
@@ -583,6 +584,89 @@ testNVMeDiskRoundtrip(const void *opaque G_GNUC_UNUSED)
 }
 
 
+/* Lookups in device lists are done for every device of every domain
+ * being started or stopped, make sure they don't depend on the number
+ * of devices already assigned on the host. */
+static int
+testVirHostdevPCIListBenchmark(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virPCIDeviceList) list = NULL;
+    gint64 start;
+    size_t i;
+
+    if (!(list = virPCIDeviceListNew()))
+        return -1;
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_NVFS; i++) {
+        g_autoptr(virPCIDevice) vf = NULL;
+        virPCIDeviceAddressPtr addr;
+
+        if (!(vf = virPCIDeviceCopy(dev[0])))
+            return -1;
+
+        addr = virPCIDeviceGetAddress(vf);
+        addr->bus = 0x10 + i / 256;
+        addr->slot = (i / 8) % 32;
+        addr->function = i % 8;
+
+        if (virPCIDeviceListAdd(list, vf) < 0)
+            return -1;
+        vf = NULL;
+    }
+    VIR_TEST_DEBUG("Adding %d devices took %lld us", TEST_NVFS,
+                   (long long) (g_get_monotonic_time() - start));
+
+    CHECK_PCI_LIST_COUNT(list, TEST_NVFS);
+
+    if (virPCIDeviceListAddCopy(list, virPCIDeviceListGet(list, 42)) == 0) {
+        VIR_TEST_DEBUG("Adding a duplicate device succeeded");
+        return -1;
+    }
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_NVFS; i++) {
+        virPCIDevicePtr vf;
+
+        vf = virPCIDeviceListFindByIDs(list, 0, 0x10 + i / 256,
+                                       (i / 8) % 32, i % 8);
+        if (!vf || virPCIDeviceListFind(list, vf) != vf) {
+            VIR_TEST_DEBUG("Device %zu not found", i);
+            return -1;
+        }
+    }
+    VIR_TEST_DEBUG("Looking up %d devices took %lld us", TEST_NVFS,
+                   (long long) (g_get_monotonic_time() - start));
+
+    /* Removing devices must keep lookups of the remaining ones working */
+    for (i = 0; i < TEST_NVFS; i += 2) {
+        virPCIDevicePtr vf = virPCIDeviceListFindByIDs(list, 0, 0x10 + i / 256,
+                                                       (i / 8) % 32, i % 8);
+
+        virPCIDeviceListDel(list, vf);
+    }
+
+    CHECK_PCI_LIST_COUNT(list, TEST_NVFS / 2);
+
+    for (i = 0; i < TEST_NVFS; i++) {
+        virPCIDevicePtr vf;
+
+        vf = virPCIDeviceListFindByIDs(list, 0, 0x10 + i / 256,
+                                       (i / 8) % 32, i % 8);
+        if (!!vf != (i % 2 == 1)) {
+            VIR_TEST_DEBUG("Unexpected lookup result for device %zu", i);
+            return -1;
+        }
+        if (vf && virPCIDeviceListFindIndex(list, vf) != i / 2) {
+            VIR_TEST_DEBUG("Unexpected index of device %zu", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 # define FAKEROOTDIRTEMPLATE abs_builddir "/fakerootdir-XXXXXX"
 
 static int
@@ -618,6 +702,7 @@ mymain(void)
     DO_TEST(testVirHostdevRoundtripMixed);
     DO_TEST(testVirHostdevOther);
     DO_TEST(testNVMeDiskRoundtrip);
+    DO_TEST(testVirHostdevPCIListBenchmark);
 
     myCleanup();
 
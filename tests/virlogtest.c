@@ -22,6 +22,9 @@
 #include "testutils.h"
 
 #include "virlog.h"
+#include "virthread.h"
+
+VIR_LOG_INIT("tests.logtest");
 
 struct testLogData {
     const char *str;
@@ -107,6 +110,171 @@ testLogParseFilters(const void *opaque)
     return ret;
 }
 
+#define TEST_LOG_MESSAGES 10000
+
+struct testLogThroughputData {
+    bool async;
+    size_t nthreads;
+};
+
+static int testLogCount;
+
+static void
+testLogOutputCount(virLogSourcePtr source,
+                   virLogPriority priority G_GNUC_UNUSED,
+                   const char *filename G_GNUC_UNUSED,
+                   int linenr G_GNUC_UNUSED,
+                   const char *funcname G_GNUC_UNUSED,
+                   const char *timestamp G_GNUC_UNUSED,
+                   virLogMetadataPtr metadata G_GNUC_UNUSED,
+                   const char *rawstr G_GNUC_UNUSED,
+                   const char *str G_GNUC_UNUSED,
+                   void *data G_GNUC_UNUSED)
+{
+    /* skip the version and hostname messages */
+    if (source == &virLogSelf)
+        g_atomic_int_inc(&testLogCount);
+}
+
+static void
+testLogThroughputWorker(void *opaque G_GNUC_UNUSED)
+{
+    size_t i;
+
+    for (i = 0; i < TEST_LOG_MESSAGES; i++)
+        VIR_DEBUG("message %zu", i);
+}
+
+static int
+testLogThroughput(const void *opaque)
+{
+    const struct testLogThroughputData *data = opaque;
+    g_autofree virThread *threads = g_new0(virThread, data->nthreads);
+    virLogOutputPtr *outputs = g_new0(virLogOutputPtr, 1);
+    unsigned int dropped;
+    unsigned int expected = data->nthreads * TEST_LOG_MESSAGES;
+    gint64 start;
+    gint64 end;
+    size_t i;
+    int ret = -1;
+
+    if (!(outputs[0] = virLogOutputNew(testLogOutputCount, NULL, NULL,
+                                       VIR_LOG_DEBUG, VIR_LOG_TO_STDERR,
+                                       NULL)) ||
+        virLogDefineOutputs(outputs, 1) < 0) {
+        virLogOutputListFree(outputs, 1);
+        return -1;
+    }
+
+    if (virLogSetDefaultPriority(VIR_LOG_DEBUG) < 0 ||
+        virLogSetAsync(data->async) < 0)
+        goto cleanup;
+
+    g_atomic_int_set(&testLogCount, 0);
+    dropped = virLogGetAsyncDropped();
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < data->nthreads; i++) {
+        if (virThreadCreate(&threads[i], true,
+                            testLogThroughputWorker, NULL) < 0) {
+            while (i-- > 0)
+                virThreadJoin(&threads[i]);
+            goto cleanup;
+        }
+    }
+    for (i = 0; i < data->nthreads; i++)
+        virThreadJoin(&threads[i]);
+    virLogFlush();
+    end = g_get_monotonic_time();
+
+    dropped = virLogGetAsyncDropped() - dropped;
+
+    VIR_TEST_DEBUG("%s, %zu threads: %d messages logged, %u dropped in %lld us",
+                   data->async ? "async" : "sync", data->nthreads,
+                   g_atomic_int_get(&testLogCount), dropped,
+                   (long long)(end - start));
+
+    if ((unsigned int)g_atomic_int_get(&testLogCount) + dropped != expected) {
+        VIR_TEST_DEBUG("Expected %u messages, got %d logged and %u dropped",
+                       expected, g_atomic_int_get(&testLogCount), dropped);
+        goto cleanup;
+    }
+
+    if (!data->async && dropped != 0) {
+        VIR_TEST_DEBUG("Synchronous logging dropped %u messages", dropped);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    ignore_value(virLogSetAsync(false));
+    ignore_value(virLogReset());
+    return ret;
+}
+
+#define TEST_LOG_DISABLED_MESSAGES 10000000
+
+static const char *
+testLogDisabledArg(int *calls)
+{
+    (*calls)++;
+    return "arg";
+}
+
+/*
+ * Debug messages which the filters let through, but none of the outputs
+ * takes must neither be formatted nor have their arguments evaluated.
+ */
+static int
+testLogDisabled(const void *opaque G_GNUC_UNUSED)
+{
+    virLogOutputPtr *outputs = g_new0(virLogOutputPtr, 1);
+    int calls = 0;
+    gint64 start;
+    gint64 end;
+    size_t i;
+    int ret = -1;
+
+    if (!(outputs[0] = virLogOutputNew(testLogOutputCount, NULL, NULL,
+                                       VIR_LOG_WARN, VIR_LOG_TO_STDERR,
+                                       NULL)) ||
+        virLogDefineOutputs(outputs, 1) < 0) {
+        virLogOutputListFree(outputs, 1);
+        return -1;
+    }
+
+    if (virLogSetDefaultPriority(VIR_LOG_DEBUG) < 0)
+        goto cleanup;
+
+    g_atomic_int_set(&testLogCount, 0);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_LOG_DISABLED_MESSAGES; i++)
+        VIR_DEBUG("message %zu %s", i, testLogDisabledArg(&calls));
+    end = g_get_monotonic_time();
+
+    VIR_TEST_DEBUG("%d disabled messages in %lld us",
+                   TEST_LOG_DISABLED_MESSAGES, (long long)(end - start));
+
+    /* the very first message refreshes the source */
+    if (calls > 1 || g_atomic_int_get(&testLogCount) != 0) {
+        VIR_TEST_DEBUG("Disabled messages were processed: %d args evaluated, "
+                       "%d logged", calls, g_atomic_int_get(&testLogCount));
+        goto cleanup;
+    }
+
+    VIR_WARN("message");
+    if (g_atomic_int_get(&testLogCount) != 1) {
+        VIR_TEST_DEBUG("Enabled message was not logged");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    ignore_value(virLogReset());
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -151,6 +319,24 @@ mymain(void)
     TEST_PARSE_FILTERS_FAIL(":foo", 1);
     TEST_PARSE_FILTERS_FAIL("1:+", 1);
 
+#define TEST_THROUGHPUT(async, nthreads) \
+    do { \
+        struct testLogThroughputData data = { async, nthreads }; \
+        if (virTestRun("testLogThroughput " #async " " #nthreads, \
+                       testLogThroughput, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    TEST_THROUGHPUT(false, 1);
+    TEST_THROUGHPUT(false, 4);
+    TEST_THROUGHPUT(false, 16);
+    TEST_THROUGHPUT(true, 1);
+    TEST_THROUGHPUT(true, 4);
+    TEST_THROUGHPUT(true, 16);
+
+    if (virTestRun("testLogDisabled", testLogDisabled, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
@@ -39,6 +39,14 @@ struct testSetStruct {
     const bool hierarchical_class;
 };
 
+struct testPlugStruct {
+    const char *net_band;
+    const char *band;
+    const char *mac;
+    unsigned int id;
+    const char *exp_cmd;
+};
+
 #define PARSE(xml, var) \
     do { \
         int rc; \
@@ -63,6 +71,43 @@ struct testSetStruct {
             goto cleanup; \
     } while (0)
 
+/* Record the full command line of each tc run followed by the batch
+ * of commands fed to it, one per line and indented. */
+static void
+testVirNetDevBandwidthDryRun(const char *const*args,
+                             const char *const*env G_GNUC_UNUSED,
+                             const char *input,
+                             char **output G_GNUC_UNUSED,
+                             char **error G_GNUC_UNUSED,
+                             int *status,
+                             void *opaque)
+{
+    virBufferPtr buf = opaque;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    size_t i;
+
+    *status = 0;
+
+    for (i = 0; args[i]; i++) {
+        if (i > 0)
+            virBufferAddChar(buf, ' ');
+        virBufferAdd(buf, args[i], -1);
+    }
+    virBufferAddChar(buf, '\n');
+
+    if (!input)
+        return;
+
+    if (!(lines = virStringSplit(input, "\n", 0)))
+        return;
+
+    for (i = 0; lines[i]; i++) {
+        if (!*lines[i])
+            continue;
+        virBufferAsprintf(buf, "  %s\n", lines[i]);
+    }
+}
+
 static int
 testVirNetDevBandwidthSet(const void *data)
 {
@@ -78,7 +123,7 @@ testVirNetDevBandwidthSet(const void *data)
     if (!iface)
         iface = "eth0";
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    virCommandSetDryRun(NULL, testVirNetDevBandwidthDryRun, &buf);
 
     if (virNetDevBandwidthSet(iface, band, info->hierarchical_class, true) < 0)
         goto cleanup;
@@ -103,6 +148,81 @@ testVirNetDevBandwidthSet(const void *data)
     return ret;
 }
 
+static int
+testVirNetDevBandwidthPlug(const void *data)
+{
+    int ret = -1;
+    const struct testPlugStruct *info = data;
+    virNetDevBandwidthPtr net_band = NULL;
+    virNetDevBandwidthPtr band = NULL;
+    virMacAddr mac;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actual_cmd = NULL;
+
+    PARSE(info->net_band, net_band);
+    PARSE(info->band, band);
+
+    if (virMacAddrParse(info->mac, &mac) < 0)
+        goto cleanup;
+
+    virCommandSetDryRun(NULL, testVirNetDevBandwidthDryRun, &buf);
+
+    if (virNetDevBandwidthPlug("br0", net_band, &mac, band, info->id) < 0 ||
+        virNetDevBandwidthUnplug("br0", info->id) < 0)
+        goto cleanup;
+
+    actual_cmd = virBufferContentAndReset(&buf);
+
+    if (STRNEQ_NULLABLE(info->exp_cmd, actual_cmd)) {
+        virTestDifference(stderr,
+                          NULLSTR(info->exp_cmd),
+                          NULLSTR(actual_cmd));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virNetDevBandwidthFree(net_band);
+    virNetDevBandwidthFree(band);
+    return ret;
+}
+
+/* Names tc would misparse in batch mode are refused before tc is run */
+static int
+testVirNetDevBandwidthBadIfname(const void *data)
+{
+    int ret = -1;
+    const char *iface = data;
+    virNetDevBandwidthPtr band = NULL;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actual_cmd = NULL;
+
+    PARSE("<bandwidth>"
+          "  <inbound average='1024'/>"
+          "</bandwidth>", band);
+
+    virCommandSetDryRun(NULL, testVirNetDevBandwidthDryRun, &buf);
+
+    if (virNetDevBandwidthSet(iface, band, false, true) == 0) {
+        VIR_TEST_DEBUG("Setting bandwidth on '%s' was expected to fail",
+                       iface);
+        goto cleanup;
+    }
+
+    if ((actual_cmd = virBufferContentAndReset(&buf))) {
+        VIR_TEST_DEBUG("Unexpected tc run: %s", actual_cmd);
+        goto cleanup;
+    }
+
+    virResetLastError();
+    ret = 0;
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virNetDevBandwidthFree(band);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -119,6 +239,27 @@ mymain(void)
             ret = -1; \
     } while (0)
 
+#define DO_TEST_PLUG(Net_band, Band, Mac, Id, Exp_cmd) \
+    do { \
+        struct testPlugStruct data = {.net_band = Net_band, \
+                                      .band = Band, \
+                                      .mac = Mac, \
+                                      .id = Id, \
+                                      .exp_cmd = Exp_cmd}; \
+        if (virTestRun("virNetDevBandwidthPlug", \
+                       testVirNetDevBandwidthPlug, \
+                       &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#define DO_TEST_BAD_IFNAME(Iface) \
+    do { \
+        if (virTestRun("virNetDevBandwidthSet bad name " Iface, \
+                       testVirNetDevBandwidthBadIfname, \
+                       Iface) < 0) \
+            ret = -1; \
+    } while (0)
+
 
     DO_TEST_SET(NULL, NULL);
 
@@ -127,36 +268,68 @@ mymain(void)
     DO_TEST_SET(("<bandwidth>"
                  "  <inbound average='1024'/>"
                  "</bandwidth>"),
-                (TC " qdisc del dev eth0 root\n"
-                 TC " qdisc del dev eth0 ingress\n"
-                 TC " qdisc add dev eth0 root handle 1: htb default 1\n"
-                 TC " class add dev eth0 parent 1: classid 1:1 htb rate 1024kbps quantum 87\n"
-                 TC " qdisc add dev eth0 parent 1:1 handle 2: sfq perturb 10\n"
-                 TC " filter add dev eth0 parent 1:0 protocol all prio 1 handle 1 fw flowid 1\n"));
+                (TC " -force -batch -\n"
+                 "  qdisc del dev eth0 root\n"
+                 "  qdisc del dev eth0 ingress\n"
+                 TC " -batch -\n"
+                 "  qdisc add dev eth0 root handle 1: htb default 1\n"
+                 "  class add dev eth0 parent 1: classid 1:1 htb rate 1024kbps quantum 87\n"
+                 "  qdisc add dev eth0 parent 1:1 handle 2: sfq perturb 10\n"
+                 "  filter add dev eth0 parent 1:0 protocol all prio 1 handle 1 fw flowid 1\n"));
 
     DO_TEST_SET(("<bandwidth>"
                  "  <outbound average='1024'/>"
                  "</bandwidth>"),
-                (TC " qdisc del dev eth0 root\n"
-                 TC " qdisc del dev eth0 ingress\n"
-                 TC " qdisc add dev eth0 ingress\n"
-                 TC " filter add dev eth0 parent ffff: protocol all u32 match u32 0 0 "
+                (TC " -force -batch -\n"
+                 "  qdisc del dev eth0 root\n"
+                 "  qdisc del dev eth0 ingress\n"
+                 TC " -batch -\n"
+                 "  qdisc add dev eth0 ingress\n"
+                 "  filter add dev eth0 parent ffff: protocol all u32 match u32 0 0 "
                  "police rate 1024kbps burst 1024kb mtu 64kb drop flowid :1\n"));
 
     DO_TEST_SET(("<bandwidth>"
                  "  <inbound average='1' peak='2' floor='3' burst='4'/>"
                  "  <outbound average='5' peak='6' burst='7'/>"
                  "</bandwidth>"),
-                (TC " qdisc del dev eth0 root\n"
-                 TC " qdisc del dev eth0 ingress\n"
-                 TC " qdisc add dev eth0 root handle 1: htb default 1\n"
-                 TC " class add dev eth0 parent 1: classid 1:1 htb rate 1kbps ceil 2kbps burst 4kb quantum 1\n"
-                 TC " qdisc add dev eth0 parent 1:1 handle 2: sfq perturb 10\n"
-                 TC " filter add dev eth0 parent 1:0 protocol all prio 1 handle 1 fw flowid 1\n"
-                 TC " qdisc add dev eth0 ingress\n"
-                 TC " filter add dev eth0 parent ffff: protocol all u32 match u32 0 0 "
+                (TC " -force -batch -\n"
+                 "  qdisc del dev eth0 root\n"
+                 "  qdisc del dev eth0 ingress\n"
+                 TC " -batch -\n"
+                 "  qdisc add dev eth0 root handle 1: htb default 1\n"
+                 "  class add dev eth0 parent 1: classid 1:1 htb rate 1kbps ceil 2kbps burst 4kb quantum 1\n"
+                 "  qdisc add dev eth0 parent 1:1 handle 2: sfq perturb 10\n"
+                 "  filter add dev eth0 parent 1:0 protocol all prio 1 handle 1 fw flowid 1\n"
+                 "  qdisc add dev eth0 ingress\n"
+                 "  filter add dev eth0 parent ffff: protocol all u32 match u32 0 0 "
                  "police rate 5kbps burst 7kb mtu 64kb drop flowid :1\n"));
 
+    DO_TEST_PLUG(("<bandwidth>"
+                  "  <inbound average='1000' peak='5000'/>"
+                  "</bandwidth>"),
+                 ("<bandwidth>"
+                  "  <inbound average='100' floor='200'/>"
+                  "</bandwidth>"),
+                 "52:54:00:12:34:56", 10,
+                 (TC " -batch -\n"
+                  "  class add dev br0 parent 1:1 classid 1:a htb rate 200kbps ceil 5000kbps quantum 8\n"
+                  "  qdisc add dev br0 parent 1:a handle a: sfq perturb 10\n"
+                  "  filter add dev br0 protocol ip prio 2 handle 800::10 u32 "
+                  "match u16 0x0800 0xffff at -2 "
+                  "match u32 0x00123456 0xffffffff at -12 "
+                  "match u16 0x5254 0xffff at -14 flowid 1:a\n"
+                  TC " -force -batch -\n"
+                  "  qdisc del dev br0 handle a:\n"
+                  "  filter del dev br0 prio 2 handle 800::10 u32\n"
+                  "  class del dev br0 classid 1:a\n"));
+
+    DO_TEST_BAD_IFNAME("eth0 x");
+    DO_TEST_BAD_IFNAME("eth0\tx");
+    DO_TEST_BAD_IFNAME("#eth0");
+    DO_TEST_BAD_IFNAME("eth\"0");
+    DO_TEST_BAD_IFNAME("eth'0");
+    DO_TEST_BAD_IFNAME("eth\\0");
+
     return ret;
 }
 
@@ -34,6 +34,69 @@ virNetDevSysfsFile(char **pf_sysfs_device_link,
                                             NET_DEV_TEST_DATA_PREFIX, ifname, file);
     return 0;
 }
+
+# ifdef WITH_LIBNL
+#  include <linux/rtnetlink.h>
+
+#  include "virnetlink.h"
+
+struct testNetDevLink {
+    const char *ifname;
+    bool hasStats;
+    struct rtnl_link_stats64 stats;
+};
+
+static const struct testNetDevLink testNetDevLinks[] = {
+    { "lo", true, { .rx_bytes = 4096, .rx_packets = 64,
+                    .tx_bytes = 4096, .tx_packets = 64 } },
+    { "vnet0", true, { .rx_bytes = 1000, .rx_packets = 10, .rx_errors = 1,
+                       .rx_dropped = 2, .rx_missed_errors = 3,
+                       .tx_bytes = 2000, .tx_packets = 20, .tx_errors = 4,
+                       .tx_dropped = 5 } },
+    { "vnet1", true, { .rx_bytes = 3000, .rx_packets = 30,
+                       .tx_bytes = 4000, .tx_packets = 40 } },
+    { "testnostats0", false, { 0 } },
+};
+
+/* Replies to the RTM_GETLINK dump with the links above instead of the
+ * host's ones */
+int
+virNetlinkDumpCommand(struct nl_msg *nl_msg G_GNUC_UNUSED,
+                      virNetlinkDumpCallback callback,
+                      uint32_t src_pid G_GNUC_UNUSED,
+                      uint32_t dst_pid G_GNUC_UNUSED,
+                      unsigned int protocol G_GNUC_UNUSED,
+                      unsigned int groups G_GNUC_UNUSED,
+                      void *opaque)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(testNetDevLinks); i++) {
+        const struct testNetDevLink *link = &testNetDevLinks[i];
+        g_autoptr(virNetlinkMsg) msg = NULL;
+        struct ifinfomsg ifinfo = {
+            .ifi_family = AF_UNSPEC,
+            .ifi_index = i + 1,
+        };
+
+        if (!(msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_MULTI)))
+            abort();
+
+        if (nlmsg_append(msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0 ||
+            nla_put_string(msg, IFLA_IFNAME, link->ifname) < 0)
+            abort();
+
+        if (link->hasStats &&
+            nla_put(msg, IFLA_STATS64, sizeof(link->stats), &link->stats) < 0)
+            abort();
+
+        if (callback(nlmsg_hdr(msg), opaque) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+# endif /* WITH_LIBNL */
 #else
 /* Nothing to override on non-__linux__ platforms */
 #endif
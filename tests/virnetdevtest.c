@@ -23,6 +23,7 @@
 #ifdef __linux__
 
 # include "virnetdev.h"
+# include "virnetdevtap.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -59,6 +60,110 @@ testVirNetDevGetLinkInfo(const void *opaque)
     return 0;
 }
 
+# ifdef WITH_LIBNL
+struct testVirNetDevTapStatsData {
+    const char *ifname;         /* ifname to look up */
+    bool swapped;               /* whether to swap RX/TX */
+    bool fail;                  /* whether the lookup is expected to fail */
+    virDomainInterfaceStatsStruct stats; /* expected stats */
+};
+
+static int
+testVirNetDevTapStatsCompare(const char *ifname,
+                             const virDomainInterfaceStatsStruct *actual,
+                             const virDomainInterfaceStatsStruct *expected)
+{
+#  define CHECK_FIELD(field) \
+    if (actual->field != expected->field) { \
+        fprintf(stderr, \
+                "Fetched %s of %s (%lld) doesn't match the expected one (%lld)\n", \
+                #field, ifname, actual->field, expected->field); \
+        return -1; \
+    }
+
+    CHECK_FIELD(rx_bytes);
+    CHECK_FIELD(rx_packets);
+    CHECK_FIELD(rx_errs);
+    CHECK_FIELD(rx_drop);
+    CHECK_FIELD(tx_bytes);
+    CHECK_FIELD(tx_packets);
+    CHECK_FIELD(tx_errs);
+    CHECK_FIELD(tx_drop);
+
+#  undef CHECK_FIELD
+
+    return 0;
+}
+
+static int
+testVirNetDevTapStatsLookup(const void *opaque)
+{
+    const struct testVirNetDevTapStatsData *data = opaque;
+    g_autoptr(virNetDevTapStats) snapshot = NULL;
+    virDomainInterfaceStatsStruct stats = { 0 };
+    int rc;
+
+    if (!(snapshot = virNetDevTapStatsNew()))
+        return -1;
+
+    rc = virNetDevTapStatsLookup(snapshot, data->ifname, &stats, data->swapped);
+
+    if (data->fail) {
+        if (rc == 0) {
+            fprintf(stderr, "Looking up %s was expected to fail\n",
+                    data->ifname);
+            return -1;
+        }
+        virResetLastError();
+        return 0;
+    }
+
+    if (rc < 0)
+        return -1;
+
+    return testVirNetDevTapStatsCompare(data->ifname, &stats, &data->stats);
+}
+
+static int
+testVirNetDevTapStatsMultiple(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virNetDevTapStats) snapshot = NULL;
+    const struct {
+        const char *ifname;
+        long long rx_bytes;
+        long long tx_bytes;
+    } ifaces[] = {
+        { "vnet1", 3000, 4000 },
+        { "lo", 4096, 4096 },
+        { "vnet0", 1000, 2000 },
+        { "vnet1", 3000, 4000 },
+    };
+    size_t i;
+
+    if (!(snapshot = virNetDevTapStatsNew()))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(ifaces); i++) {
+        virDomainInterfaceStatsStruct stats = { 0 };
+
+        if (virNetDevTapStatsLookup(snapshot, ifaces[i].ifname,
+                                    &stats, false) < 0)
+            return -1;
+
+        if (stats.rx_bytes != ifaces[i].rx_bytes ||
+            stats.tx_bytes != ifaces[i].tx_bytes) {
+            fprintf(stderr,
+                    "Fetched traffic of %s (%lld/%lld) doesn't match the expected one (%lld/%lld)\n",
+                    ifaces[i].ifname, stats.rx_bytes, stats.tx_bytes,
+                    ifaces[i].rx_bytes, ifaces[i].tx_bytes);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+# endif /* WITH_LIBNL */
+
 static int
 mymain(void)
 {
@@ -76,6 +181,39 @@ mymain(void)
     DO_TEST_LINK("lo", VIR_NETDEV_IF_STATE_UNKNOWN, 0);
     DO_TEST_LINK("eth0-broken", VIR_NETDEV_IF_STATE_DOWN, 0);
 
+# ifdef WITH_LIBNL
+#  define DO_TEST_TAP_STATS_FULL(name, ifname, swapped, fail, ...) \
+    do { \
+        struct testVirNetDevTapStatsData data = { \
+            ifname, swapped, fail, __VA_ARGS__ \
+        }; \
+        if (virTestRun("Tap stats: " name, \
+                       testVirNetDevTapStatsLookup, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#  define DO_TEST_TAP_STATS(ifname, ...) \
+    DO_TEST_TAP_STATS_FULL(ifname, ifname, false, false, __VA_ARGS__)
+#  define DO_TEST_TAP_STATS_SWAPPED(ifname, ...) \
+    DO_TEST_TAP_STATS_FULL(ifname " swapped", ifname, true, false, __VA_ARGS__)
+#  define DO_TEST_TAP_STATS_FAIL(ifname) \
+    DO_TEST_TAP_STATS_FULL(ifname " missing", ifname, false, true, { 0 })
+
+    /* rx_drop includes rx_missed_errors as in /proc/net/dev */
+    DO_TEST_TAP_STATS("vnet0", { 1000, 10, 1, 5, 2000, 20, 4, 5 });
+    DO_TEST_TAP_STATS_SWAPPED("vnet0", { 2000, 20, 4, 5, 1000, 10, 1, 5 });
+    DO_TEST_TAP_STATS("vnet1", { 3000, 30, 0, 0, 4000, 40, 0, 0 });
+
+    /* Interfaces missing in the snapshot fall back to /proc/net/dev,
+     * which doesn't know them either */
+    DO_TEST_TAP_STATS_FAIL("testnostats0");
+    DO_TEST_TAP_STATS_FAIL("testmissing0");
+
+    if (virTestRun("Tap stats: multiple interfaces",
+                   testVirNetDevTapStatsMultiple, NULL) < 0)
+        ret = -1;
+# endif /* WITH_LIBNL */
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,297 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virnodedeviceobj.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Number of PCI devices in the synthetic device tree, each of them has
+ * a network interface and a mediated device as children. */
+#define TEST_NPCI 2000
+
+
+static virNodeDeviceDefPtr
+testNodeDeviceDefNew(const char *name,
+                     const char *sysfs_path,
+                     const char *parent,
+                     virNodeDevCapType type)
+{
+    virNodeDeviceDefPtr def = g_new0(virNodeDeviceDef, 1);
+
+    def->name = g_strdup(name);
+    def->sysfs_path = g_strdup(sysfs_path);
+    def->parent = g_strdup(parent);
+    def->caps = g_new0(virNodeDevCapsDef, 1);
+    def->caps->data.type = type;
+
+    return def;
+}
+
+
+static int
+testNodeDeviceAssign(virNodeDeviceObjListPtr devs,
+                     virNodeDeviceDefPtr def)
+{
+    virNodeDeviceObjPtr obj;
+
+    if (!(obj = virNodeDeviceObjListAssignDef(devs, def))) {
+        virNodeDeviceDefFree(def);
+        return -1;
+    }
+
+    virNodeDeviceObjEndAPI(&obj);
+    return 0;
+}
+
+
+/* Returns 0 if @sysfs_path resolves to @name, or to nothing if @name
+ * is NULL. */
+static int
+testNodeDeviceCheckSysfsPath(virNodeDeviceObjListPtr devs,
+                             const char *sysfs_path,
+                             const char *name)
+{
+    virNodeDeviceObjPtr obj;
+    int ret = -1;
+
+    obj = virNodeDeviceObjListFindBySysfsPath(devs, sysfs_path);
+
+    if (!name && !obj)
+        return 0;
+
+    if (!obj) {
+        VIR_TEST_DEBUG("No device found for '%s'", sysfs_path);
+        return -1;
+    }
+
+    if (STRNEQ_NULLABLE(virNodeDeviceObjGetDef(obj)->name, name)) {
+        VIR_TEST_DEBUG("Expected '%s' for '%s', got '%s'",
+                       NULLSTR(name), sysfs_path,
+                       virNodeDeviceObjGetDef(obj)->name);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virNodeDeviceObjEndAPI(&obj);
+    return ret;
+}
+
+
+/* Populate @devs with a synthetic device tree the same way udev
+ * enumeration does, i.e. looking up the parent by its sysfs path
+ * before adding each device. */
+static int
+testNodeDevicePopulate(virNodeDeviceObjListPtr devs)
+{
+    size_t i;
+
+    for (i = 0; i < TEST_NPCI; i++) {
+        g_autofree char *pciName = NULL;
+        g_autofree char *pciPath = NULL;
+        g_autofree char *netName = NULL;
+        g_autofree char *netPath = NULL;
+        g_autofree char *mdevUUID = NULL;
+        g_autofree char *mdevPath = NULL;
+        virNodeDeviceObjPtr parent;
+        virNodeDeviceDefPtr def;
+
+        pciName = g_strdup_printf("pci_0000_%02zx_%02zx_%zx",
+                                  i / 256, (i / 8) % 32, i % 8);
+        pciPath = g_strdup_printf("/sys/devices/pci0000:00/0000:%02zx:%02zx.%zx",
+                                  i / 256, (i / 8) % 32, i % 8);
+        netName = g_strdup_printf("net_eth%zu", i);
+        netPath = g_strdup_printf("%s/net/eth%zu", pciPath, i);
+        mdevUUID = g_strdup_printf("%08zx-0000-0000-0000-000000000000", i);
+        mdevPath = g_strdup_printf("%s/%s", pciPath, mdevUUID);
+
+        if (testNodeDeviceAssign(devs,
+                                 testNodeDeviceDefNew(pciName, pciPath,
+                                                      "computer",
+                                                      VIR_NODE_DEV_CAP_PCI_DEV)) < 0)
+            return -1;
+
+        if (!(parent = virNodeDeviceObjListFindBySysfsPath(devs, pciPath))) {
+            VIR_TEST_DEBUG("Parent '%s' not found", pciPath);
+            return -1;
+        }
+        virNodeDeviceObjEndAPI(&parent);
+
+        if (testNodeDeviceAssign(devs,
+                                 testNodeDeviceDefNew(netName, netPath, pciName,
+                                                      VIR_NODE_DEV_CAP_NET)) < 0)
+            return -1;
+
+        def = testNodeDeviceDefNew(mdevUUID, mdevPath, pciName,
+                                   VIR_NODE_DEV_CAP_MDEV);
+        def->caps->data.mdev.uuid = g_strdup(mdevUUID);
+        if (testNodeDeviceAssign(devs, def) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testNodeDeviceIndexes(const void *opaque G_GNUC_UNUSED)
+{
+    virNodeDeviceObjListPtr devs = NULL;
+    virNodeDeviceObjPtr obj = NULL;
+    virNodeDeviceDefPtr def;
+    int ret = -1;
+
+    if (!(devs = virNodeDeviceObjListNew()))
+        return -1;
+
+    if (testNodeDevicePopulate(devs) < 0)
+        goto cleanup;
+
+    if (testNodeDeviceCheckSysfsPath(devs, "/sys/devices/pci0000:00/0000:00:00.1",
+                                     "pci_0000_00_00_1") < 0 ||
+        testNodeDeviceCheckSysfsPath(devs, "/sys/devices/pci0000:00/0000:00:00.1/net/eth1",
+                                     "net_eth1") < 0 ||
+        testNodeDeviceCheckSysfsPath(devs, "/sys/devices/nonexistent", NULL) < 0)
+        goto cleanup;
+
+    if (!(obj = virNodeDeviceObjListFindMediatedDeviceByUUID(devs,
+                                                             "00000002-0000-0000-0000-000000000000")) ||
+        STRNEQ(virNodeDeviceObjGetDef(obj)->parent, "pci_0000_00_00_2")) {
+        VIR_TEST_DEBUG("Mediated device lookup failed");
+        goto cleanup;
+    }
+    virNodeDeviceObjEndAPI(&obj);
+
+    /* a change event may replace the definition and thus the sysfs path */
+    if (testNodeDeviceAssign(devs,
+                             testNodeDeviceDefNew("net_eth1",
+                                                  "/sys/devices/virtual/net/eth1",
+                                                  "computer",
+                                                  VIR_NODE_DEV_CAP_NET)) < 0)
+        goto cleanup;
+
+    if (testNodeDeviceCheckSysfsPath(devs, "/sys/devices/pci0000:00/0000:00:00.1/net/eth1",
+                                     NULL) < 0 ||
+        testNodeDeviceCheckSysfsPath(devs, "/sys/devices/virtual/net/eth1",
+                                     "net_eth1") < 0)
+        goto cleanup;
+
+    if (!(obj = virNodeDeviceObjListFindBySysfsPath(devs,
+                                                    "/sys/devices/virtual/net/eth1")))
+        goto cleanup;
+    virNodeDeviceObjListRemove(devs, obj);
+    virNodeDeviceObjEndAPI(&obj);
+
+    if (testNodeDeviceCheckSysfsPath(devs, "/sys/devices/virtual/net/eth1",
+                                     NULL) < 0)
+        goto cleanup;
+
+    /* vHBA parent lookup only considers SCSI hosts */
+    def = testNodeDeviceDefNew("scsi_host5", "/sys/devices/pci0000:00/host5",
+                               "computer", VIR_NODE_DEV_CAP_SCSI_HOST);
+    def->caps->data.scsi_host.host = 5;
+    def->caps->data.scsi_host.wwnn = g_strdup("2000000000000001");
+    def->caps->data.scsi_host.wwpn = g_strdup("1000000000000001");
+    def->caps->data.scsi_host.flags = VIR_NODE_DEV_CAP_FLAG_HBA_FC_HOST |
+                                      VIR_NODE_DEV_CAP_FLAG_HBA_VPORT_OPS;
+    if (testNodeDeviceAssign(devs, def) < 0)
+        goto cleanup;
+
+    def = testNodeDeviceDefNew("scsi_host6", NULL, NULL,
+                               VIR_NODE_DEV_CAP_SCSI_HOST);
+    def->parent_wwnn = g_strdup("2000000000000001");
+    def->parent_wwpn = g_strdup("1000000000000001");
+    if (virNodeDeviceObjListGetParentHost(devs, def) != 5) {
+        VIR_TEST_DEBUG("Parent host lookup by WWNs failed");
+        virNodeDeviceDefFree(def);
+        goto cleanup;
+    }
+    VIR_FREE(def->parent_wwnn);
+    VIR_FREE(def->parent_wwpn);
+    if (virNodeDeviceObjListGetParentHost(devs, def) != 5) {
+        VIR_TEST_DEBUG("Vport capable parent host lookup failed");
+        virNodeDeviceDefFree(def);
+        goto cleanup;
+    }
+    virNodeDeviceDefFree(def);
+
+    ret = 0;
+
+ cleanup:
+    virNodeDeviceObjEndAPI(&obj);
+    virNodeDeviceObjListFree(devs);
+    return ret;
+}
+
+
+static int
+testNodeDeviceBenchmark(const void *opaque G_GNUC_UNUSED)
+{
+    virNodeDeviceObjListPtr devs = NULL;
+    gint64 start;
+    size_t i;
+    int ret = -1;
+
+    if (!(devs = virNodeDeviceObjListNew()))
+        return -1;
+
+    start = g_get_monotonic_time();
+    if (testNodeDevicePopulate(devs) < 0)
+        goto cleanup;
+    VIR_TEST_DEBUG("Populating %d devices took %lld us",
+                   TEST_NPCI * 3,
+                   (long long) (g_get_monotonic_time() - start));
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_NPCI; i++) {
+        g_autofree char *uuid = NULL;
+        virNodeDeviceObjPtr obj;
+
+        uuid = g_strdup_printf("%08zx-0000-0000-0000-000000000000", i);
+        if (!(obj = virNodeDeviceObjListFindMediatedDeviceByUUID(devs, uuid)))
+            goto cleanup;
+        virNodeDeviceObjEndAPI(&obj);
+    }
+    VIR_TEST_DEBUG("Looking up %d mediated devices took %lld us",
+                   TEST_NPCI,
+                   (long long) (g_get_monotonic_time() - start));
+
+    ret = 0;
+
+ cleanup:
+    virNodeDeviceObjListFree(devs);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Indexes", testNodeDeviceIndexes, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Benchmark", testNodeDeviceBenchmark, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -29,13 +29,19 @@
 # include "virerror.h"
 # include "viralloc.h"
 # include "virlog.h"
+# include "virbitmap.h"
 # include "virportallocator.h"
 # include "virstring.h"
+# include "virthread.h"
 
 # define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("tests.portallocatortest");
 
+# define TEST_CONCURRENT_THREADS 8
+# define TEST_CONCURRENT_PORTS 100
+# define TEST_CONCURRENT_START 6000
+
 static int testAllocAll(const void *args G_GNUC_UNUSED)
 {
     virPortAllocatorRangePtr ports = virPortAllocatorRangeNew("test", 5900, 5909);
@@ -158,6 +164,103 @@ static int testAllocReuse(const void *args G_GNUC_UNUSED)
     return ret;
 }
 
+typedef struct _testAllocConcurrentData testAllocConcurrentData;
+struct _testAllocConcurrentData {
+    virPortAllocatorRangePtr ports;
+    unsigned short acquired[TEST_CONCURRENT_PORTS];
+    bool failed;
+};
+
+static void
+testAllocConcurrentWorker(void *opaque)
+{
+    testAllocConcurrentData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < TEST_CONCURRENT_PORTS; i++) {
+        if (virPortAllocatorAcquire(data->ports, &data->acquired[i]) < 0) {
+            data->failed = true;
+            return;
+        }
+    }
+}
+
+/* Several threads exhaust a range at once, each port must be handed
+ * out exactly once. */
+static int testAllocConcurrent(const void *args G_GNUC_UNUSED)
+{
+    virPortAllocatorRangePtr ports = NULL;
+    testAllocConcurrentData data[TEST_CONCURRENT_THREADS];
+    virThread threads[TEST_CONCURRENT_THREADS];
+    g_autoptr(virBitmap) seen = virBitmapNew(TEST_CONCURRENT_THREADS *
+                                             TEST_CONCURRENT_PORTS);
+    unsigned short extra = 0;
+    gint64 start;
+    size_t i, j;
+    int ret = -1;
+
+    memset(data, 0, sizeof(data));
+
+    if (!(ports = virPortAllocatorRangeNew("test", TEST_CONCURRENT_START,
+                                           TEST_CONCURRENT_START - 1 +
+                                           TEST_CONCURRENT_THREADS *
+                                           TEST_CONCURRENT_PORTS)))
+        return -1;
+
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < TEST_CONCURRENT_THREADS; i++) {
+        data[i].ports = ports;
+        if (virThreadCreate(&threads[i], true,
+                            testAllocConcurrentWorker, &data[i]) < 0) {
+            data[i].failed = true;
+            break;
+        }
+    }
+
+    for (j = 0; j < i; j++)
+        virThreadJoin(&threads[j]);
+
+    VIR_TEST_DEBUG("Acquiring %d ports in %d threads took %lld us",
+                   TEST_CONCURRENT_THREADS * TEST_CONCURRENT_PORTS,
+                   TEST_CONCURRENT_THREADS,
+                   (long long) (g_get_monotonic_time() - start));
+
+    for (i = 0; i < TEST_CONCURRENT_THREADS; i++) {
+        if (data[i].failed) {
+            VIR_TEST_DEBUG("Thread %zu failed to acquire a port", i);
+            goto cleanup;
+        }
+
+        for (j = 0; j < TEST_CONCURRENT_PORTS; j++) {
+            size_t bit = data[i].acquired[j] - TEST_CONCURRENT_START;
+
+            if (virBitmapIsBitSet(seen, bit)) {
+                VIR_TEST_DEBUG("Port %d acquired twice",
+                               data[i].acquired[j]);
+                goto cleanup;
+            }
+            ignore_value(virBitmapSetBit(seen, bit));
+        }
+    }
+
+    if (virPortAllocatorAcquire(ports, &extra) == 0) {
+        VIR_TEST_DEBUG("Expected error, got %d", extra);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < TEST_CONCURRENT_THREADS; i++) {
+        for (j = 0; j < TEST_CONCURRENT_PORTS; j++)
+            virPortAllocatorRelease(data[i].acquired[j]);
+    }
+    virPortAllocatorRelease(extra);
+
+    virPortAllocatorRangeFree(ports);
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -170,6 +273,9 @@ mymain(void)
     if (virTestRun("Test alloc reuse", testAllocReuse, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Test concurrent alloc", testAllocConcurrent, NULL) < 0)
+        ret = -1;
+
     g_setenv("LIBVIRT_TEST_IPV4ONLY", "really", TRUE);
 
     if (virTestRun("Test IPv4-only alloc all", testAllocAll, NULL) < 0)
@@ -111,6 +111,7 @@ findLease(const char *name,
     size_t nmacs = 0;
     size_t i;
     time_t now;
+    int rv;
 
     *address = NULL;
     *naddress = 0;
@@ -121,6 +122,19 @@ findLease(const char *name,
         goto cleanup;
     }
 
+    if ((now = time(NULL)) == (time_t)-1) {
+        DEBUG("Failed to get time");
+        goto cleanup;
+    }
+
+#if !defined(LIBVIRT_NSS_GUEST)
+    if ((rv = findLeasesIndex(leaseDir, name, NULL, 0, af, now,
+                              address, naddress, found)) < 0)
+        goto cleanup;
+    if (rv == 0)
+        goto done;
+#endif /* !LIBVIRT_NSS_GUEST */
+
     dir = opendir(leaseDir);
     if (!dir) {
         ERROR("Failed to open dir '%s'", leaseDir);
@@ -167,12 +181,13 @@ findLease(const char *name,
         goto cleanup;
     for (i = 0; i < nmacs; i++)
         DEBUG("  %s", macs[i]);
-#endif
 
-    if ((now = time(NULL)) == (time_t)-1) {
-        DEBUG("Failed to get time");
+    if ((rv = findLeasesIndex(leaseDir, name, macs, nmacs, af, now,
+                              address, naddress, found)) < 0)
         goto cleanup;
-    }
+    if (rv == 0)
+        goto done;
+#endif
 
     for (i = 0; i < nleaseFiles; i++) {
         if (findLeases(leaseFiles[i],
@@ -183,6 +198,7 @@ findLease(const char *name,
             goto cleanup;
     }
 
+ done:
     DEBUG("Found %zu addresses", *naddress);
     sortAddr(*address, *naddress);
 
@@ -20,17 +20,22 @@
 
 #include <config.h>
 
+#include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <yajl/yajl_gen.h>
 #include <yajl/yajl_parse.h>
 
 #include "libvirt_nss_leases.h"
 #include "libvirt_nss.h"
+#include "virleaseindex.h"
 
 enum {
     FIND_LEASES_STATE_START,
@@ -436,3 +441,251 @@ findLeases(const char *file,
         close(fd);
     return ret;
 }
+
+
+/* The lease index mapped by the last lookup. It is replaced once
+ * leaseshelper renames a new index into place. */
+static struct {
+    pthread_mutex_t lock;
+    void *map;
+    size_t len;
+    dev_t dev;
+    ino_t ino;
+} leaseIndex = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+static bool
+leaseIndexIsValid(const void *map,
+                  size_t len,
+                  const struct stat *dirsb)
+{
+    const virLeaseIndexHeader *hdr = map;
+    const char *strtab;
+    size_t recordsLen;
+
+    if (len < sizeof(*hdr) ||
+        memcmp(hdr->magic, VIR_LEASE_INDEX_MAGIC, VIR_LEASE_INDEX_MAGIC_LEN) != 0 ||
+        hdr->version != VIR_LEASE_INDEX_VERSION) {
+        DEBUG("Malformed lease index");
+        return false;
+    }
+
+    if ((len - sizeof(*hdr)) / sizeof(virLeaseIndexRecord) < hdr->nrecords) {
+        DEBUG("Truncated lease index");
+        return false;
+    }
+
+    recordsLen = hdr->nrecords * sizeof(virLeaseIndexRecord);
+    if (hdr->strtabLen == 0 ||
+        hdr->strtabLen != len - sizeof(*hdr) - recordsLen) {
+        DEBUG("Malformed lease index string table");
+        return false;
+    }
+
+    strtab = (const char *)map + sizeof(*hdr) + recordsLen;
+    if (strtab[hdr->strtabLen - 1] != '\0') {
+        DEBUG("Malformed lease index string table");
+        return false;
+    }
+
+    if (hdr->dirMtimeSec != dirsb->st_mtim.tv_sec ||
+        hdr->dirMtimeNsec != dirsb->st_mtim.tv_nsec) {
+        DEBUG("Lease index is stale");
+        return false;
+    }
+
+    return true;
+}
+
+
+static const char *
+leaseIndexString(const virLeaseIndexHeader *hdr,
+                 const char *strtab,
+                 uint32_t offset)
+{
+    if (offset >= hdr->strtabLen)
+        return NULL;
+
+    return strtab + offset;
+}
+
+
+static int
+leaseIndexAppend(const virLeaseIndexHeader *hdr,
+                 const char *strtab,
+                 const virLeaseIndexRecord *record,
+                 const char *name,
+                 int af,
+                 time_t now,
+                 leaseAddress **addrs,
+                 size_t *naddrs,
+                 bool *found)
+{
+    const char *ipaddr = leaseIndexString(hdr, strtab, record->ipaddr);
+
+    if (!ipaddr || !*ipaddr)
+        return 0;
+
+    if (record->expirytime < (long long)now) {
+        DEBUG("Entry expired at %lld vs now %lld",
+              (long long)record->expirytime, (long long)now);
+        return 0;
+    }
+
+    *found = true;
+
+    return appendAddr(name, addrs, naddrs, ipaddr, record->expirytime, af);
+}
+
+
+/**
+ * findLeasesIndex:
+ * @dir: lease directory
+ * @name: domain name to lookup
+ * @macs: MAC addresses of the domain, or NULL
+ * @nmacs: number of elements in @macs
+ * @af: address family
+ * @now: current time
+ * @addrs: all the addresses found for selected @af
+ * @naddrs: number of elements in @addrs array
+ * @found: whether @name has been found
+ *
+ * Look up leases in the index maintained by leaseshelper instead of
+ * parsing the lease files in @dir. If @nmacs is zero leases are
+ * matched by hostname, otherwise by MAC address.
+ *
+ * Returns -1 on error,
+ *          0 on success,
+ *          1 if the index is missing or stale and lease files have to
+ *            be parsed instead.
+ */
+int
+findLeasesIndex(const char *dir,
+                const char *name,
+                char **macs,
+                size_t nmacs,
+                int af,
+                time_t now,
+                leaseAddress **addrs,
+                size_t *naddrs,
+                bool *found)
+{
+    char *path = NULL;
+    int fd = -1;
+    int dirfd = -1;
+    struct stat sb;
+    struct stat dirsb;
+    const virLeaseIndexHeader *hdr;
+    const virLeaseIndexRecord *records;
+    const char *strtab;
+    size_t lo, hi, i, j;
+    int ret = -1;
+
+    if (asprintf(&path, "%s/%s", dir, VIR_LEASE_INDEX_FILE) < 0)
+        return -1;
+
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        fstat(fd, &sb) < 0 ||
+        (dirfd = open(dir, O_RDONLY | O_DIRECTORY)) < 0 ||
+        fstat(dirfd, &dirsb) < 0) {
+        DEBUG("Lease index %s is not available", path);
+        free(path);
+        if (dirfd != -1)
+            close(dirfd);
+        if (fd != -1)
+            close(fd);
+        return 1;
+    }
+    free(path);
+    close(dirfd);
+
+    pthread_mutex_lock(&leaseIndex.lock);
+
+    if (!leaseIndex.map ||
+        leaseIndex.dev != sb.st_dev ||
+        leaseIndex.ino != sb.st_ino ||
+        leaseIndex.len != (size_t)sb.st_size) {
+        if (leaseIndex.map)
+            munmap(leaseIndex.map, leaseIndex.len);
+        leaseIndex.map = NULL;
+        leaseIndex.len = 0;
+
+        if (sb.st_size > 0) {
+            leaseIndex.map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (leaseIndex.map == MAP_FAILED)
+                leaseIndex.map = NULL;
+        }
+
+        if (leaseIndex.map) {
+            leaseIndex.len = sb.st_size;
+            leaseIndex.dev = sb.st_dev;
+            leaseIndex.ino = sb.st_ino;
+        }
+    }
+
+    if (!leaseIndex.map ||
+        !leaseIndexIsValid(leaseIndex.map, leaseIndex.len, &dirsb)) {
+        ret = 1;
+        goto cleanup;
+    }
+
+    hdr = leaseIndex.map;
+    records = (const virLeaseIndexRecord *)(hdr + 1);
+    strtab = (const char *)(records + hdr->nrecords);
+
+    if (nmacs) {
+        for (i = 0; i < hdr->nrecords; i++) {
+            const char *macaddr = leaseIndexString(hdr, strtab, records[i].macaddr);
+
+            if (!macaddr)
+                continue;
+
+            for (j = 0; j < nmacs; j++) {
+                if (strcmp(macs[j], macaddr) == 0)
+                    break;
+            }
+            if (j == nmacs)
+                continue;
+
+            if (leaseIndexAppend(hdr, strtab, &records[i], name,
+                                 af, now, addrs, naddrs, found) < 0)
+                goto cleanup;
+        }
+    } else {
+        /* Records are sorted by hostname, find the first match */
+        lo = 0;
+        hi = hdr->nrecords;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            const char *hostname = leaseIndexString(hdr, strtab, records[mid].hostname);
+
+            if (!hostname || strcmp(hostname, name) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (i = lo; i < hdr->nrecords; i++) {
+            const char *hostname = leaseIndexString(hdr, strtab, records[i].hostname);
+
+            if (!hostname || strcmp(hostname, name) != 0)
+                break;
+
+            if (leaseIndexAppend(hdr, strtab, &records[i], name,
+                                 af, now, addrs, naddrs, found) < 0)
+                goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    pthread_mutex_unlock(&leaseIndex.lock);
+    if (ret < 0) {
+        free(*addrs);
+        *addrs = NULL;
+        *naddrs = 0;
+    }
+    close(fd);
+    return ret;
+}
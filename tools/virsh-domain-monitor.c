@@ -2199,6 +2199,19 @@ virshDomainStatsPrintRecord(vshControl *ctl G_GNUC_UNUSED,
     return true;
 }
 
+/* Maximum number of domains to fetch stats for in a single API call */
+#define VIRSH_DOMSTATS_CHUNK 128
+
+#define VIRSH_DOMSTATS_LIST_FLAGS \
+    (VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE | \
+     VIR_CONNECT_GET_ALL_DOMAINS_STATS_INACTIVE | \
+     VIR_CONNECT_GET_ALL_DOMAINS_STATS_PERSISTENT | \
+     VIR_CONNECT_GET_ALL_DOMAINS_STATS_TRANSIENT | \
+     VIR_CONNECT_GET_ALL_DOMAINS_STATS_RUNNING | \
+     VIR_CONNECT_GET_ALL_DOMAINS_STATS_PAUSED | \
+     VIR_CONNECT_GET_ALL_DOMAINS_STATS_SHUTOFF | \
+     VIR_CONNECT_GET_ALL_DOMAINS_STATS_OTHER)
+
 static bool
 cmdDomstats(vshControl *ctl, const vshCmd *cmd)
 {
@@ -2206,8 +2219,10 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     virDomainPtr *domlist = NULL;
     virDomainPtr dom;
     size_t ndoms = 0;
+    size_t i;
     virDomainStatsRecordPtr *records = NULL;
     virDomainStatsRecordPtr *next;
+    bool printed = false;
     bool raw = vshCommandOptBool(cmd, "raw");
     int flags = 0;
     const vshCmdOpt *opt = NULL;
@@ -2288,26 +2303,47 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
                 goto cleanup;
         }
 
-        if (virDomainListGetStats(domlist,
-                                  stats,
-                                  &records,
-                                  flags) < 0)
-            goto cleanup;
+        /* don't count the trailing NULL */
+        ndoms--;
     } else {
-       if ((virConnectGetAllDomainStats(priv->conn,
-                                        stats,
-                                        &records,
-                                        flags)) < 0)
-           goto cleanup;
+        /* The list filtering flags have the same values for both APIs,
+         * apply them when listing the domains so that the stats calls
+         * below don't have to. */
+        unsigned int listflags = flags & VIRSH_DOMSTATS_LIST_FLAGS;
+        int rc;
+
+        if ((rc = virConnectListAllDomains(priv->conn, &domlist,
+                                           listflags)) < 0)
+            goto cleanup;
+
+        ndoms = rc;
+        flags &= ~listflags;
     }
 
-    next = records;
-    while (*next) {
-        if (!virshDomainStatsPrintRecord(ctl, *next, raw))
+    /* Fetch and print the stats in chunks so that the output starts
+     * right away and memory usage doesn't grow with the number of
+     * domains on the host. */
+    for (i = 0; i < ndoms; i += VIRSH_DOMSTATS_CHUNK) {
+        size_t nchunk = MIN(VIRSH_DOMSTATS_CHUNK, ndoms - i);
+        g_autofree virDomainPtr *chunk = g_new0(virDomainPtr, nchunk + 1);
+
+        memcpy(chunk, domlist + i, nchunk * sizeof(*chunk));
+
+        if (virDomainListGetStats(chunk, stats, &records, flags) < 0)
             goto cleanup;
 
-        if (*(++next))
-            vshPrint(ctl, "\n");
+        for (next = records; *next; next++) {
+            if (printed)
+                vshPrint(ctl, "\n");
+
+            if (!virshDomainStatsPrintRecord(ctl, *next, raw))
+                goto cleanup;
+
+            printed = true;
+        }
+
+        virDomainStatsRecordListFree(records);
+        records = NULL;
     }
 
     ret = true;